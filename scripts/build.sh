@@ -100,6 +100,11 @@ echo -e "${GREEN}Build completed successfully!${NC}"
 echo -e "${GREEN}Executables are in: ${BUILD_DIR}/${NC}"
 echo -e "  - gopher_client"
 echo -e "  - gopherd"
+echo -e "  - gopher_codec_bench"
+echo -e "  - gopher_rx_bench"
+echo -e "  - gopher_crypto_bench"
+echo -e "  - gopher_replay"
+echo -e "  - gopher_path_check"
 
 # Optional: Run tests if they exist
 if [[ -f "Makefile" ]] && make -n test >/dev/null 2>&1; then
@@ -0,0 +1,138 @@
+#!/bin/bash
+# scripts/netns_rendezvous.sh - Rendezvous, hole punching and relay across NATs, on one machine
+#
+#   sudo scripts/netns_rendezvous.sh [nat|symmetric|routed|relay] [build dir]
+#
+# Two clients on separate LANs behind their own NAT router, and a gopherd
+# --rendezvous on the "internet" between them, all in network namespaces:
+#
+#   a 192.168.1.2 -- n1 -- 10.200.1.0/24 --+
+#                                          gw 10.200.1.1 (gopherd --rendezvous)
+#   b 192.168.2.2 -- n2 -- 10.200.2.0/24 --+
+#
+#   nat        iptables MASQUERADE on n1 and n2: hole punching should find a direct path
+#   symmetric  MASQUERADE --random-fully, a new port per destination: expect the relay
+#   routed     no NAT, the LANs are routed: direct path to the host addresses
+#   relay      like nat, but the clients skip the checks and relay
+#
+# gopher_path_check stands in for the clients (no camera needed).
+
+set -e
+
+RED='\033[0;31m'
+GREEN='\033[0;32m'
+YELLOW='\033[1;33m'
+NC='\033[0m' # No Color
+
+MODE="${1:-nat}"
+BUILD_DIR="$(cd "${2:-build}" && pwd)"
+PREFIX="gph"
+NAMESPACES="${PREFIX}-gw ${PREFIX}-n1 ${PREFIX}-n2 ${PREFIX}-a ${PREFIX}-b"
+
+case "${MODE}" in
+    nat|symmetric|routed|relay) ;;
+    *) echo "Unknown mode ${MODE}"; exit 2;;
+esac
+
+if [ "$(id -u)" != "0" ]; then
+    echo -e "${RED}Network namespaces need root${NC}"
+    exit 2
+fi
+for bin in gopherd gopher_path_check; do
+    if [ ! -x "${BUILD_DIR}/${bin}" ]; then
+        echo -e "${RED}${BUILD_DIR}/${bin} not found, build first${NC}"
+        exit 2
+    fi
+done
+if [ "${MODE}" != "routed" ] && ! command -v iptables >/dev/null 2>&1; then
+    echo -e "${RED}Mode ${MODE} needs iptables${NC}"
+    exit 2
+fi
+
+cleanup() {
+    [ -n "${GOPHERD_PID}" ] && kill "${GOPHERD_PID}" 2>/dev/null || true
+    for ns in ${NAMESPACES}; do
+        ip netns del "${ns}" 2>/dev/null || true
+    done
+}
+trap cleanup EXIT
+cleanup
+
+in_ns() {
+    local ns="$1"
+    shift
+    ip netns exec "${PREFIX}-${ns}" "$@"
+}
+
+# link <ns1> <addr1> <ns2> <addr2>: veth pair between two namespaces
+link() {
+    ip link add "${1}-${3}" netns "${PREFIX}-${1}" type veth peer name "${3}-${1}" netns "${PREFIX}-${3}"
+    in_ns "$1" ip addr add "$2" dev "${1}-${3}"
+    in_ns "$3" ip addr add "$4" dev "${3}-${1}"
+    in_ns "$1" ip link set "${1}-${3}" up
+    in_ns "$3" ip link set "${3}-${1}" up
+}
+
+echo -e "${YELLOW}Setting up namespaces (${MODE})...${NC}"
+for ns in ${NAMESPACES}; do
+    ip netns add "${ns}"
+    ip netns exec "${ns}" ip link set lo up
+done
+
+link gw 10.200.1.1/24 n1 10.200.1.2/24
+link gw 10.200.2.1/24 n2 10.200.2.2/24
+link n1 192.168.1.1/24 a 192.168.1.2/24
+link n2 192.168.2.1/24 b 192.168.2.2/24
+
+for side in 1 2; do
+    in_ns "n${side}" sysctl -qw net.ipv4.ip_forward=1
+    in_ns "n${side}" ip route add default via "10.200.${side}.1"
+done
+in_ns gw sysctl -qw net.ipv4.ip_forward=1
+in_ns a ip route add default via 192.168.1.1
+in_ns b ip route add default via 192.168.2.1
+
+if [ "${MODE}" = "routed" ]; then
+    in_ns gw ip route add 192.168.1.0/24 via 10.200.1.2
+    in_ns gw ip route add 192.168.2.0/24 via 10.200.2.2
+else
+    # Private addresses stay unroutable past the NATs, as on the internet
+    RANDOM_FULLY=""
+    [ "${MODE}" = "symmetric" ] && RANDOM_FULLY="--random-fully"
+    in_ns n1 iptables -t nat -A POSTROUTING -o n1-gw -j MASQUERADE ${RANDOM_FULLY}
+    in_ns n2 iptables -t nat -A POSTROUTING -o n2-gw -j MASQUERADE ${RANDOM_FULLY}
+fi
+
+# Not through in_ns: $! has to be gopherd itself for cleanup to stop it
+ip netns exec "${PREFIX}-gw" "${BUILD_DIR}/gopherd" --rendezvous --metrics-port 0 > /tmp/${PREFIX}-gopherd.log 2>&1 &
+GOPHERD_PID=$!
+sleep 0.5
+
+RELAY_FLAG=""
+[ "${MODE}" = "relay" ] && RELAY_FLAG="--relay"
+in_ns a "${BUILD_DIR}/gopher_path_check" --rendezvous 10.200.1.1 --name alice --peer bob ${RELAY_FLAG} \
+    > /tmp/${PREFIX}-a.log 2>&1 &
+A_PID=$!
+# The second side starts late, as when one user picks the other first
+sleep 1
+in_ns b "${BUILD_DIR}/gopher_path_check" --rendezvous 10.200.1.1 --name bob --peer alice ${RELAY_FLAG} \
+    > /tmp/${PREFIX}-b.log 2>&1 &
+B_PID=$!
+
+RESULT=0
+wait ${A_PID} || RESULT=1
+wait ${B_PID} || RESULT=1
+cat /tmp/${PREFIX}-a.log /tmp/${PREFIX}-b.log
+
+EXPECT="direct"
+[ "${MODE}" = "symmetric" ] || [ "${MODE}" = "relay" ] && EXPECT="relayed"
+for side in a b; do
+    grep -q ": ${EXPECT}, sent" /tmp/${PREFIX}-${side}.log || RESULT=1
+done
+
+if [ ${RESULT} = 0 ]; then
+    echo -e "${GREEN}${MODE}: both sides ${EXPECT}${NC}"
+else
+    echo -e "${RED}${MODE}: expected both sides ${EXPECT}${NC}"
+fi
+exit ${RESULT}
@@ -0,0 +1,140 @@
+#include "announcer.hpp"
+#include "thread_policy.hpp"
+
+#include <iostream>
+#include <algorithm>
+#include <set>
+
+bool Announcer::initialize(const std::string& gopher_name, uint16_t listening_port,
+                           const std::string& decodable_codecs, const std::string& identity_key,
+                           std::function<std::string()> local_ip_fn,
+                           std::function<std::vector<std::string>()> peer_snapshot_fn) {
+    name = gopher_name;
+    port = listening_port;
+    codecs = decodable_codecs;
+    public_key = identity_key;
+    local_ip = std::move(local_ip_fn);
+    peer_snapshot = std::move(peer_snapshot_fn);
+
+    // IPv4 group, scoped to the local segment
+    sock_v4 = socket(AF_INET, SOCK_DGRAM, 0);
+    if (sock_v4 >= 0) {
+        unsigned char ttl = 1, loop = 1; // loop so the local gopherd hears us too
+        setsockopt(sock_v4, IPPROTO_IP, IP_MULTICAST_TTL, &ttl, sizeof(ttl));
+        setsockopt(sock_v4, IPPROTO_IP, IP_MULTICAST_LOOP, &loop, sizeof(loop));
+        group_v4.sin_family = AF_INET;
+        group_v4.sin_port = htons(DISCOVERY_PORT);
+        inet_pton(AF_INET, MCAST_GROUP_V4, &group_v4.sin_addr);
+    }
+
+    // IPv6 link-local group, best effort
+    sock_v6 = socket(AF_INET6, SOCK_DGRAM, 0);
+    if (sock_v6 >= 0) {
+        int hops = 1, loop = 1;
+        setsockopt(sock_v6, IPPROTO_IPV6, IPV6_MULTICAST_HOPS, &hops, sizeof(hops));
+        setsockopt(sock_v6, IPPROTO_IPV6, IPV6_MULTICAST_LOOP, &loop, sizeof(loop));
+        group_v6.sin6_family = AF_INET6;
+        group_v6.sin6_port = htons(DISCOVERY_PORT);
+        inet_pton(AF_INET6, MCAST_GROUP_V6, &group_v6.sin6_addr);
+    }
+
+    if (sock_v4 < 0 && sock_v6 < 0) {
+        std::cerr << "Failed to open discovery sockets" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+void Announcer::start() {
+    if (running.exchange(true)) return;
+    worker = std::thread(&Announcer::loop, this);
+}
+
+void Announcer::stop() {
+    if (!running.exchange(false)) return;
+    wake_cv.notify_all();
+    if (worker.joinable()) worker.join();
+
+    Announcement bye;
+    bye.name = name;
+    bye.ip = local_ip();
+    bye.port = port;
+    bye.goodbye = true;
+    send(bye);
+}
+
+int Announcer::ttlFor(std::chrono::milliseconds next) const {
+    // The next announce is at most 1.5x away; allow one of them to be lost
+    auto ms = next.count() * 3;
+    return static_cast<int>(std::max<int64_t>(DEFAULT_ANNOUNCE_TTL / 3, (ms + 999) / 1000));
+}
+
+void Announcer::send(const Announcement& a) {
+    std::string message = format_announcement(a);
+    if (sock_v4 >= 0) {
+        sendto(sock_v4, message.c_str(), message.size(), 0, (sockaddr*)&group_v4, sizeof(group_v4));
+    }
+    if (sock_v6 >= 0) {
+        sendto(sock_v6, message.c_str(), message.size(), 0, (sockaddr*)&group_v6, sizeof(group_v6));
+    }
+}
+
+void Announcer::loop() {
+    apply_thread_policy(ThreadRole::BACKGROUND, "announcer");
+    using clock = std::chrono::steady_clock;
+    std::uniform_real_distribution<double> jitter(0.5, 1.5);
+    std::set<std::string> known;
+    bool peers_changed = false;
+
+    auto next_announce = clock::now(); // announce right away on startup
+    auto next_poll = clock::now() + peer_poll;
+
+    while (running) {
+        auto now = clock::now();
+
+        if (now >= next_poll) {
+            next_poll = now + peer_poll;
+            std::set<std::string> current;
+            for (auto& key : peer_snapshot()) current.insert(std::move(key));
+
+            bool newcomer = std::any_of(current.begin(), current.end(),
+                [&](const std::string& k) { return known.count(k) == 0; });
+            if (newcomer) {
+                // Tell the new peer about us now rather than after our backoff
+                interval = min_interval;
+                next_announce = now;
+            }
+            peers_changed |= current != known;
+            known = std::move(current);
+        }
+
+        if (now >= next_announce) {
+            Announcement a;
+            a.name = name;
+            a.ip = local_ip(); // re-resolved each time in case the address changed
+            a.port = port;
+            a.ttl = ttlFor(interval);
+            a.codecs = codecs;
+            a.key = public_key;
+            send(a);
+
+            auto jittered = std::chrono::duration_cast<std::chrono::milliseconds>(interval * jitter(rng));
+            next_announce = now + jittered;
+
+            // Stable peer set: back off. Any change keeps us at the current pace.
+            if (!peers_changed) {
+                interval = std::min(interval * 2, max_interval);
+            }
+            peers_changed = false;
+        }
+
+        std::unique_lock<std::mutex> lock(wake_mutex);
+        wake_cv.wait_until(lock, std::min(next_announce, next_poll), [this] { return !running; });
+    }
+}
+
+Announcer::~Announcer() {
+    stop();
+    if (sock_v4 >= 0) close(sock_v4);
+    if (sock_v6 >= 0) close(sock_v6);
+}
@@ -0,0 +1,66 @@
+#ifndef ANNOUNCER_HPP
+#define ANNOUNCER_HPP
+
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <random>
+#include <functional>
+#include <condition_variable>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+
+#include "discovery.hpp"
+
+/*
+  Multicast presence announcer. Announce intervals start at min_interval,
+  are jittered by +-50% so hosts do not fire in lockstep, and double on every
+  round where the peer set did not change, up to max_interval. A new peer
+  resets the interval and triggers an immediate announce so it learns about
+  us without waiting out our backoff. stop() sends a goodbye.
+*/
+class Announcer {
+private:
+    int sock_v4 = -1;
+    int sock_v6 = -1;
+    sockaddr_in group_v4{};
+    sockaddr_in6 group_v6{};
+
+    std::string name;
+    uint16_t port = 0;
+    std::string codecs;
+    std::string public_key;
+    std::function<std::string()> local_ip;
+    std::function<std::vector<std::string>()> peer_snapshot;
+
+    std::chrono::milliseconds min_interval{1000};
+    std::chrono::milliseconds max_interval{60000};
+    std::chrono::milliseconds interval{1000};
+    std::chrono::milliseconds peer_poll{1000};
+
+    std::thread worker;
+    std::atomic<bool> running{false};
+    std::mutex wake_mutex;
+    std::condition_variable wake_cv;
+    std::mt19937 rng{std::random_device{}()};
+
+    void loop();
+    void send(const Announcement& a);
+    int ttlFor(std::chrono::milliseconds next) const;
+
+public:
+    // peer_snapshot returns one key per currently known peer
+    bool initialize(const std::string& gopher_name, uint16_t listening_port,
+                    const std::string& decodable_codecs, const std::string& identity_key,
+                    std::function<std::string()> local_ip_fn,
+                    std::function<std::vector<std::string>()> peer_snapshot_fn);
+    void start();
+    void stop();
+    ~Announcer();
+};
+
+#endif // ANNOUNCER_HPP
@@ -0,0 +1,54 @@
+#ifndef AUDIO_COMMON_HPP
+#define AUDIO_COMMON_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+
+#include "media_packet.hpp"
+
+// Opus runs at 48 kHz; 20 ms frames are the latency/overhead sweet spot
+constexpr int AUDIO_SAMPLE_RATE   = 48000;
+constexpr int AUDIO_CHANNELS      = 1;
+constexpr int AUDIO_FRAME_MS      = 20;
+constexpr int AUDIO_FRAME_SAMPLES = AUDIO_SAMPLE_RATE * AUDIO_FRAME_MS / 1000;
+constexpr int AUDIO_BIT_RATE      = 32000;
+
+/*
+  Receiver playout clock in the sender's media clock domain: the pts of the
+  audio currently leaving the speaker. The audio playout thread re-anchors
+  it after every device write; video presentation is slaved to it.
+*/
+class AudioClock {
+private:
+    std::atomic<int64_t> anchor_pts_us{0};
+    std::atomic<int64_t> anchor_local_us{0};
+    std::atomic<bool> valid{false};
+
+public:
+    void anchor(int64_t pts_us) {
+        anchor_pts_us.store(pts_us, std::memory_order_relaxed);
+        anchor_local_us.store(media_clock_us(), std::memory_order_relaxed);
+        valid.store(true, std::memory_order_release);
+    }
+    void reset() { valid.store(false, std::memory_order_release); }
+    bool isValid() const { return valid.load(std::memory_order_acquire); }
+    // Extrapolated from the last anchor
+    int64_t nowUs() const {
+        return anchor_pts_us.load(std::memory_order_relaxed) +
+               (media_clock_us() - anchor_local_us.load(std::memory_order_relaxed));
+    }
+};
+
+AudioClock& playout_clock();
+
+// How long to hold a video frame with this pts before showing it. Negative
+// means it is late; 0 when there is no audio to follow.
+inline int64_t av_sync_delay_us(int64_t video_pts_us) {
+    AudioClock& clock = playout_clock();
+    if (!clock.isValid()) return 0;
+    return video_pts_us - clock.nowUs();
+}
+
+#endif // AUDIO_COMMON_HPP
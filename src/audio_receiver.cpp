@@ -0,0 +1,240 @@
+#include "audio_receiver.hpp"
+#include "metrics.hpp"
+#include "thread_policy.hpp"
+
+#include <cmath>
+#include <algorithm>
+
+static Counter& audio_played = metrics().counter("gopher_audio_frames_played_total", "20 ms audio frames played out");
+static Counter& audio_concealed = metrics().counter("gopher_audio_frames_concealed_total",
+                                                    "Audio frames synthesized by loss concealment");
+static Counter& audio_late = metrics().counter("gopher_audio_late_packets_total",
+                                               "Audio packets that arrived after their playout slot");
+static Gauge& jitter_depth = metrics().gauge("gopher_audio_jitter_buffer_depth", "Audio frames buffered");
+static Gauge& jitter_gauge = metrics().gauge("gopher_audio_jitter_microseconds", "Interarrival jitter estimate");
+
+// Longest Opus packet (120 ms), so any frame size the sender picks decodes
+static constexpr int OPUS_MAX_FRAME_SAMPLES = AUDIO_SAMPLE_RATE * 120 / 1000;
+
+AudioClock& playout_clock() {
+    static AudioClock clock;
+    return clock;
+}
+
+bool AudioReceiver::initialize(bool open_device) {
+    avdevice_register_all();
+
+    int err = OPUS_OK;
+    decoder = opus_decoder_create(AUDIO_SAMPLE_RATE, AUDIO_CHANNELS, &err);
+    if (!decoder) {
+        std::cerr << "Failed to open Opus decoder: " << opus_strerror(err) << std::endl;
+        return false;
+    }
+
+    if (open_device && !openOutput()) {
+        // Still decode and drive the A/V clock so video timing stays right
+        std::cerr << "No audio output device, playing silently" << std::endl;
+    }
+    return true;
+}
+
+bool AudioReceiver::openOutput() {
+#ifdef __APPLE__
+    const char* devices[] = { "audiotoolbox" };
+#else
+    const char* devices[] = { "pulse", "alsa" };
+#endif
+    for (const char* name : devices) {
+        const AVOutputFormat* fmt = av_guess_format(name, nullptr, nullptr);
+        if (!fmt) continue;
+        if (avformat_alloc_output_context2(&output_ctx, fmt, nullptr, "default") < 0) continue;
+
+        AVStream* st = avformat_new_stream(output_ctx, nullptr);
+        st->codecpar->codec_type = AVMEDIA_TYPE_AUDIO;
+        st->codecpar->codec_id = AV_CODEC_ID_PCM_S16LE;
+        st->codecpar->format = AV_SAMPLE_FMT_S16;
+        st->codecpar->sample_rate = AUDIO_SAMPLE_RATE;
+        av_channel_layout_default(&st->codecpar->ch_layout, AUDIO_CHANNELS);
+        st->time_base = {1, AUDIO_SAMPLE_RATE};
+
+        if (avformat_write_header(output_ctx, nullptr) >= 0) {
+            std::cout << "Audio output: " << name << std::endl;
+            return true;
+        }
+        avformat_free_context(output_ctx);
+        output_ctx = nullptr;
+    }
+    return false;
+}
+
+void AudioReceiver::push(uint32_t seq, int64_t pts_us, int64_t arrival_us, const uint8_t* data, size_t size) {
+    std::lock_guard<std::mutex> lock(buffer_mutex);
+
+    // Transit time is in mixed clock domains; only its variation matters
+    int64_t transit = arrival_us - pts_us;
+    if (have_transit) {
+        double d = std::abs(static_cast<double>(transit - last_transit_us));
+        jitter_us += (d - jitter_us) / 16.0;
+    }
+    last_transit_us = transit;
+    have_transit = true;
+    jitter_gauge.set(static_cast<int64_t>(jitter_us));
+    target_depth = std::min(10, std::max(2, 1 + (int)std::ceil(2.0 * jitter_us / (AUDIO_FRAME_MS * 1000))));
+
+    if (playing && static_cast<int32_t>(seq - next_seq) < 0) {
+        late_packets++; // its slot was already concealed
+        audio_late.inc();
+        return;
+    }
+
+    jitter_buffer[seq] = BufferedPacket{std::vector<uint8_t>(data, data + size), pts_us};
+    // Never hold more than a second of audio
+    while (jitter_buffer.size() > 50) jitter_buffer.erase(jitter_buffer.begin());
+    jitter_depth.set(jitter_buffer.size());
+    buffer_cv.notify_one();
+}
+
+bool AudioReceiver::decode(const BufferedPacket& packet, std::vector<int16_t>& pcm) {
+    pcm.resize(OPUS_MAX_FRAME_SAMPLES * AUDIO_CHANNELS);
+    int samples = opus_decode(decoder, packet.data.data(), static_cast<opus_int32>(packet.data.size()),
+                              pcm.data(), OPUS_MAX_FRAME_SAMPLES, 0);
+    pcm.resize(std::max(samples, 0) * AUDIO_CHANNELS);
+    return samples > 0;
+}
+
+// Packet-loss concealment by libopus: it extrapolates from the decoder state and fades out by itself
+void AudioReceiver::conceal(std::vector<int16_t>& pcm) {
+    consecutive_losses++;
+    pcm.resize(AUDIO_FRAME_SAMPLES * AUDIO_CHANNELS);
+    int samples = opus_decode(decoder, nullptr, 0, pcm.data(), AUDIO_FRAME_SAMPLES, 0);
+    if (samples != AUDIO_FRAME_SAMPLES) std::fill(pcm.begin(), pcm.end(), 0);
+}
+
+void AudioReceiver::output(const std::vector<int16_t>& pcm, int64_t pts_us) {
+    const int samples = static_cast<int>(pcm.size() / AUDIO_CHANNELS);
+    if (!output_ctx) {
+        // Paced by the playout loop: this frame starts playing now
+        playout_clock().anchor(pts_us);
+        return;
+    }
+
+    AVPacket* pkt = av_packet_alloc();
+    av_new_packet(pkt, pcm.size() * sizeof(int16_t));
+    memcpy(pkt->data, pcm.data(), pcm.size() * sizeof(int16_t));
+    pkt->pts = pkt->dts = samples_written;
+    pkt->duration = samples;
+    pkt->stream_index = 0;
+    av_write_frame(output_ctx, pkt); // blocks while the device buffer is full
+    av_packet_free(&pkt);
+    samples_written += samples;
+
+    // What is audible now is this frame's end minus whatever the device still holds
+    int64_t latency_us = 2 * AUDIO_FRAME_MS * 1000;
+    int64_t played_dts, wall;
+    if (av_get_output_timestamp(output_ctx, 0, &played_dts, &wall) >= 0) {
+        latency_us = (samples_written - played_dts) * 1000000 / AUDIO_SAMPLE_RATE;
+    }
+    int64_t frame_end_us = pts_us + (int64_t)samples * 1000000 / AUDIO_SAMPLE_RATE;
+    playout_clock().anchor(frame_end_us - latency_us);
+}
+
+bool AudioReceiver::playoutStep(bool wait) {
+    BufferedPacket packet;
+    bool have_packet = false;
+    {
+        std::unique_lock<std::mutex> lock(buffer_mutex);
+        if (!playing) {
+            // (Re)buffer until the jitter buffer reaches its target depth
+            if (wait) {
+                buffer_cv.wait_for(lock, std::chrono::milliseconds(AUDIO_FRAME_MS), [this] {
+                    return !running || (int)jitter_buffer.size() >= target_depth;
+                });
+            }
+            if ((int)jitter_buffer.size() < target_depth) return false;
+            playing = true;
+            next_seq = jitter_buffer.begin()->first;
+        }
+
+        auto it = jitter_buffer.find(next_seq);
+        if (it != jitter_buffer.end()) {
+            packet = std::move(it->second);
+            jitter_buffer.erase(it);
+            have_packet = true;
+        }
+        next_seq++;
+
+        // Anything at or before the playout point is now too late
+        while (!jitter_buffer.empty() &&
+               static_cast<int32_t>(jitter_buffer.begin()->first - next_seq) < 0) {
+            jitter_buffer.erase(jitter_buffer.begin());
+            late_packets++;
+            audio_late.inc();
+        }
+        jitter_depth.set(jitter_buffer.size());
+
+        // Sustained underrun: stop and rebuffer instead of concealing forever
+        if (!have_packet && jitter_buffer.empty() && consecutive_losses >= 10) {
+            playing = false;
+            return false;
+        }
+    }
+
+    if (have_packet && decode(packet, pcm)) {
+        last_pts_us = packet.pts_us;
+        consecutive_losses = 0;
+    } else {
+        conceal(pcm);
+        last_pts_us += AUDIO_FRAME_MS * 1000;
+        frames_concealed++;
+        audio_concealed.inc();
+    }
+
+    output(pcm, last_pts_us);
+    frames_played++;
+    audio_played.inc();
+    return true;
+}
+
+void AudioReceiver::run() {
+    apply_thread_policy(ThreadRole::AUDIO_PLAYOUT);
+
+    auto next_tick = std::chrono::steady_clock::now();
+    bool buffering = true;
+
+    while (running) {
+        if (!playoutStep(true)) {
+            buffering = true;
+            continue;
+        }
+        if (buffering) {
+            next_tick = std::chrono::steady_clock::now();
+            buffering = false;
+        }
+
+        if (!output_ctx) {
+            next_tick += std::chrono::milliseconds(AUDIO_FRAME_MS);
+            std::this_thread::sleep_until(next_tick);
+        }
+    }
+}
+
+void AudioReceiver::start() {
+    if (running.exchange(true)) return;
+    worker = std::thread(&AudioReceiver::run, this);
+}
+
+void AudioReceiver::stop() {
+    running = false;
+    buffer_cv.notify_all();
+    if (worker.joinable()) worker.join();
+    playout_clock().reset();
+}
+
+AudioReceiver::~AudioReceiver() {
+    stop();
+    if (output_ctx) {
+        av_write_trailer(output_ctx);
+        avformat_free_context(output_ctx);
+    }
+    if (decoder) opus_decoder_destroy(decoder);
+}
@@ -0,0 +1,80 @@
+#ifndef AUDIO_RECEIVER_HPP
+#define AUDIO_RECEIVER_HPP
+
+#include <map>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
+
+extern "C" {
+#include <libavdevice/avdevice.h>
+#include <libavformat/avformat.h>
+}
+#include <opus.h>
+
+#include "audio_common.hpp"
+
+/*
+  Receiver side of the audio path: an adaptive jitter buffer ordered by
+  sequence number, Opus decode, packet-loss concealment and playout on
+  its own real-time thread. Decoding goes straight to libopus so a lost
+  frame can be filled by its own concealment (opus_decode with no data). Playout re-anchors playout_clock() so video
+  presentation can follow the audio.
+*/
+class AudioReceiver {
+private:
+    struct BufferedPacket {
+        std::vector<uint8_t> data;
+        int64_t pts_us;
+    };
+
+    OpusDecoder* decoder = nullptr;
+    AVFormatContext* output_ctx = nullptr; // audio device, nullptr = paced by sleeping
+    int64_t samples_written = 0;
+
+    std::map<uint32_t, BufferedPacket> jitter_buffer;
+    std::mutex buffer_mutex;
+    std::condition_variable buffer_cv;
+    uint32_t next_seq = 0;
+    bool playing = false;
+
+    // RFC 3550 style interarrival jitter, in microseconds
+    double jitter_us = 0;
+    int64_t last_transit_us = 0;
+    bool have_transit = false;
+    int target_depth = 3; // frames buffered before playout starts
+
+    int consecutive_losses = 0;
+    int64_t last_pts_us = 0;
+
+    std::thread worker;
+    std::atomic<bool> running{false};
+
+    std::vector<int16_t> pcm;
+
+    bool openOutput();
+    bool decode(const BufferedPacket& packet, std::vector<int16_t>& pcm);
+    void conceal(std::vector<int16_t>& pcm);
+    void output(const std::vector<int16_t>& pcm, int64_t pts_us);
+    void run();
+
+public:
+    std::atomic<uint64_t> frames_played{0};
+    std::atomic<uint64_t> frames_concealed{0};
+    std::atomic<uint64_t> late_packets{0};
+
+    // Without a device, playout is paced by sleeping (or driven by playoutStep)
+    bool initialize(bool open_device = true);
+    // arrival_us: local media clock when the frame completed
+    void push(uint32_t seq, int64_t pts_us, int64_t arrival_us, const uint8_t* data, size_t size);
+    // Plays one 20 ms slot; false while (re)buffering. wait: block briefly for data.
+    // Trace replay calls this directly instead of start().
+    bool playoutStep(bool wait);
+    void start();
+    void stop();
+    ~AudioReceiver();
+};
+
+#endif // AUDIO_RECEIVER_HPP
@@ -0,0 +1,224 @@
+#include "audio_sender.hpp"
+#include "thread_policy.hpp"
+
+#include <cmath>
+#include <vector>
+
+bool AudioSender::initialize(const std::string& source, FFmpegSender* transport) {
+    this->transport = transport;
+    avdevice_register_all();
+
+    if (!openEncoder()) {
+        std::cerr << "Failed to open Opus encoder" << std::endl;
+        return false;
+    }
+    if (!openInput(source)) {
+        std::cerr << "Failed to open audio source " << source << std::endl;
+        return false;
+    }
+
+    fifo = av_audio_fifo_alloc(encoder_ctx->sample_fmt, AUDIO_CHANNELS, AUDIO_FRAME_SAMPLES * 4);
+    return fifo != nullptr;
+}
+
+bool AudioSender::openEncoder() {
+    // libopus when available; the native encoder is still flagged experimental
+    const AVCodec* encoder = avcodec_find_encoder_by_name("libopus");
+    if (!encoder) encoder = avcodec_find_encoder(AV_CODEC_ID_OPUS);
+    if (!encoder) return false;
+
+    encoder_ctx = avcodec_alloc_context3(encoder);
+    encoder_ctx->sample_rate = AUDIO_SAMPLE_RATE;
+    av_channel_layout_default(&encoder_ctx->ch_layout, AUDIO_CHANNELS);
+    encoder_ctx->sample_fmt = encoder->sample_fmts ? encoder->sample_fmts[0] : AV_SAMPLE_FMT_S16;
+    encoder_ctx->bit_rate = AUDIO_BIT_RATE;
+    encoder_ctx->time_base = {1, AUDIO_SAMPLE_RATE};
+    encoder_ctx->strict_std_compliance = FF_COMPLIANCE_EXPERIMENTAL;
+
+    AVDictionary* opts = nullptr;
+    av_dict_set(&opts, "application", "voip", 0);
+    av_dict_set_int(&opts, "frame_duration", AUDIO_FRAME_MS, 0);
+    // No in-band FEC: the receiver never decodes the redundant copy from the next packet,
+    // it fills a lost frame with libopus concealment (audio_receiver.cpp)
+    int ret = avcodec_open2(encoder_ctx, encoder, &opts);
+    av_dict_free(&opts);
+    return ret >= 0;
+}
+
+bool AudioSender::openInput(const std::string& source) {
+    AVChannelLayout in_layout;
+    AVSampleFormat in_fmt;
+    int in_rate;
+
+    if (source.rfind("sine", 0) == 0) {
+        synthetic = true;
+        paced = true;
+        if (source.size() > 5) sine_hz = std::stod(source.substr(5));
+        av_channel_layout_default(&in_layout, 1);
+        in_fmt = AV_SAMPLE_FMT_S16;
+        in_rate = AUDIO_SAMPLE_RATE;
+    } else {
+        AVDictionary* options = nullptr;
+        const AVInputFormat* input_fmt = nullptr;
+        std::string url;
+
+        if (source.rfind("file:", 0) == 0) {
+            url = source.substr(5);
+            paced = true;
+        } else {
+#ifdef __APPLE__
+            input_fmt = av_find_input_format("avfoundation");
+            url = ":0"; // default microphone, no video
+#else
+            input_fmt = av_find_input_format("pulse");
+            if (!input_fmt) input_fmt = av_find_input_format("alsa");
+            url = "default";
+#endif
+            av_dict_set(&options, "sample_rate", "48000", 0);
+            av_dict_set(&options, "channels", "1", 0);
+        }
+
+        int ret = avformat_open_input(&input_ctx, url.c_str(), input_fmt, &options);
+        av_dict_free(&options);
+        if (ret < 0) return false;
+        if (avformat_find_stream_info(input_ctx, nullptr) < 0) return false;
+
+        const AVCodec* dec = nullptr;
+        stream_idx = av_find_best_stream(input_ctx, AVMEDIA_TYPE_AUDIO, -1, -1, &dec, 0);
+        if (stream_idx < 0 || !dec) return false;
+
+        input_dec = avcodec_alloc_context3(dec);
+        avcodec_parameters_to_context(input_dec, input_ctx->streams[stream_idx]->codecpar);
+        if (avcodec_open2(input_dec, dec, nullptr) < 0) return false;
+
+        av_channel_layout_copy(&in_layout, &input_dec->ch_layout);
+        in_fmt = input_dec->sample_fmt;
+        in_rate = input_dec->sample_rate;
+    }
+
+    int ret = swr_alloc_set_opts2(&swr_ctx,
+                                  &encoder_ctx->ch_layout, encoder_ctx->sample_fmt, AUDIO_SAMPLE_RATE,
+                                  &in_layout, in_fmt, in_rate, 0, nullptr);
+    av_channel_layout_uninit(&in_layout);
+    return ret >= 0 && swr_init(swr_ctx) >= 0;
+}
+
+// Pull one chunk from the source, resample it and append it to the fifo
+bool AudioSender::captureSome() {
+    auto push = [this](const uint8_t** in, int in_samples) {
+        int out_count = swr_get_out_samples(swr_ctx, in_samples);
+        uint8_t* out[AV_NUM_DATA_POINTERS] = {};
+        int linesize;
+        if (av_samples_alloc(out, &linesize, AUDIO_CHANNELS, out_count, encoder_ctx->sample_fmt, 0) < 0) return;
+        int got = swr_convert(swr_ctx, out, out_count, in, in_samples);
+        if (got > 0) av_audio_fifo_write(fifo, (void**)out, got);
+        av_freep(&out[0]);
+    };
+
+    if (synthetic) {
+        int16_t tone[AUDIO_FRAME_SAMPLES];
+        const double step = 2.0 * M_PI * sine_hz / AUDIO_SAMPLE_RATE;
+        for (int i = 0; i < AUDIO_FRAME_SAMPLES; i++) {
+            tone[i] = static_cast<int16_t>(8000.0 * std::sin(sine_phase));
+            sine_phase = std::fmod(sine_phase + step, 2.0 * M_PI);
+        }
+        const uint8_t* in[1] = { reinterpret_cast<const uint8_t*>(tone) };
+        push(in, AUDIO_FRAME_SAMPLES);
+        return true;
+    }
+
+    AVPacket* pkt = av_packet_alloc();
+    int ret = av_read_frame(input_ctx, pkt);
+    if (ret == AVERROR(EAGAIN)) {
+        av_packet_free(&pkt);
+        std::this_thread::sleep_for(std::chrono::milliseconds(2));
+        return true;
+    }
+    if (ret < 0) {
+        av_packet_free(&pkt);
+        if (!paced) return false;
+        // Loop file sources
+        av_seek_frame(input_ctx, stream_idx, 0, AVSEEK_FLAG_BACKWARD);
+        avcodec_flush_buffers(input_dec);
+        return true;
+    }
+
+    if (pkt->stream_index == stream_idx && avcodec_send_packet(input_dec, pkt) >= 0) {
+        AVFrame* frame = av_frame_alloc();
+        while (avcodec_receive_frame(input_dec, frame) >= 0) {
+            push(const_cast<const uint8_t**>(frame->extended_data), frame->nb_samples);
+        }
+        av_frame_free(&frame);
+    }
+    av_packet_free(&pkt);
+    return true;
+}
+
+void AudioSender::encodeAvailable() {
+    const int frame_size = encoder_ctx->frame_size > 0 ? encoder_ctx->frame_size : AUDIO_FRAME_SAMPLES;
+
+    while (av_audio_fifo_size(fifo) >= frame_size) {
+        AVFrame* frame = av_frame_alloc();
+        frame->nb_samples = frame_size;
+        frame->format = encoder_ctx->sample_fmt;
+        frame->sample_rate = AUDIO_SAMPLE_RATE;
+        av_channel_layout_copy(&frame->ch_layout, &encoder_ctx->ch_layout);
+        av_frame_get_buffer(frame, 0);
+        av_audio_fifo_read(fifo, (void**)frame->data, frame_size);
+
+        // First sample of this frame was captured (backlog + this frame) ago
+        int64_t backlog = av_audio_fifo_size(fifo) + frame_size;
+        int64_t pts_us = media_clock_us() - backlog * 1000000 / AUDIO_SAMPLE_RATE;
+        frame->pts = samples_encoded;
+        samples_encoded += frame_size;
+
+        if (avcodec_send_frame(encoder_ctx, frame) >= 0) {
+            AVPacket* pkt = av_packet_alloc();
+            while (avcodec_receive_packet(encoder_ctx, pkt) >= 0) {
+                transport->sendPacket(pkt, MEDIA_KIND_AUDIO, pts_us);
+                av_packet_unref(pkt);
+            }
+            av_packet_free(&pkt);
+        }
+        av_frame_free(&frame);
+    }
+}
+
+void AudioSender::run() {
+    apply_thread_policy(ThreadRole::AUDIO_CAPTURE);
+
+    // Pacing for sources that are not clocked by a capture device
+    const auto start = std::chrono::steady_clock::now();
+
+    while (running) {
+        if (!captureSome()) {
+            std::cerr << "Audio source ended" << std::endl;
+            break;
+        }
+        encodeAvailable();
+
+        if (paced) {
+            std::this_thread::sleep_until(start + std::chrono::microseconds(
+                samples_encoded * 1000000 / AUDIO_SAMPLE_RATE));
+        }
+    }
+}
+
+void AudioSender::start() {
+    if (running.exchange(true)) return;
+    worker = std::thread(&AudioSender::run, this);
+}
+
+void AudioSender::stop() {
+    running = false;
+    if (worker.joinable()) worker.join();
+}
+
+AudioSender::~AudioSender() {
+    stop();
+    if (fifo) av_audio_fifo_free(fifo);
+    if (swr_ctx) swr_free(&swr_ctx);
+    if (encoder_ctx) avcodec_free_context(&encoder_ctx);
+    if (input_dec) avcodec_free_context(&input_dec);
+    if (input_ctx) avformat_close_input(&input_ctx);
+}
@@ -0,0 +1,60 @@
+#ifndef AUDIO_SENDER_HPP
+#define AUDIO_SENDER_HPP
+
+#include <string>
+#include <thread>
+#include <atomic>
+
+extern "C" {
+#include <libavdevice/avdevice.h>
+#include <libavformat/avformat.h>
+#include <libavcodec/avcodec.h>
+#include <libavutil/audio_fifo.h>
+#include <libswresample/swresample.h>
+}
+
+#include "audio_common.hpp"
+#include "ffmpeg_sender.hpp"
+
+/*
+  Audio capture -> 48 kHz mono -> 20 ms Opus frames, sent through the
+  video sender's socket as MEDIA_KIND_AUDIO. Sources:
+    "device"        default microphone (avfoundation / pulse / alsa)
+    "file:<path>"   any file libavformat can read, looped, paced in real time
+    "sine[:<hz>]"   synthetic tone, for tests without hardware
+*/
+class AudioSender {
+private:
+    FFmpegSender* transport = nullptr; // not owned
+    AVFormatContext* input_ctx = nullptr;
+    AVCodecContext* input_dec = nullptr;
+    AVCodecContext* encoder_ctx = nullptr;
+    SwrContext* swr_ctx = nullptr;
+    AVAudioFifo* fifo = nullptr;
+    int stream_idx = -1;
+
+    bool synthetic = false;
+    bool paced = false;       // file/synthetic sources are not clocked by hardware
+    double sine_hz = 440.0;
+    double sine_phase = 0.0;
+    int64_t samples_encoded = 0;
+
+    std::thread worker;
+    std::atomic<bool> running{false};
+
+    bool openInput(const std::string& source);
+    bool openEncoder();
+    bool captureSome();
+    void encodeAvailable();
+    void run();
+
+public:
+    bool initialize(const std::string& source, FFmpegSender* transport);
+    // Encoder delay in 48 kHz samples, for the recording's OpusHead
+    int preSkip() const { return encoder_ctx ? encoder_ctx->initial_padding : 0; }
+    void start();
+    void stop();
+    ~AudioSender();
+};
+
+#endif // AUDIO_SENDER_HPP
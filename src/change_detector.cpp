@@ -0,0 +1,157 @@
+#include "change_detector.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+// Rows sampled per block (every other row of 16)
+constexpr int SAMPLED_ROWS = ChangeDetector::BLOCK / 2;
+
+// SAD of one block: SAMPLED_ROWS rows of 16 bytes, row pitch `stride` in both inputs
+static uint32_t block_sad(const uint8_t* a, const uint8_t* b, size_t stride) {
+#if defined(__SSE2__)
+    __m128i acc = _mm_setzero_si128();
+    for (int r = 0; r < SAMPLED_ROWS; r++) {
+        __m128i va = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + r * stride));
+        __m128i vb = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + r * stride));
+        acc = _mm_add_epi64(acc, _mm_sad_epu8(va, vb));
+    }
+    return _mm_cvtsi128_si32(acc) + _mm_cvtsi128_si32(_mm_srli_si128(acc, 8));
+#elif defined(__ARM_NEON)
+    uint16x8_t acc = vdupq_n_u16(0);
+    for (int r = 0; r < SAMPLED_ROWS; r++) {
+        uint8x16_t d = vabdq_u8(vld1q_u8(a + r * stride), vld1q_u8(b + r * stride));
+        acc = vpadalq_u8(acc, d); // 8 rows x 2 x 255 fits in u16
+    }
+    uint32x4_t sum4 = vpaddlq_u16(acc);
+    uint64x2_t sum2 = vpaddlq_u32(sum4);
+    return static_cast<uint32_t>(vgetq_lane_u64(sum2, 0) + vgetq_lane_u64(sum2, 1));
+#else
+    uint32_t sad = 0;
+    for (int r = 0; r < SAMPLED_ROWS; r++) {
+        for (int x = 0; x < 16; x++) {
+            int d = a[r * stride + x] - b[r * stride + x];
+            sad += d < 0 ? -d : d;
+        }
+    }
+    return sad;
+#endif
+}
+
+ChangeDetector::ChangeDetector(int threshold) : threshold(threshold) {}
+
+double ChangeDetector::analyze(const uint8_t* luma, int stride, int w, int h) {
+    if (w != width || h != height) {
+        width = w;
+        height = h;
+        blocks_w = w / BLOCK;
+        blocks_h = h / BLOCK;
+        reference.assign(static_cast<size_t>(blocks_w) * BLOCK * blocks_h * SAMPLED_ROWS, 0);
+        current.assign(reference.size(), 0);
+        changed.assign(static_cast<size_t>(blocks_w) * blocks_h, 1);
+        have_reference = false;
+    }
+
+    // Keep only the sampled rows, packed: row pitch blocks_w * BLOCK
+    const size_t pitch = static_cast<size_t>(blocks_w) * BLOCK;
+    for (int y = 0; y < blocks_h * SAMPLED_ROWS; y++) {
+        memcpy(&current[y * pitch], luma + static_cast<size_t>(2 * y) * stride, pitch);
+    }
+
+    if (!have_reference) {
+        std::fill(changed.begin(), changed.end(), 1);
+        changed_blocks = blocks_w * blocks_h;
+        changed_fraction = 1.0;
+        return changed_fraction;
+    }
+
+    const uint32_t limit = static_cast<uint32_t>(threshold) * BLOCK * SAMPLED_ROWS;
+    changed_blocks = 0;
+    for (int by = 0; by < blocks_h; by++) {
+        size_t row = static_cast<size_t>(by) * SAMPLED_ROWS * pitch;
+        for (int bx = 0; bx < blocks_w; bx++) {
+            size_t offset = row + bx * BLOCK;
+            bool hit = block_sad(&current[offset], &reference[offset], pitch) > limit;
+            changed[by * blocks_w + bx] = hit;
+            changed_blocks += hit;
+        }
+    }
+    int total = blocks_w * blocks_h;
+    changed_fraction = total > 0 ? double(changed_blocks) / total : 0.0;
+    return changed_fraction;
+}
+
+void ChangeDetector::commit() {
+    reference.swap(current);
+    have_reference = true;
+}
+
+void ChangeDetector::reset() {
+    have_reference = false;
+}
+
+ContentAdaptivePolicy::ContentAdaptivePolicy(int full_fps, int static_fps)
+    : full_fps(std::max(1, full_fps)), static_fps(std::max(1, static_fps)) {}
+
+bool ContentAdaptivePolicy::shouldEncode(const ChangeDetector& detector, int64_t now_us, bool force) {
+    if (detector.changedFraction() > STATIC_FRACTION) {
+        quiet_frames = 0;
+        static_scene = false;
+    } else if (++quiet_frames >= full_fps / 2) {
+        static_scene = true;
+    }
+
+    bool encode = force || !static_scene || now_us - last_encode_us >= 1000000 / static_fps;
+    if (encode) last_encode_us = now_us;
+    return encode;
+}
+
+void ContentAdaptivePolicy::applyRoi(const ChangeDetector& detector, AVFrame* f) const {
+    av_frame_remove_side_data(f, AV_FRAME_DATA_REGIONS_OF_INTEREST);
+    double fraction = detector.changedFraction();
+    if (fraction <= STATIC_FRACTION || fraction > ROI_MAX_FRACTION) return;
+
+    // One region per block row spanning its changed blocks, then the whole frame as background.
+    // Encoders give the first listed region priority where regions overlap.
+    std::vector<AVRegionOfInterest> regions;
+    const auto& map = detector.changedMap();
+    const int bw = detector.blocksWide();
+    for (int by = 0; by < detector.blocksHigh(); by++) {
+        int first = -1, last = -1;
+        for (int bx = 0; bx < bw; bx++) {
+            if (!map[by * bw + bx]) continue;
+            if (first < 0) first = bx;
+            last = bx;
+        }
+        if (first < 0) continue;
+        AVRegionOfInterest roi{};
+        roi.self_size = sizeof(AVRegionOfInterest);
+        roi.top = by * ChangeDetector::BLOCK;
+        roi.bottom = (by + 1) * ChangeDetector::BLOCK;
+        roi.left = first * ChangeDetector::BLOCK;
+        roi.right = (last + 1) * ChangeDetector::BLOCK;
+        roi.qoffset = AVRational{-1, 8};
+        regions.push_back(roi);
+    }
+    AVRegionOfInterest background{};
+    background.self_size = sizeof(AVRegionOfInterest);
+    background.right = f->width;
+    background.bottom = f->height;
+    background.qoffset = AVRational{1, 5};
+    regions.push_back(background);
+
+    AVFrameSideData* sd = av_frame_new_side_data(f, AV_FRAME_DATA_REGIONS_OF_INTEREST,
+                                                 regions.size() * sizeof(AVRegionOfInterest));
+    if (sd) memcpy(sd->data, regions.data(), sd->size);
+}
+
+void ContentAdaptivePolicy::reset() {
+    quiet_frames = 0;
+    static_scene = false;
+    last_encode_us = 0;
+}
@@ -0,0 +1,88 @@
+#ifndef CHANGE_DETECTOR_HPP
+#define CHANGE_DETECTOR_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+extern "C" {
+#include <libavutil/frame.h>
+}
+
+/*
+  Cheap scene-change detector for the encoder input. Luma is compared
+  with the last frame that was actually encoded, one 16x16 macroblock at
+  a time, using every other row of the block (a 2:1 vertical downsample).
+  Block SAD uses SSE2 psadbw on x86 and NEON absolute differences on ARM.
+  A 720p frame is compared in well under a millisecond.
+
+  Comparing against the last encoded frame rather than the previous
+  capture means a slow drift, such as a lighting change, still adds up to
+  a change.
+*/
+class ChangeDetector {
+public:
+    static constexpr int BLOCK = 16;
+
+    // threshold: mean absolute luma difference above which a block counts as changed
+    explicit ChangeDetector(int threshold = 4);
+
+    // Marks changed blocks against the reference; the first frame (or after reset) is all changed
+    double analyze(const uint8_t* luma, int stride, int width, int height);
+    // Current analyze()d frame becomes the reference; call when it is sent to the encoder
+    void commit();
+    void reset();
+
+    double changedFraction() const { return changed_fraction; }
+    int changedBlocks() const { return changed_blocks; }
+    int blocksWide() const { return blocks_w; }
+    int blocksHigh() const { return blocks_h; }
+    // Row-major, blocksWide() x blocksHigh(); 1 = changed
+    const std::vector<uint8_t>& changedMap() const { return changed; }
+
+private:
+    int threshold;
+    int width = 0;
+    int height = 0;
+    int blocks_w = 0;
+    int blocks_h = 0;
+    bool have_reference = false;
+    std::vector<uint8_t> reference; // sampled rows of the last committed frame
+    std::vector<uint8_t> current;   // sampled rows of the last analyzed frame
+    std::vector<uint8_t> changed;
+    int changed_blocks = 0;
+    double changed_fraction = 1.0;
+};
+
+/*
+  Frame rate and quality policy for a call, driven by ChangeDetector.
+  After half a second without meaningful change the scene counts as
+  static and is refreshed at static_fps. Any change goes back to full
+  rate on that same frame, so motion is never delayed. Only partly
+  changed frames get ROI side data: the moving blocks get a finer
+  quantizer and the still background a coarser one. Fully active
+  frames are left to the encoder.
+*/
+class ContentAdaptivePolicy {
+public:
+    ContentAdaptivePolicy(int full_fps, int static_fps = 3);
+
+    // Whether to encode this capture; force (keyframe requests) always encodes
+    bool shouldEncode(const ChangeDetector& detector, int64_t now_us, bool force);
+    bool isStatic() const { return static_scene; }
+    // Replaces f's ROI side data from the detector's changed map (or removes it)
+    void applyRoi(const ChangeDetector& detector, AVFrame* f) const;
+    void reset();
+
+private:
+    static constexpr double STATIC_FRACTION = 0.003; // ~10 macroblocks at 720p
+    static constexpr double ROI_MAX_FRACTION = 0.5;  // busier than this: no ROI
+
+    int full_fps;
+    int static_fps;
+    int quiet_frames = 0;
+    bool static_scene = false;
+    int64_t last_encode_us = 0;
+};
+
+#endif // CHANGE_DETECTOR_HPP
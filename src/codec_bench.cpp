@@ -0,0 +1,302 @@
+/*
+  gopher_codec_bench - encode the same recorded clip with every available
+  codec/preset and report CPU per frame, bitrate and PSNR/SSIM, so the
+  codec for a given link can be chosen from data.
+
+    gopher_codec_bench [clip] [--frames N] [--bitrate bps] [--codec vp9+av1] [--record DIR]
+
+  The clip defaults to out.mov and is looped until N frames are collected.
+  --record also remuxes each config's stream to DIR/<codec>-<preset>.mp4
+  and reports the recorder's CPU as a share of the encoder's.
+*/
+#include <iostream>
+#include <vector>
+#include <string>
+#include <cmath>
+#include <cstdio>
+#include <ctime>
+#include <algorithm>
+
+extern "C" {
+#include <libavformat/avformat.h>
+#include <libavcodec/avcodec.h>
+#include <libswscale/swscale.h>
+}
+
+#include "video_codec.hpp"
+#include "stream_recorder.hpp"
+
+struct BenchConfig {
+    VideoCodec codec;
+    std::string preset;
+    bool hardware;
+};
+
+struct BenchResult {
+    double cpu_ms_per_frame = 0;
+    double kbps = 0;
+    double psnr = 0;
+    double ssim = 0;
+    int frames = 0;
+    double record_percent = -1; // recorder CPU / encoder CPU, -1 if not recorded
+};
+
+static double cpu_seconds() {
+    // Process time so encoder worker threads are counted
+    timespec ts;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Decode up to max_frames of the clip into YUV420P, rewinding as needed
+static std::vector<AVFrame*> load_clip(const std::string& path, int max_frames, int& fps) {
+    std::vector<AVFrame*> frames;
+    AVFormatContext* fmt = nullptr;
+    if (avformat_open_input(&fmt, path.c_str(), nullptr, nullptr) < 0) {
+        std::cerr << "Failed to open " << path << std::endl;
+        return frames;
+    }
+    avformat_find_stream_info(fmt, nullptr);
+
+    int idx = av_find_best_stream(fmt, AVMEDIA_TYPE_VIDEO, -1, -1, nullptr, 0);
+    if (idx < 0) {
+        std::cerr << "No video stream in " << path << std::endl;
+        avformat_close_input(&fmt);
+        return frames;
+    }
+    AVStream* st = fmt->streams[idx];
+    fps = st->avg_frame_rate.num > 0 ? (int)std::lround(av_q2d(st->avg_frame_rate)) : 30;
+
+    const AVCodec* dec = avcodec_find_decoder(st->codecpar->codec_id);
+    AVCodecContext* dec_ctx = avcodec_alloc_context3(dec);
+    avcodec_parameters_to_context(dec_ctx, st->codecpar);
+    avcodec_open2(dec_ctx, dec, nullptr);
+
+    SwsContext* sws = nullptr;
+    AVPacket* pkt = av_packet_alloc();
+    AVFrame* raw = av_frame_alloc();
+    int decoded_this_pass = 1;
+
+    while ((int)frames.size() < max_frames && decoded_this_pass > 0) {
+        decoded_this_pass = 0;
+        while ((int)frames.size() < max_frames && av_read_frame(fmt, pkt) >= 0) {
+            if (pkt->stream_index == idx && avcodec_send_packet(dec_ctx, pkt) >= 0) {
+                while (avcodec_receive_frame(dec_ctx, raw) >= 0 && (int)frames.size() < max_frames) {
+                    sws = sws_getCachedContext(sws, raw->width, raw->height, (AVPixelFormat)raw->format,
+                                               raw->width & ~1, raw->height & ~1, AV_PIX_FMT_YUV420P,
+                                               SWS_BILINEAR, nullptr, nullptr, nullptr);
+                    AVFrame* yuv = av_frame_alloc();
+                    yuv->format = AV_PIX_FMT_YUV420P;
+                    yuv->width = raw->width & ~1;
+                    yuv->height = raw->height & ~1;
+                    av_frame_get_buffer(yuv, 0);
+                    sws_scale(sws, raw->data, raw->linesize, 0, raw->height, yuv->data, yuv->linesize);
+                    frames.push_back(yuv);
+                    decoded_this_pass++;
+                }
+            }
+            av_packet_unref(pkt);
+        }
+        // Loop the clip
+        av_seek_frame(fmt, idx, 0, AVSEEK_FLAG_BACKWARD);
+        avcodec_flush_buffers(dec_ctx);
+    }
+
+    sws_freeContext(sws);
+    av_frame_free(&raw);
+    av_packet_free(&pkt);
+    avcodec_free_context(&dec_ctx);
+    avformat_close_input(&fmt);
+    return frames;
+}
+
+static double plane_mse(const uint8_t* a, int a_stride, const uint8_t* b, int b_stride, int w, int h) {
+    double sum = 0;
+    for (int y = 0; y < h; y++) {
+        for (int x = 0; x < w; x++) {
+            int d = a[y * a_stride + x] - b[y * b_stride + x];
+            sum += d * d;
+        }
+    }
+    return sum / ((double)w * h);
+}
+
+static double psnr_yuv420(const AVFrame* ref, const AVFrame* dist) {
+    int w = ref->width, h = ref->height;
+    double mse_y = plane_mse(ref->data[0], ref->linesize[0], dist->data[0], dist->linesize[0], w, h);
+    double mse_u = plane_mse(ref->data[1], ref->linesize[1], dist->data[1], dist->linesize[1], w / 2, h / 2);
+    double mse_v = plane_mse(ref->data[2], ref->linesize[2], dist->data[2], dist->linesize[2], w / 2, h / 2);
+    double mse = (4 * mse_y + mse_u + mse_v) / 6.0; // weighted by sample count
+    return mse <= 0 ? 100.0 : 10.0 * std::log10(255.0 * 255.0 / mse);
+}
+
+// Luma SSIM over 8x8 windows with a stride of 4
+static double ssim_luma(const AVFrame* ref, const AVFrame* dist) {
+    const double c1 = (0.01 * 255) * (0.01 * 255);
+    const double c2 = (0.03 * 255) * (0.03 * 255);
+    double total = 0;
+    int windows = 0;
+
+    for (int y = 0; y + 8 <= ref->height; y += 4) {
+        for (int x = 0; x + 8 <= ref->width; x += 4) {
+            double sa = 0, sb = 0, saa = 0, sbb = 0, sab = 0;
+            for (int j = 0; j < 8; j++) {
+                const uint8_t* pa = ref->data[0] + (y + j) * ref->linesize[0] + x;
+                const uint8_t* pb = dist->data[0] + (y + j) * dist->linesize[0] + x;
+                for (int i = 0; i < 8; i++) {
+                    sa += pa[i];
+                    sb += pb[i];
+                    saa += pa[i] * pa[i];
+                    sbb += pb[i] * pb[i];
+                    sab += pa[i] * pb[i];
+                }
+            }
+            const double n = 64.0;
+            double ma = sa / n, mb = sb / n;
+            double va = saa / n - ma * ma, vb = sbb / n - mb * mb, cov = sab / n - ma * mb;
+            total += ((2 * ma * mb + c1) * (2 * cov + c2)) /
+                     ((ma * ma + mb * mb + c1) * (va + vb + c2));
+            windows++;
+        }
+    }
+    return windows ? total / windows : 1.0;
+}
+
+static bool run_config(const BenchConfig& cfg, const std::vector<AVFrame*>& clip, int fps,
+                       int64_t bit_rate, const std::string& record_dir, BenchResult& out) {
+    CodecSettings settings;
+    settings.codec = cfg.codec;
+    settings.preset = cfg.preset;
+    settings.width = clip.front()->width;
+    settings.height = clip.front()->height;
+    settings.fps = fps;
+    settings.bit_rate = bit_rate;
+    settings.gop = fps;
+    settings.allow_hardware = cfg.hardware;
+
+    AVCodecContext* enc = open_video_encoder(settings);
+    AVCodecContext* dec = open_video_decoder(cfg.codec);
+    if (!enc || !dec) {
+        if (enc) avcodec_free_context(&enc);
+        if (dec) avcodec_free_context(&dec);
+        return false;
+    }
+
+    // Encode the whole clip first so decode/metrics are not in the CPU figure
+    std::vector<AVPacket*> packets;
+    AVPacket* pkt = av_packet_alloc();
+    size_t total_bytes = 0;
+    double cpu_start = cpu_seconds();
+
+    for (size_t i = 0; i <= clip.size(); i++) {
+        AVFrame* f = nullptr;
+        if (i < clip.size()) {
+            f = clip[i];
+            f->pts = (int64_t)i;
+        }
+        if (avcodec_send_frame(enc, f) < 0) break; // nullptr drains the encoder
+        while (avcodec_receive_packet(enc, pkt) >= 0) {
+            total_bytes += pkt->size;
+            packets.push_back(av_packet_clone(pkt));
+            av_packet_unref(pkt);
+        }
+    }
+    double cpu_used = cpu_seconds() - cpu_start;
+
+    // Decode and compare against the source, frame for frame (no B-frames)
+    AVFrame* decoded = av_frame_alloc();
+    size_t idx = 0;
+    double psnr_sum = 0, ssim_sum = 0;
+    for (size_t i = 0; i <= packets.size(); i++) {
+        avcodec_send_packet(dec, i < packets.size() ? packets[i] : nullptr);
+        while (avcodec_receive_frame(dec, decoded) >= 0 && idx < clip.size()) {
+            psnr_sum += psnr_yuv420(clip[idx], decoded);
+            ssim_sum += ssim_luma(clip[idx], decoded);
+            idx++;
+        }
+    }
+
+    // Remux the same packets, separately from the encode timing above
+    if (!record_dir.empty()) {
+        StreamRecorder recorder;
+        if (recorder.open(record_dir + "/" + codec_name(cfg.codec) + "-" +
+                          (cfg.hardware ? "hw" : cfg.preset) + ".mp4", false)) {
+            recorder.setVideoSize(settings.width, settings.height);
+            for (auto* p : packets) {
+                recorder.writePacket(MEDIA_KIND_VIDEO, cfg.codec, p, p->pts * 1000000 / fps);
+            }
+            recorder.close();
+            auto st = recorder.stats();
+            out.record_percent = cpu_used > 0 ? 100.0 * (st.writer_cpu_ms + st.producer_cpu_ms) / (cpu_used * 1000.0)
+                                              : 0;
+        }
+    }
+
+    out.frames = (int)idx;
+    out.cpu_ms_per_frame = cpu_used * 1000.0 / clip.size();
+    out.kbps = total_bytes * 8.0 / (clip.size() / (double)fps) / 1000.0;
+    out.psnr = idx ? psnr_sum / idx : 0;
+    out.ssim = idx ? ssim_sum / idx : 0;
+
+    for (auto* p : packets) av_packet_free(&p);
+    av_frame_free(&decoded);
+    av_packet_free(&pkt);
+    avcodec_free_context(&enc);
+    avcodec_free_context(&dec);
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+    std::string clip_path = "out.mov";
+    int max_frames = 300;
+    int64_t bit_rate = 2000000;
+    std::vector<VideoCodec> only;
+    std::string record_dir;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--frames" && i + 1 < argc) max_frames = std::stoi(argv[++i]);
+        else if (arg == "--bitrate" && i + 1 < argc) bit_rate = std::stoll(argv[++i]);
+        else if (arg == "--codec" && i + 1 < argc) only = parse_codec_list(argv[++i]);
+        else if (arg == "--record" && i + 1 < argc) record_dir = argv[++i];
+        else clip_path = arg;
+    }
+
+    int fps = 30;
+    std::vector<AVFrame*> clip = load_clip(clip_path, max_frames, fps);
+    if (clip.empty()) return 1;
+    std::cout << "Clip: " << clip_path << " " << clip.front()->width << "x" << clip.front()->height
+              << " @" << fps << " fps, " << clip.size() << " frames, target "
+              << bit_rate / 1000 << " kbps" << std::endl;
+
+    // Real-time speed presets worth comparing per codec
+    std::vector<BenchConfig> configs = {
+        {VideoCodec::H264, "ultrafast", false}, {VideoCodec::H264, "superfast", false},
+        {VideoCodec::H264, "veryfast", false},  {VideoCodec::H264, "", true},
+        {VideoCodec::VP8, "12", false},         {VideoCodec::VP8, "8", false},
+        {VideoCodec::VP9, "8", false},          {VideoCodec::VP9, "7", false},
+        {VideoCodec::VP9, "6", false},
+        {VideoCodec::AV1, "12", false},         {VideoCodec::AV1, "10", false},
+    };
+
+    printf("%-6s %-10s %12s %10s %9s %8s %7s\n", "codec", "preset", "cpu ms/frm", "kbps", "PSNR dB", "SSIM",
+           record_dir.empty() ? "" : "rec %");
+    for (const auto& cfg : configs) {
+        if (!only.empty() && std::find(only.begin(), only.end(), cfg.codec) == only.end()) continue;
+        // Hardware row only when it would actually pick a hardware encoder
+        if (cfg.hardware && !avcodec_find_encoder_by_name("h264_videotoolbox")) continue;
+
+        BenchResult r;
+        if (!run_config(cfg, clip, fps, bit_rate, record_dir, r)) {
+            printf("%-6s %-10s %12s\n", codec_name(cfg.codec), cfg.preset.c_str(), "unavailable");
+            continue;
+        }
+        printf("%-6s %-10s %12.2f %10.0f %9.2f %8.4f", codec_name(cfg.codec),
+               cfg.hardware ? "hw" : cfg.preset.c_str(), r.cpu_ms_per_frame, r.kbps, r.psnr, r.ssim);
+        if (r.record_percent >= 0) printf(" %7.2f", r.record_percent);
+        printf("\n");
+    }
+
+    for (auto* f : clip) av_frame_free(&f);
+    return 0;
+}
@@ -0,0 +1,47 @@
+#include "codec_pool.hpp"
+
+AVCodecContext* CodecContextPool::acquire(const std::string& key,
+                                          const std::function<AVCodecContext*()>& open) {
+    {
+        std::lock_guard<std::mutex> lock(pool_mutex);
+        for (auto it = idle.begin(); it != idle.end(); ++it) {
+            if (it->key == key) {
+                AVCodecContext* ctx = it->ctx;
+                idle.erase(it);
+                return ctx;
+            }
+        }
+    }
+    return open();
+}
+
+void CodecContextPool::release(const std::string& key, AVCodecContext* ctx) {
+    if (!ctx) return;
+
+    // An encoder can only be reset if it supports flushing; otherwise it would carry the previous
+    // call's reference frames and rate-control state into the next one, so close it instead
+    if (av_codec_is_encoder(ctx->codec) && !(ctx->codec->capabilities & AV_CODEC_CAP_ENCODER_FLUSH)) {
+        avcodec_free_context(&ctx);
+        return;
+    }
+
+    // Drop any frames/packets buffered from the previous call
+    avcodec_flush_buffers(ctx);
+
+    std::lock_guard<std::mutex> lock(pool_mutex);
+    if (idle.size() >= max_idle) {
+        // Evict the oldest parked context
+        avcodec_free_context(&idle.front().ctx);
+        idle.erase(idle.begin());
+    }
+    idle.push_back(Entry{key, ctx});
+}
+
+CodecContextPool::~CodecContextPool() {
+    for (auto& e : idle) avcodec_free_context(&e.ctx);
+}
+
+CodecContextPool& codec_pool() {
+    static CodecContextPool pool;
+    return pool;
+}
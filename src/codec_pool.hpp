@@ -0,0 +1,43 @@
+#ifndef CODEC_POOL_HPP
+#define CODEC_POOL_HPP
+
+#include <string>
+#include <vector>
+#include <mutex>
+#include <functional>
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+}
+
+/*
+  Small pool of opened codec contexts shared across calls. Contexts are
+  keyed by a caller-chosen string that must capture everything baked in at
+  avcodec_open2 time (codec name, size, rate...). A released context is
+  flushed and parked; the next acquire with the same key gets it back
+  without reallocating or reopening the codec. Encoders without
+  AV_CODEC_CAP_ENCODER_FLUSH cannot be reset and are closed on release.
+*/
+class CodecContextPool {
+private:
+    struct Entry {
+        std::string key;
+        AVCodecContext* ctx;
+    };
+    std::vector<Entry> idle;
+    std::mutex pool_mutex;
+    size_t max_idle;
+
+public:
+    explicit CodecContextPool(size_t max_idle = 4) : max_idle(max_idle) {}
+
+    // Returns a pooled context for key, or calls open() to create one (may return nullptr)
+    AVCodecContext* acquire(const std::string& key, const std::function<AVCodecContext*()>& open);
+    void release(const std::string& key, AVCodecContext* ctx);
+    ~CodecContextPool();
+};
+
+// Process-wide pool used by the sender and receiver
+CodecContextPool& codec_pool();
+
+#endif // CODEC_POOL_HPP
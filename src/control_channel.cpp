@@ -0,0 +1,270 @@
+#include "control_channel.hpp"
+#include "metrics.hpp"
+#include "thread_policy.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <arpa/inet.h>
+
+static Histogram& rtt_time = metrics().histogram("gopher_rtt_seconds", "Round-trip time to the peer",
+                                                 {1000, 2000, 5000, 10000, 20000, 50000, 100000, 200000, 500000});
+static Gauge& peer_loss = metrics().gauge("gopher_peer_fraction_lost_per_mille",
+                                          "Share of our video frames the peer reported lost, last interval");
+static Gauge& peer_jitter = metrics().gauge("gopher_peer_jitter_microseconds",
+                                            "Interarrival jitter of our video at the peer");
+
+constexpr size_t REPORT_HEADER = 40;
+constexpr size_t ARRIVAL_SIZE = 12;
+constexpr size_t PING_SIZE = 16;
+
+static void put_u32(uint8_t* out, uint32_t v) {
+    v = htonl(v);
+    memcpy(out, &v, 4);
+}
+
+static uint32_t get_u32(const uint8_t* in) {
+    uint32_t v;
+    memcpy(&v, in, 4);
+    return ntohl(v);
+}
+
+static void put_i64(uint8_t* out, int64_t v) {
+    put_u32(out, static_cast<uint32_t>(static_cast<uint64_t>(v) >> 32));
+    put_u32(out + 4, static_cast<uint32_t>(v));
+}
+
+static int64_t get_i64(const uint8_t* in) {
+    return static_cast<int64_t>((static_cast<uint64_t>(get_u32(in)) << 32) | get_u32(in + 4));
+}
+
+void RttEstimator::addSample(int64_t rtt_us) {
+    latest_us = rtt_us;
+    if (srtt_us < 0) {
+        srtt_us = rtt_us;
+        rttvar_us = rtt_us / 2;
+    } else {
+        rttvar_us = (3 * rttvar_us + std::abs(srtt_us - rtt_us)) / 4;
+        srtt_us = (7 * srtt_us + rtt_us) / 8;
+    }
+    recent[count++ % MIN_WINDOW] = rtt_us;
+}
+
+int64_t RttEstimator::minimum() const {
+    if (count == 0) return -1;
+    size_t n = std::min<size_t>(count, MIN_WINDOW);
+    return *std::min_element(recent, recent + n);
+}
+
+void ControlChannel::start(SendFn fn) {
+    send = std::move(fn);
+    running = true;
+    worker = std::thread(&ControlChannel::loop, this);
+}
+
+void ControlChannel::stop() {
+    {
+        std::lock_guard<std::mutex> lock(wake_mutex);
+        running = false;
+    }
+    wake_cv.notify_all();
+    if (worker.joinable()) worker.join();
+}
+
+ControlChannel::~ControlChannel() {
+    stop();
+}
+
+void ControlChannel::loop() {
+    apply_thread_policy(ThreadRole::BACKGROUND, "control");
+    using namespace std::chrono;
+    auto next_report = steady_clock::now() + milliseconds(REPORT_INTERVAL_MS);
+    auto next_ping = steady_clock::now();
+    std::unique_lock<std::mutex> lock(wake_mutex);
+    while (running) {
+        wake_cv.wait_until(lock, std::min(next_report, next_ping), [this] { return !running; });
+        if (!running) break;
+        auto now = steady_clock::now();
+        lock.unlock();
+        if (now >= next_ping) {
+            sendPing();
+            next_ping = now + milliseconds(PING_INTERVAL_MS);
+        }
+        if (now >= next_report) {
+            sendReport();
+            next_report = now + milliseconds(REPORT_INTERVAL_MS);
+        }
+        lock.lock();
+    }
+}
+
+int ControlChannel::subscribe(Subscriber s) {
+    std::lock_guard<std::mutex> lock(subscriber_mutex);
+    subscribers.emplace_back(next_subscriber, std::move(s));
+    return next_subscriber++;
+}
+
+void ControlChannel::unsubscribe(int id) {
+    std::lock_guard<std::mutex> lock(subscriber_mutex);
+    subscribers.erase(std::remove_if(subscribers.begin(), subscribers.end(),
+                                     [id](const auto& s) { return s.first == id; }),
+                      subscribers.end());
+}
+
+LinkStats ControlChannel::stats() const {
+    std::lock_guard<std::mutex> lock(stats_mutex);
+    return link;
+}
+
+void ControlChannel::publish() {
+    LinkStats snapshot = stats();
+    std::lock_guard<std::mutex> lock(subscriber_mutex);
+    for (auto& s : subscribers) s.second(snapshot);
+}
+
+void ControlChannel::noteFrameComplete(uint8_t kind, uint32_t seq, int64_t pts_us, int64_t arrival_us) {
+    if (kind != MEDIA_KIND_VIDEO) return;
+    std::lock_guard<std::mutex> lock(stats_mutex);
+    if (!have_seq) {
+        have_seq = true;
+        base_seq = highest_seq = seq;
+    } else if (static_cast<int32_t>(seq - highest_seq) > 0) {
+        highest_seq = seq;
+    }
+    frames_received++;
+
+    // RFC 3550: the clocks differ, but only changes in transit time matter
+    int64_t transit = arrival_us - pts_us;
+    if (have_transit) {
+        double d = static_cast<double>(std::abs(transit - last_transit_us));
+        jitter_us += (d - jitter_us) / 16;
+    }
+    last_transit_us = transit;
+    have_transit = true;
+
+    if (arrivals.size() < MAX_ARRIVALS) arrivals.push_back(FrameArrival{seq, pts_us, arrival_us});
+}
+
+void ControlChannel::sendReport() {
+    ReceiverReport report;
+    {
+        std::lock_guard<std::mutex> lock(stats_mutex);
+        uint32_t expected = have_seq ? highest_seq - base_seq + 1 : 0;
+        report.highest_seq = highest_seq;
+        report.frames_received = frames_received;
+        report.frames_lost = expected > frames_received ? expected - frames_received : 0;
+        report.fragments_received = fragments_received.load(std::memory_order_relaxed);
+        report.jitter_us = static_cast<uint32_t>(jitter_us);
+
+        // RFC 3550 fraction lost over this interval; late frames can make it negative
+        int64_t expected_interval = static_cast<int64_t>(expected) - expected_prior;
+        int64_t lost_interval = expected_interval - (static_cast<int64_t>(frames_received) - received_prior);
+        expected_prior = expected;
+        received_prior = frames_received;
+        if (expected_interval > 0 && lost_interval > 0) {
+            int64_t fraction = (lost_interval << 8) / expected_interval;
+            report.fraction_lost = static_cast<uint8_t>(std::min<int64_t>(255, fraction));
+        }
+        report.arrivals.swap(arrivals);
+        link.local = report;
+    }
+
+    uint8_t payload[REPORT_HEADER + MAX_ARRIVALS * ARRIVAL_SIZE] = {};
+    const size_t n = report.arrivals.size();
+    payload[0] = CONTROL_REPORT;
+    payload[1] = static_cast<uint8_t>(n);
+    payload[2] = report.fraction_lost;
+    put_u32(payload + 4, report.highest_seq);
+    put_u32(payload + 8, report.frames_received);
+    put_u32(payload + 12, report.frames_lost);
+    put_u32(payload + 16, report.fragments_received);
+    put_u32(payload + 20, report.jitter_us);
+    int64_t base_pts = n ? report.arrivals[0].pts_us : 0;
+    int64_t base_arrival = n ? report.arrivals[0].arrival_us : 0;
+    put_i64(payload + 24, base_pts);
+    put_i64(payload + 32, base_arrival);
+    for (size_t i = 0; i < n; i++) {
+        uint8_t* entry = payload + REPORT_HEADER + i * ARRIVAL_SIZE;
+        put_u32(entry, report.arrivals[i].seq);
+        put_u32(entry + 4, static_cast<uint32_t>(report.arrivals[i].pts_us - base_pts));
+        put_u32(entry + 8, static_cast<uint32_t>(report.arrivals[i].arrival_us - base_arrival));
+    }
+    send(payload, REPORT_HEADER + n * ARRIVAL_SIZE);
+}
+
+void ControlChannel::sendPing() {
+    uint8_t payload[PING_SIZE] = {};
+    payload[0] = CONTROL_PING;
+    put_u32(payload + 4, next_ping++);
+    put_i64(payload + 8, media_clock_us());
+    send(payload, sizeof(payload));
+}
+
+void ControlChannel::handle(const uint8_t* payload, size_t len, int64_t arrival_us) {
+    if (len == 0) return;
+    switch (payload[0]) {
+    case CONTROL_PING:
+        if (len < PING_SIZE) return;
+        {
+            // Echo straight away so the peer's RTT excludes any of our queueing
+            uint8_t pong[PING_SIZE];
+            memcpy(pong, payload, PING_SIZE);
+            pong[0] = CONTROL_PONG;
+            send(pong, sizeof(pong));
+        }
+        return;
+
+    case CONTROL_PONG: {
+        if (len < PING_SIZE) return;
+        int64_t sample = arrival_us - get_i64(payload + 8);
+        if (sample < 0 || sample > 10000000) return; // not one of ours
+        {
+            std::lock_guard<std::mutex> lock(stats_mutex);
+            rtt.addSample(sample);
+            link.rtt_us = rtt.latest();
+            link.srtt_us = rtt.smoothed();
+            link.rttvar_us = rtt.variation();
+            link.min_rtt_us = rtt.minimum();
+            link.rtt_samples = rtt.samples();
+        }
+        rtt_time.observe(sample);
+        publish();
+        return;
+    }
+
+    case CONTROL_REPORT: {
+        if (len < REPORT_HEADER) return;
+        size_t n = std::min<size_t>(payload[1], (len - REPORT_HEADER) / ARRIVAL_SIZE);
+        ReceiverReport report;
+        report.fraction_lost = payload[2];
+        report.highest_seq = get_u32(payload + 4);
+        report.frames_received = get_u32(payload + 8);
+        report.frames_lost = get_u32(payload + 12);
+        report.fragments_received = get_u32(payload + 16);
+        report.jitter_us = get_u32(payload + 20);
+        int64_t base_pts = get_i64(payload + 24);
+        int64_t base_arrival = get_i64(payload + 32);
+        report.arrivals.resize(n);
+        for (size_t i = 0; i < n; i++) {
+            const uint8_t* entry = payload + REPORT_HEADER + i * ARRIVAL_SIZE;
+            report.arrivals[i].seq = get_u32(entry);
+            report.arrivals[i].pts_us = base_pts + static_cast<int32_t>(get_u32(entry + 4));
+            report.arrivals[i].arrival_us = base_arrival + static_cast<int32_t>(get_u32(entry + 8));
+        }
+        peer_loss.set(report.fraction_lost * 1000 / 256);
+        peer_jitter.set(report.jitter_us);
+        {
+            std::lock_guard<std::mutex> lock(stats_mutex);
+            link.remote = std::move(report);
+            link.remote_at_us = arrival_us;
+            link.have_remote = true;
+        }
+        publish();
+        return;
+    }
+
+    default:
+        return; // newer message types
+    }
+}
@@ -0,0 +1,153 @@
+#ifndef CONTROL_CHANNEL_HPP
+#define CONTROL_CHANNEL_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "media_packet.hpp"
+
+// RFC 6298 smoothing, plus the minimum over the last MIN_WINDOW samples
+class RttEstimator {
+public:
+    static constexpr size_t MIN_WINDOW = 32;
+
+    void addSample(int64_t rtt_us);
+    int64_t latest() const { return latest_us; }
+    int64_t smoothed() const { return srtt_us; }      // -1 before the first sample
+    int64_t variation() const { return rttvar_us; }
+    int64_t minimum() const;
+    // Retransmission-style timeout: srtt + 4 * rttvar
+    int64_t timeout() const { return srtt_us < 0 ? -1 : srtt_us + 4 * rttvar_us; }
+    uint32_t samples() const { return count; }
+
+private:
+    int64_t latest_us = -1;
+    int64_t srtt_us = -1;
+    int64_t rttvar_us = 0;
+    int64_t recent[MIN_WINDOW] = {};
+    uint32_t count = 0;
+};
+
+// Arrival of one complete video frame, for delay-gradient estimation
+struct FrameArrival {
+    uint32_t seq = 0;
+    int64_t pts_us = 0;     // sender's media clock
+    int64_t arrival_us = 0; // receiver's media clock
+};
+
+// What one side reports about the video it receives
+struct ReceiverReport {
+    uint32_t highest_seq = 0;
+    uint32_t frames_received = 0;    // cumulative, complete frames
+    uint32_t frames_lost = 0;        // cumulative: expected by sequence minus received
+    uint32_t fragments_received = 0; // cumulative, all kinds
+    uint8_t fraction_lost = 0;       // of the frames expected since the previous report, in 1/256
+    uint32_t jitter_us = 0;          // RFC 3550 interarrival jitter over video frames
+    std::vector<FrameArrival> arrivals; // frames completed since the previous report
+};
+
+struct LinkStats {
+    int64_t rtt_us = -1;       // latest ping
+    int64_t srtt_us = -1;
+    int64_t rttvar_us = 0;
+    int64_t min_rtt_us = -1;
+    uint32_t rtt_samples = 0;
+    bool have_remote = false;
+    ReceiverReport remote;     // how the peer receives our stream
+    int64_t remote_at_us = 0;  // local media clock when it arrived
+    ReceiverReport local;      // the last report we sent about the peer's stream
+};
+
+/*
+  Back-channel between the two ends of a call, multiplexed on the media
+  sockets as MEDIA_KIND_CONTROL datagrams and sealed like media
+  (media_crypto.hpp). Every REPORT_INTERVAL_MS each side sends a receiver
+  report on the video it gets. Every PING_INTERVAL_MS it sends a ping,
+  which the peer echoes at once. Payloads, all big endian:
+
+    REPORT  0 u8 CONTROL_REPORT  1 u8 arrival count  2 u8 fraction lost  3 u8 0
+            4 u32 highest seq  8 u32 frames received  12 u32 frames lost
+            16 u32 fragments received  20 u32 jitter us
+            24 i64 base pts  32 i64 base arrival
+            40 per arrival: u32 seq, i32 pts - base pts, i32 arrival - base arrival
+    PING    0 u8 CONTROL_PING  1..3 0  4 u32 id  8 i64 sender clock
+    PONG    the ping, echoed with CONTROL_PONG
+
+  The receive thread feeds note*() and dispatches handle(). A worker
+  thread sends the periodic messages. Subscribers run on the receive
+  thread after every pong and every report from the peer, and must not
+  block.
+*/
+class ControlChannel {
+public:
+    static constexpr uint8_t CONTROL_REPORT = 2; // 1 is MediaCrypto::CONTROL_KEY
+    static constexpr uint8_t CONTROL_PING = 3;
+    static constexpr uint8_t CONTROL_PONG = 4;
+    static constexpr int REPORT_INTERVAL_MS = 200;
+    static constexpr int PING_INTERVAL_MS = 500;
+    static constexpr size_t MAX_ARRIVALS = 64;
+
+    using SendFn = std::function<void(const uint8_t* payload, size_t len)>;
+    using Subscriber = std::function<void(const LinkStats&)>;
+
+    ControlChannel() = default;
+    ~ControlChannel();
+    ControlChannel(const ControlChannel&) = delete;
+    ControlChannel& operator=(const ControlChannel&) = delete;
+
+    // send seals and transmits one control payload to the peer; may drop it
+    void start(SendFn send);
+    void stop();
+
+    // Returns an id for unsubscribe()
+    int subscribe(Subscriber s);
+    void unsubscribe(int id);
+    LinkStats stats() const;
+
+    // Receive side bookkeeping for our reports
+    void noteFragment() { fragments_received.fetch_add(1, std::memory_order_relaxed); }
+    void noteFrameComplete(uint8_t kind, uint32_t seq, int64_t pts_us, int64_t arrival_us);
+    // A decrypted control payload from the peer
+    void handle(const uint8_t* payload, size_t len, int64_t arrival_us);
+
+private:
+    SendFn send;
+    std::thread worker;
+    std::atomic<bool> running{false};
+    std::mutex wake_mutex;
+    std::condition_variable wake_cv;
+
+    mutable std::mutex stats_mutex;
+    LinkStats link;
+    RttEstimator rtt;
+    // Receive bookkeeping since the last report
+    bool have_seq = false;
+    uint32_t base_seq = 0;
+    uint32_t highest_seq = 0;
+    uint32_t frames_received = 0;
+    std::atomic<uint32_t> fragments_received{0}; // every datagram: kept off the mutex
+    uint32_t expected_prior = 0;
+    uint32_t received_prior = 0;
+    double jitter_us = 0;
+    int64_t last_transit_us = 0;
+    bool have_transit = false;
+    std::vector<FrameArrival> arrivals;
+
+    std::mutex subscriber_mutex;
+    std::vector<std::pair<int, Subscriber>> subscribers;
+    int next_subscriber = 0;
+    uint32_t next_ping = 0;
+
+    void loop();
+    void sendReport();
+    void sendPing();
+    void publish();
+};
+
+#endif // CONTROL_CHANNEL_HPP
@@ -0,0 +1,158 @@
+/*
+  gopher_crypto_bench - CPU cost of media encryption. Two MediaCrypto ends
+  swap KEY datagrams as in a call. Then the bench seals and opens a
+  synthetic 30 fps stream at several bitrates and reports the CPU share
+  per Mbps. Sealing covers a whole frame's fragments per call, as in
+  FFmpegSender::sendPacket.
+
+    gopher_crypto_bench [--seconds N] [--cipher aes|chacha|both] [--mbps 1,2.5,5,10]
+
+  N seconds of media are processed per bitrate (default 20).
+*/
+#include <algorithm>
+#include <iostream>
+#include <string>
+#include <sstream>
+#include <vector>
+#include <cstdio>
+#include <ctime>
+
+#include "media_crypto.hpp"
+
+constexpr int FPS = 30;
+
+static double thread_cpu_seconds() {
+    timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+struct BenchResult {
+    double seal_cpu = 0;
+    double open_cpu = 0;
+    uint64_t datagrams = 0;
+    uint64_t failures = 0;
+};
+
+// Alice encrypts, Bob decrypts
+static bool pair_up(MediaCrypto& alice, MediaCrypto& bob, MediaCipher cipher) {
+    MediaKeyPair alice_id, bob_id;
+    if (!MediaKeyPair::generate(alice_id) || !MediaKeyPair::generate(bob_id)) return false;
+    if (!alice.initialize(alice_id, bob_id.public_key, cipher) ||
+        !bob.initialize(bob_id, alice_id.public_key, cipher)) {
+        return false;
+    }
+    uint8_t packet[MediaCrypto::KEY_PACKET_SIZE];
+    for (int round = 0; round < 2; round++) {
+        bob.handleKeyPacket(packet, alice.writeKeyPacket(packet));
+        alice.handleKeyPacket(packet, bob.writeKeyPacket(packet));
+    }
+    return alice.ready() && alice.peerReady() && bob.ready() && bob.peerReady();
+}
+
+static BenchResult run(MediaCipher cipher, double mbps, int seconds) {
+    BenchResult result;
+    MediaCrypto alice, bob;
+    if (!pair_up(alice, bob, cipher)) {
+        std::cerr << "Key exchange failed" << std::endl;
+        return result;
+    }
+
+    // Keyframe every 2 s at 5x the average size, like a real stream
+    const size_t frame_bytes = static_cast<size_t>(mbps * 1e6 / 8 / FPS);
+    const size_t stride = MEDIA_HEADER_SIZE + MEDIA_MAX_PAYLOAD + MEDIA_TAG_SIZE;
+    std::vector<uint8_t> frame(frame_bytes * 5);
+    for (size_t i = 0; i < frame.size(); i++) frame[i] = static_cast<uint8_t>(i * 131);
+    std::vector<uint8_t> wire((frame.size() / MEDIA_MAX_PAYLOAD + 1) * stride);
+    uint8_t opened[MEDIA_MAX_PAYLOAD];
+
+    MediaHeader hdr;
+    hdr.type = MEDIA_KIND_VIDEO;
+    for (int f = 0; f < seconds * FPS; f++) {
+        bool keyframe = f % (2 * FPS) == 0;
+        // Keep the average at mbps: non-keyframes give up the keyframe's extra
+        size_t size = keyframe ? frame_bytes * 5 : frame_bytes * (2 * FPS - 5) / (2 * FPS - 1);
+        size_t fragments = (size + MEDIA_MAX_PAYLOAD - 1) / MEDIA_MAX_PAYLOAD;
+        hdr.seq = f;
+        hdr.flags = MEDIA_FLAG_ENCRYPTED | (keyframe ? MEDIA_FLAG_KEYFRAME : 0);
+        hdr.frame_size = size;
+
+        double start = thread_cpu_seconds();
+        for (size_t i = 0; i < fragments; i++) {
+            hdr.frag_offset = i * MEDIA_MAX_PAYLOAD;
+            write_media_header(&wire[i * stride], hdr);
+        }
+        if (!alice.sealFrame(MEDIA_KIND_VIDEO, frame.data(), size, wire.data(), stride)) result.failures++;
+        double sealed = thread_cpu_seconds();
+        result.seal_cpu += sealed - start;
+
+        for (size_t i = 0; i < fragments; i++) {
+            size_t chunk = std::min(MEDIA_MAX_PAYLOAD, size - i * MEDIA_MAX_PAYLOAD);
+            const uint8_t* datagram = &wire[i * stride];
+            MediaHeader h;
+            size_t len = 0;
+            if (!read_media_header(datagram, MEDIA_HEADER_SIZE + chunk + MEDIA_TAG_SIZE, h) ||
+                !bob.open(h, datagram, MEDIA_HEADER_SIZE + chunk + MEDIA_TAG_SIZE, opened, len) || len != chunk) {
+                result.failures++;
+            }
+        }
+        result.open_cpu += thread_cpu_seconds() - sealed;
+        result.datagrams += fragments;
+    }
+
+    // A flipped bit must not get through
+    hdr.seq = seconds * FPS;
+    hdr.frag_offset = 0;
+    hdr.frame_size = 100;
+    write_media_header(wire.data(), hdr);
+    alice.sealFrame(MEDIA_KIND_VIDEO, frame.data(), 100, wire.data(), stride);
+    wire[MEDIA_HEADER_SIZE + 7] ^= 1;
+    MediaHeader h;
+    size_t len = 0;
+    read_media_header(wire.data(), MEDIA_HEADER_SIZE + 100 + MEDIA_TAG_SIZE, h);
+    if (bob.open(h, wire.data(), MEDIA_HEADER_SIZE + 100 + MEDIA_TAG_SIZE, opened, len)) result.failures++;
+
+    // Nor may the intact datagram, a second time
+    wire[MEDIA_HEADER_SIZE + 7] ^= 1;
+    if (!bob.open(h, wire.data(), MEDIA_HEADER_SIZE + 100 + MEDIA_TAG_SIZE, opened, len)) result.failures++;
+    if (bob.open(h, wire.data(), MEDIA_HEADER_SIZE + 100 + MEDIA_TAG_SIZE, opened, len)) result.failures++;
+    return result;
+}
+
+int main(int argc, char* argv[]) {
+    int seconds = 20;
+    std::string cipher = "both";
+    std::vector<double> rates = {1, 2.5, 5, 10};
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--seconds" && i + 1 < argc) seconds = std::stoi(argv[++i]);
+        else if (arg == "--cipher" && i + 1 < argc) cipher = argv[++i];
+        else if (arg == "--mbps" && i + 1 < argc) {
+            rates.clear();
+            std::istringstream list(argv[++i]);
+            std::string rate;
+            while (std::getline(list, rate, ',')) rates.push_back(std::stod(rate));
+        }
+    }
+
+    std::vector<MediaCipher> ciphers;
+    if (cipher == "aes" || cipher == "both") ciphers.push_back(MediaCipher::AES_256_GCM);
+    if (cipher == "chacha" || cipher == "both") ciphers.push_back(MediaCipher::CHACHA20_POLY1305);
+    std::cout << "Preferred on this CPU: " << media_cipher_name(preferred_media_cipher()) << std::endl;
+
+    printf("%-18s %7s %10s %11s %11s %13s %13s %8s\n", "cipher", "Mbps", "datagrams", "seal ns/dg",
+           "open ns/dg", "seal %cpu/Mbps", "open %cpu/Mbps", "failures");
+    for (MediaCipher c : ciphers) {
+        for (double mbps : rates) {
+            BenchResult r = run(c, mbps, seconds);
+            double per_dg = r.datagrams ? 1e9 / r.datagrams : 0;
+            // CPU share of one core while the stream runs in real time, per Mbps
+            double seal_pct = r.seal_cpu / seconds * 100 / mbps;
+            double open_pct = r.open_cpu / seconds * 100 / mbps;
+            printf("%-18s %7.1f %10llu %11.0f %11.0f %13.3f %13.3f %8llu\n", media_cipher_name(c), mbps,
+                   (unsigned long long)r.datagrams, r.seal_cpu * per_dg, r.open_cpu * per_dg, seal_pct, open_pct,
+                   (unsigned long long)r.failures);
+        }
+    }
+    return 0;
+}
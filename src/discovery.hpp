@@ -0,0 +1,117 @@
+#pragma once
+#include <string>
+#include <cstdint>
+
+/*
+  Discovery wire format shared by gopher_client and gopherd.
+
+    announce: "name:<name>;ip:<ip>;port:<port>;ttl:<seconds>;codecs:<c1+c2..>;key:<hex>;"
+    goodbye:  "bye:1;name:<name>;ip:<ip>;port:<port>;"
+
+  Announcements go to the IPv4/IPv6 multicast groups below (older clients
+  still broadcast to 255.255.255.255 on the same port). ttl tells the daemon
+  how long to keep the entry without hearing from the peer again, so it can
+  track the client's backed-off announce interval. codecs lists the video
+  codecs the client can decode ("h264+vp9"); missing means H.264 only.
+  key is the client's X25519 identity key (64 hex digits), which calls use
+  to encrypt media (media_crypto.hpp); clients without one cannot be called.
+
+  Rendezvous: a gopherd started with --rendezvous also introduces clients
+  on other segments or behind NAT. Clients send it announcements (format
+  above, goodbye included) every RENDEZVOUS_INTERVAL_S from their media
+  socket to RENDEZVOUS_PORT, so the daemon sees the address their NAT maps
+  that socket to. Its peer list then gives each registered client a sixth
+  field of candidate endpoints, "<ip>:<port>+<ip>:<port>": the announced
+  host address first, then the server reflexive one if it differs. A key
+  belongs to the reflexive address that registered it until that
+  registration expires; the daemon ignores the same key from anywhere else,
+  so a client whose NAT remaps its socket is unreachable for up to one ttl.
+
+    relay: "relay:1;key:<own key>;peer:<peer key>;"
+
+  asks the daemon to forward every media datagram it gets from the
+  requester's reflexive address to the peer's. Clients only ask when no
+  candidate answers their connectivity checks (rendezvous.hpp), and repeat
+  the request with every registration for as long as they relay.
+*/
+
+constexpr uint16_t DISCOVERY_PORT      = 43753;
+constexpr const char* MCAST_GROUP_V4   = "239.255.71.80";
+constexpr const char* MCAST_GROUP_V6   = "ff02::4750";
+constexpr int DEFAULT_ANNOUNCE_TTL     = 30;
+constexpr uint16_t RENDEZVOUS_PORT     = 43826;
+constexpr int RENDEZVOUS_INTERVAL_S    = 10; // inside the 30 s UDP timeout of common NATs
+
+struct Announcement {
+  std::string name;
+  std::string ip;
+  uint16_t port = 0;
+  int ttl = DEFAULT_ANNOUNCE_TTL;
+  std::string codecs;
+  std::string key;
+  bool goodbye = false;
+};
+
+inline std::string format_announcement(const Announcement& a) {
+  std::string msg;
+  if (a.goodbye) msg += "bye:1;";
+  msg += "name:" + a.name + ";ip:" + a.ip + ";port:" + std::to_string(a.port) + ";";
+  if (!a.goodbye) msg += "ttl:" + std::to_string(a.ttl) + ";";
+  if (!a.goodbye && !a.codecs.empty()) msg += "codecs:" + a.codecs + ";";
+  if (!a.goodbye && !a.key.empty()) msg += "key:" + a.key + ";";
+  return msg;
+}
+
+// Returns false on malformed input. Unknown fields are ignored.
+inline bool parse_announcement(const char* buffer, size_t len, Announcement& out) {
+  std::string msg(buffer, len);
+  size_t name_pos = msg.find("name:");
+  size_t ip_pos = msg.find(";ip:");
+  size_t port_pos = msg.find(";port:");
+
+  if (name_pos == std::string::npos || ip_pos == std::string::npos ||
+      port_pos == std::string::npos) return false;
+
+  try {
+    out.name = msg.substr(name_pos + 5, ip_pos - (name_pos + 5));
+    out.ip = msg.substr(ip_pos + 4, port_pos - (ip_pos + 4));
+    out.port = static_cast<uint16_t>(std::stoi(msg.substr(port_pos + 6)));
+
+    size_t ttl_pos = msg.find(";ttl:");
+    out.ttl = ttl_pos == std::string::npos ? DEFAULT_ANNOUNCE_TTL
+                                           : std::stoi(msg.substr(ttl_pos + 5));
+  } catch (const std::exception& e) {
+    // Invalid port/ttl number
+    return false;
+  }
+  size_t codecs_pos = msg.find(";codecs:");
+  if (codecs_pos != std::string::npos) {
+    size_t end = msg.find(';', codecs_pos + 8);
+    out.codecs = msg.substr(codecs_pos + 8, end == std::string::npos ? std::string::npos
+                                                                     : end - (codecs_pos + 8));
+  }
+  size_t key_pos = msg.find(";key:");
+  if (key_pos != std::string::npos) {
+    size_t end = msg.find(';', key_pos + 5);
+    out.key = msg.substr(key_pos + 5, end == std::string::npos ? std::string::npos : end - (key_pos + 5));
+  }
+  out.goodbye = msg.compare(0, 6, "bye:1;") == 0;
+  return true;
+}
+
+inline std::string format_relay_request(const std::string& key, const std::string& peer_key) {
+  return "relay:1;key:" + key + ";peer:" + peer_key + ";";
+}
+
+// Returns false unless buffer is a relay request
+inline bool parse_relay_request(const char* buffer, size_t len, std::string& key, std::string& peer_key) {
+  std::string msg(buffer, len);
+  if (msg.compare(0, 8, "relay:1;") != 0) return false;
+  size_t key_pos = msg.find(";key:");
+  size_t peer_pos = msg.find(";peer:");
+  if (key_pos == std::string::npos || peer_pos == std::string::npos || peer_pos < key_pos) return false;
+  key = msg.substr(key_pos + 5, peer_pos - (key_pos + 5));
+  size_t end = msg.find(';', peer_pos + 6);
+  peer_key = msg.substr(peer_pos + 6, end == std::string::npos ? std::string::npos : end - (peer_pos + 6));
+  return !key.empty() && !peer_key.empty();
+}
@@ -0,0 +1,110 @@
+#include "display_scheduler.hpp"
+#include "audio_common.hpp"
+#include "metrics.hpp"
+#include "thread_policy.hpp"
+
+#include <algorithm>
+#include <iostream>
+#include <thread>
+
+static Counter& frames_presented = metrics().counter("gopher_display_frames_total", "Video frames shown");
+static Counter& frames_dropped = metrics().counter("gopher_display_dropped_total",
+                                                   "Decoded frames superseded before their refresh tick");
+static Counter& frames_overflow = metrics().counter("gopher_display_overflow_total",
+                                                    "Decoded frames pushed out while held for A/V sync");
+static Counter& ticks_skipped = metrics().counter("gopher_display_skipped_ticks_total",
+                                                  "Refresh ticks lost to slow rendering");
+static Gauge& display_depth = metrics().gauge("gopher_display_queue_depth", "Decoded frames waiting for display");
+
+void DisplayScheduler::submit(cv::Mat image, int64_t pts_us) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (pending.size() >= MAX_PENDING) {
+        pending.pop_front();
+        overflow.fetch_add(1, std::memory_order_relaxed);
+        frames_overflow.inc();
+    }
+    pending.push_back(DisplayFrame{std::move(image), pts_us});
+    submitted.fetch_add(1, std::memory_order_relaxed);
+    display_depth.set(pending.size());
+}
+
+bool DisplayScheduler::next(DisplayFrame& out, bool follow_audio) {
+    std::lock_guard<std::mutex> lock(mutex);
+    // Newest frame that is due; frames arrive in decode order
+    size_t due = pending.size();
+    for (size_t i = pending.size(); i-- > 0;) {
+        if (!follow_audio || av_sync_delay_us(pending[i].pts_us) <= 0) {
+            due = i;
+            break;
+        }
+    }
+    if (due == pending.size()) return false;
+
+    out = std::move(pending[due]);
+    pending.erase(pending.begin(), pending.begin() + due + 1);
+    dropped.fetch_add(due, std::memory_order_relaxed);
+    presented.fetch_add(1, std::memory_order_relaxed);
+    frames_dropped.inc(due);
+    frames_presented.inc();
+    display_depth.set(pending.size());
+    return true;
+}
+
+void DisplayScheduler::clear() {
+    std::lock_guard<std::mutex> lock(mutex);
+    pending.clear();
+    display_depth.set(0);
+}
+
+DisplayScheduler::Stats DisplayScheduler::stats() const {
+    Stats s;
+    s.submitted = submitted.load(std::memory_order_relaxed);
+    s.presented = presented.load(std::memory_order_relaxed);
+    s.dropped = dropped.load(std::memory_order_relaxed);
+    s.overflow = overflow.load(std::memory_order_relaxed);
+    return s;
+}
+
+DisplayScheduler& display_scheduler() {
+    static DisplayScheduler scheduler;
+    return scheduler;
+}
+
+void present_frames(const std::string& window, int refresh_hz, const std::function<void(int)>& on_key) {
+    ThreadRoleScope display_role(ThreadRole::DISPLAY);
+    DisplayScheduler& scheduler = display_scheduler();
+    DisplayScheduler::Stats before = scheduler.stats();
+    const auto period = std::chrono::microseconds(1000000 / std::max(1, refresh_hz));
+    uint64_t skipped = 0;
+
+    cv::namedWindow(window, cv::WINDOW_AUTOSIZE);
+    auto next_tick = std::chrono::steady_clock::now();
+    while (true) {
+        DisplayFrame frame;
+        if (scheduler.next(frame)) cv::imshow(window, frame.image);
+
+        next_tick += period;
+        auto now = std::chrono::steady_clock::now();
+        if (now > next_tick) {
+            // Render overran the tick: start again from now rather than burst to catch up
+            uint64_t missed = (now - next_tick) / period;
+            skipped += missed;
+            ticks_skipped.inc(missed);
+            next_tick = now;
+        }
+
+        // waitKey also runs the window's event loop; it returns early on a key press
+        auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(next_tick - now).count();
+        int key = cv::waitKey(std::max<int>(1, remaining));
+        if (key == 27) break; // ESC to exit
+        if (key >= 0 && on_key) on_key(key);
+        std::this_thread::sleep_until(next_tick);
+    }
+    cv::destroyWindow(window);
+
+    DisplayScheduler::Stats after = scheduler.stats();
+    std::cout << "Display: " << after.presented - before.presented << " frames presented, "
+              << after.dropped - before.dropped << " dropped as stale, "
+              << after.overflow - before.overflow << " overflowed, " << skipped << " refresh ticks skipped"
+              << std::endl;
+}
@@ -0,0 +1,72 @@
+#ifndef DISPLAY_SCHEDULER_HPP
+#define DISPLAY_SCHEDULER_HPP
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <opencv2/opencv.hpp>
+
+// Decoded frame waiting for presentation; pts_us is in the sender's media clock
+struct DisplayFrame {
+    cv::Mat image;
+    int64_t pts_us;
+};
+
+/*
+  Hand-off between the decoder and the window. Decode submits every frame
+  and never blocks. The display side asks for a frame once per refresh
+  tick and gets the newest one that is due: when audio is playing, due
+  means the frame's pts has reached the audio playout clock; otherwise
+  the newest frame is always due. Older frames are dropped at that point,
+  so a slow renderer shows fewer frames instead of falling further behind.
+  Latency stays bounded by one refresh period plus one render.
+*/
+class DisplayScheduler {
+public:
+    struct Stats {
+        uint64_t submitted;
+        uint64_t presented;
+        uint64_t dropped;   // superseded by a newer due frame
+        uint64_t overflow;  // pushed out while held for A/V sync
+    };
+
+    // Decode thread
+    void submit(cv::Mat image, int64_t pts_us);
+    // Display thread, once per refresh tick. false: nothing new is due, keep the current image.
+    // follow_audio = false ignores the audio clock (offline replay).
+    bool next(DisplayFrame& out, bool follow_audio = true);
+    // Forget pending frames, e.g. between calls
+    void clear();
+    Stats stats() const;
+
+private:
+    // 8 frames: ~250 ms at 30 fps held for A/V sync
+    static constexpr size_t MAX_PENDING = 8;
+
+    mutable std::mutex mutex;
+    std::deque<DisplayFrame> pending;
+
+    std::atomic<uint64_t> submitted{0};
+    std::atomic<uint64_t> presented{0};
+    std::atomic<uint64_t> dropped{0};
+    std::atomic<uint64_t> overflow{0};
+};
+
+DisplayScheduler& display_scheduler();
+
+constexpr int DEFAULT_REFRESH_HZ = 60;
+
+/*
+  Shows display_scheduler() frames in an OpenCV window at refresh_hz until
+  ESC is pressed; any other key goes to on_key. Ticks stay on a fixed cadence. After a render that
+  overruns a tick, the missed ticks are skipped rather than caught up in
+  a burst. Prints the presented and dropped counts for the session.
+*/
+void present_frames(const std::string& window, int refresh_hz = DEFAULT_REFRESH_HZ,
+                    const std::function<void(int)>& on_key = nullptr);
+
+#endif // DISPLAY_SCHEDULER_HPP
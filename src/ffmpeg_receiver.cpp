@@ -1,107 +1,331 @@
 #include "ffmpeg_receiver.hpp"
+#include "display_scheduler.hpp"
+#include "metrics.hpp"
 
-// External declarations - these are defined in ffmpeg_sender.cpp
-extern std::queue<cv::Mat> display_queue;
-extern std::mutex display_mutex;
-extern std::condition_variable display_cv;
+#include <algorithm>
+#include <climits>
 
-bool FFmpegReceiver::initialize(int existing_sock_fd, uint16_t listen_port) {
-    // Setup decoder
-    const AVCodec* decoder = avcodec_find_decoder(AV_CODEC_ID_H264);
-    decoder_ctx = avcodec_alloc_context3(decoder);
+// Longer than any GOP, so only size classes a burst left behind are handed back
+constexpr int64_t SLAB_TRIM_INTERVAL_US = 10000000;
+
+static Counter& fragments_received = metrics().counter("gopher_fragments_received_total", "Media datagrams received");
+static Counter& fragments_duplicate = metrics().counter("gopher_fragments_duplicate_total",
+                                                      "Media datagrams for a fragment already received");
+static Counter& fragments_lost = metrics().counter("gopher_fragments_lost_total",
+                                                   "Fragments missing from frames dropped incomplete");
+static Counter& frames_incomplete = metrics().counter("gopher_frames_incomplete_total",
+                                                      "Frames dropped before all fragments arrived");
+static Counter& frames_oversize = metrics().counter("gopher_frames_oversize_total",
+                                                    "Frames over the reassembly size limit");
+static Counter& video_frames_received = metrics().counter("gopher_video_frames_received_total",
+                                                          "Video frames reassembled");
+static Counter& video_bytes_received = metrics().counter("gopher_video_bytes_received_total",
+                                                         "Video bytes reassembled");
+static Counter& audio_frames_received = metrics().counter("gopher_audio_frames_received_total",
+                                                          "Opus frames reassembled");
+static Counter& datagrams_rejected = metrics().counter("gopher_datagrams_rejected_total",
+                                                       "Media datagrams dropped as unencrypted, not yet decryptable or forged");
+static Histogram& decode_time = metrics().histogram("gopher_video_decode_seconds", "Time to decode one frame");
+
+bool FFmpegReceiver::initializeDecoding(size_t max_frame_bytes, bool live) {
+    start_time = std::chrono::steady_clock::now();
+    slabs = std::make_unique<FrameSlabAllocator>(max_frame_bytes, AV_INPUT_BUFFER_PADDING_SIZE);
     
-    if (avcodec_open2(decoder_ctx, decoder, nullptr) < 0) {
+    // H.264 until the stream says otherwise; decoders come from the pool
+    if (!selectDecoder(VideoCodec::H264)) {
         std::cerr << "Failed to open decoder" << std::endl;
         return false;
     }
     
-    // Setup network
-    sock = socket(AF_INET, SOCK_DGRAM, 0);
-    sockaddr_in addr{};
-    addr.sin_family = AF_INET;
-    addr.sin_port = htons(listen_port);
-    addr.sin_addr.s_addr = INADDR_ANY;
-    
+    // Audio is optional: a call without a working Opus decoder is video only
+    audio = std::make_unique<AudioReceiver>();
+    if (!audio->initialize(live)) {
+        audio.reset();
+    } else if (live) {
+        audio->start();
+    }
+    return true;
+}
+
+bool FFmpegReceiver::initialize(int existing_sock_fd, uint16_t listen_port, size_t max_frame_bytes) {
+    // Setup network. The receiver takes ownership of existing_sock_fd.
     sock = existing_sock_fd;
     
+    // Wake up periodically so stop() is noticed
+    struct timeval timeout;
+    timeout.tv_sec = 0;
+    timeout.tv_usec = 200000;
+    setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    
+    // Room for the largest frame we accept plus audio while the decoder is busy. Each
+    // datagram is charged its full skb size, well above its payload, so ask for twice
+    // the frame limit; the kernel caps the request at net.core.rmem_max.
+    int rcvbuf = static_cast<int>(std::min<size_t>(std::max<size_t>(4 * 1024 * 1024, 2 * max_frame_bytes),
+                                                   INT_MAX / 2));
+    setsockopt(sock, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+    int granted = 0;
+    socklen_t granted_len = sizeof(granted);
+    // Linux reports double what it was asked for, overhead included
+    if (getsockopt(sock, SOL_SOCKET, SO_RCVBUF, &granted, &granted_len) == 0 && granted < rcvbuf) {
+        std::cerr << "Receive buffer capped at " << granted / 1024 << " KB (net.core.rmem_max); frames near the "
+                  << max_frame_bytes / (1024 * 1024) << " MB limit may lose fragments" << std::endl;
+    }
+    rx.initialize(sock);
+    
+    return initializeDecoding(max_frame_bytes, true);
+}
+
+bool FFmpegReceiver::initializeReplay(size_t max_frame_bytes) {
+    return initializeDecoding(max_frame_bytes, false);
+}
+
+bool FFmpegReceiver::startTrace(const std::string& path) {
+    trace = std::make_unique<TraceWriter>();
+    if (!trace->open(path, media_clock_us())) {
+        trace.reset();
+        return false;
+    }
+    return true;
+}
+
+bool FFmpegReceiver::selectDecoder(VideoCodec codec) {
+    if (decoder_ctx && codec == decoder_codec) return true;
+    
+    std::string key = decoder_pool_key(codec);
+    AVCodecContext* ctx = codec_pool().acquire(key, [codec] { return open_video_decoder(codec); });
+    if (!ctx) return false;
+    
+    if (decoder_ctx) codec_pool().release(decoder_key, decoder_ctx);
+    decoder_ctx = ctx;
+    decoder_key = key;
+    decoder_codec = codec;
+    std::cout << "Decoding " << codec_name(codec) << std::endl;
     return true;
 }
 
 void FFmpegReceiver::run() {
-    std::vector<uint8_t> packet_buffer;
-    uint8_t recv_buffer[2048];
+    // io_uring when available, blocking recvfrom otherwise; both feed handleDatagram
+    rx.run(running, [this](const uint8_t* data, size_t len) { handleDatagram(data, len, media_clock_us()); });
+    if (trace) {
+        std::cout << "Trace: " << trace->recordCount() << " datagrams" << std::endl;
+        trace->close();
+    }
+}
+
+void FFmpegReceiver::handleDatagram(const uint8_t* data, size_t len, int64_t arrival_us) {
+    MediaHeader header;
+    bool valid = read_media_header(data, len, header);
+    if (valid && media_type_kind(header.type) == MEDIA_KIND_CONTROL) {
+        handleControl(header, data, len, arrival_us);
+    } else if (crypto) {
+        // Nothing unauthenticated reaches reassembly. The trace gets the
+        // decrypted datagram so it replays without the call's keys.
+        size_t plain_len = 0;
+        if (valid && crypto->open(header, data, len, opened.data() + MEDIA_HEADER_SIZE, plain_len)) {
+            header.flags &= ~MEDIA_FLAG_ENCRYPTED;
+            write_media_header(opened.data(), header);
+            if (trace) trace->write(arrival_us, opened.data(), MEDIA_HEADER_SIZE + plain_len);
+            handleFragment(header, opened.data() + MEDIA_HEADER_SIZE, plain_len, arrival_us);
+        } else {
+            datagrams_rejected.inc();
+        }
+    } else {
+        if (trace) trace->write(arrival_us, data, len);
+        if (valid) handleFragment(header, data + MEDIA_HEADER_SIZE, len - MEDIA_HEADER_SIZE, arrival_us);
+    }
     
-    while (true) {
-        // Receive packet size
-        uint32_t packet_size;
-        if (recvfrom(sock, &packet_size, sizeof(packet_size), 0, nullptr, nullptr) 
-            != sizeof(packet_size)) continue;
-        
-        packet_size = ntohl(packet_size);
-        if (packet_size > 100000) continue; // Sanity check
-        
-        // Receive packet type
-        uint8_t packet_type;
-        if (recvfrom(sock, &packet_type, 1, 0, nullptr, nullptr) != 1) continue;
-        
-        // Receive packet data
-        packet_buffer.clear();
-        packet_buffer.reserve(packet_size - 1);
-        
-        while (packet_buffer.size() < packet_size - 1) {
-            int n = recvfrom(sock, recv_buffer, sizeof(recv_buffer), 0, nullptr, nullptr);
-            if (n <= 0) break;
-            
-            size_t copy_size = std::min((size_t)n, packet_size - 1 - packet_buffer.size());
-            packet_buffer.insert(packet_buffer.end(), recv_buffer, recv_buffer + copy_size);
+    if (arrival_us - last_expiry_us > 100000) {
+        last_expiry_us = arrival_us;
+        expirePending(arrival_us);
+    }
+    if (arrival_us - last_trim_us > SLAB_TRIM_INTERVAL_US) {
+        last_trim_us = arrival_us;
+        slabs->trimIdle();
+    }
+}
+
+// KEY datagrams are the only plaintext control messages in an encrypted call
+void FFmpegReceiver::handleControl(const MediaHeader& header, const uint8_t* data, size_t len, int64_t arrival_us) {
+    size_t plain_len = 0;
+    if (!crypto) {
+        if (control) control->handle(data + MEDIA_HEADER_SIZE, len - MEDIA_HEADER_SIZE, arrival_us);
+    } else if (!(header.flags & MEDIA_FLAG_ENCRYPTED)) {
+        if (!crypto->handleKeyPacket(data, len)) datagrams_rejected.inc();
+    } else if (crypto->open(header, data, len, opened.data(), plain_len)) {
+        if (control) control->handle(opened.data(), plain_len, arrival_us);
+    } else {
+        datagrams_rejected.inc();
+    }
+}
+
+// Slot already reassembling key, else a free one (evicting the oldest if all are busy)
+FFmpegReceiver::PendingFrame* FFmpegReceiver::pendingSlot(uint64_t key) {
+    PendingFrame* free_slot = nullptr;
+    PendingFrame* oldest = &pending[0];
+    for (auto& frame : pending) {
+        if (frame.used && frame.key == key) return &frame;
+        if (!frame.used && !free_slot) free_slot = &frame;
+        if (frame.used && frame.first_seen_us < oldest->first_seen_us) oldest = &frame;
+    }
+    if (free_slot) return free_slot;
+    dropIncomplete(*oldest);
+    return oldest;
+}
+
+void FFmpegReceiver::dropIncomplete(PendingFrame& frame) {
+    frames_expired++;
+    frames_incomplete.inc();
+    size_t missing = frame.header.frame_size - frame.received;
+    fragments_lost.inc((missing + MEDIA_MAX_PAYLOAD - 1) / MEDIA_MAX_PAYLOAD);
+    releasePending(frame);
+}
+
+void FFmpegReceiver::releasePending(PendingFrame& frame) {
+    slabs->release(frame.block);
+    frame.used = false;
+    frame.received = 0;
+}
+
+void FFmpegReceiver::handleFragment(const MediaHeader& header, const uint8_t* payload, size_t len,
+                                    int64_t arrival_us) {
+    fragments_received.inc();
+    if (control) control->noteFragment();
+    if (header.frame_size == 0) return;
+    if (header.frag_offset >= header.frame_size || len > header.frame_size - header.frag_offset) return;
+    // Fragments are cut at fixed offsets and only the last is short, so a
+    // fragment's index names it and each index can only ever carry one payload
+    if (header.frag_offset % MEDIA_MAX_PAYLOAD != 0 ||
+        len != std::min(MEDIA_MAX_PAYLOAD, static_cast<size_t>(header.frame_size - header.frag_offset))) {
+        return;
+    }
+    if (header.frame_size > slabs->maxFrameBytes()) {
+        if (header.frag_offset == 0) frames_oversize.inc();
+        if (header.frag_offset == 0 && oversize_frames++ == 0) {
+            std::cerr << "Dropping " << header.frame_size << " byte frame, over the "
+                      << slabs->maxFrameBytes() << " byte limit" << std::endl;
+        }
+        return;
+    }
+    
+    uint8_t kind = media_type_kind(header.type);
+    uint64_t key = (static_cast<uint64_t>(kind) << 32) | header.seq;
+    
+    PendingFrame& frame = *pendingSlot(key);
+    if (!frame.used) {
+        frame.block = slabs->acquire(header.frame_size); // padding comes zeroed
+        if (!frame.block.data) return;
+        frame.used = true;
+        frame.key = key;
+        frame.header = header;
+        frame.received = 0;
+        frame.arrived.assign((header.frame_size / MEDIA_MAX_PAYLOAD + 64) / 64, 0);
+        frame.first_seen_us = arrival_us;
+    }
+    if (frame.header.frame_size != header.frame_size) return;
+    
+    // Duplicates (network or replayed) must not count towards completion
+    size_t index = header.frag_offset / MEDIA_MAX_PAYLOAD;
+    uint64_t bit = uint64_t(1) << (index % 64);
+    if (frame.arrived[index / 64] & bit) {
+        fragments_duplicate.inc();
+        return;
+    }
+    frame.arrived[index / 64] |= bit;
+    memcpy(frame.block.data + header.frag_offset, payload, len);
+    frame.received += len;
+    if (frame.received < header.frame_size) return;
+    
+    const uint8_t* data = frame.block.data;
+    frames_completed++;
+    if (control) control->noteFrameComplete(kind, header.seq, header.pts_us, arrival_us);
+    if (kind == MEDIA_KIND_VIDEO) {
+        video_frames_received.inc();
+        video_bytes_received.inc(header.frame_size);
+        // Sender tags each frame with its codec; follow it if it changes mid-stream
+        if (selectDecoder(media_type_codec(header.type))) {
+            processVideoPacket(data, header.frame_size, header.pts_us);
+            if (recorder) recorder->setVideoSize(decoder_ctx->width, decoder_ctx->height);
         }
-        
-        if (packet_buffer.size() >= packet_size - 1 && packet_type == 1) {
-            processVideoPacket(packet_buffer);
+    } else if (kind == MEDIA_KIND_AUDIO && audio) {
+        audio_frames_received.inc();
+        audio->push(header.seq, header.pts_us, arrival_us, data, header.frame_size);
+    }
+    if (recorder) {
+        recorder->writeData(kind, media_type_codec(header.type), data, header.frame_size, header.pts_us,
+                            header.flags & MEDIA_FLAG_KEYFRAME);
+    }
+    releasePending(frame);
+}
+
+// Frames that lost a fragment never complete; hand their blocks back
+void FFmpegReceiver::expirePending(int64_t now_us) {
+    for (auto& frame : pending) {
+        if (frame.used && now_us - frame.first_seen_us > 500000) {
+            dropIncomplete(frame);
         }
     }
 }
 
-void FFmpegReceiver::processVideoPacket(const std::vector<uint8_t>& data) {
+void FFmpegReceiver::stop() {
+    running = false;
+    if (audio) audio->stop();
+}
+
+void FFmpegReceiver::processVideoPacket(const uint8_t* data, size_t size, int64_t pts_us) {
     AVPacket* pkt = av_packet_alloc();
-    pkt->data = const_cast<uint8_t*>(data.data());
-    pkt->size = data.size();
+    pkt->data = const_cast<uint8_t*>(data);
+    pkt->size = size;
     
+    auto decode_start = std::chrono::steady_clock::now();
     if (avcodec_send_packet(decoder_ctx, pkt) >= 0) {
         AVFrame* frame = av_frame_alloc();
         while (avcodec_receive_frame(decoder_ctx, frame) >= 0) {
+            frames_decoded++;
+            if (!first_frame_seen) {
+                first_frame_seen = true;
+                auto elapsed = std::chrono::steady_clock::now() - start_time;
+                std::cout << "Receiver time to first frame: "
+                          << std::chrono::duration_cast<std::chrono::milliseconds>(elapsed).count()
+                          << " ms" << std::endl;
+            }
+            
             // Convert to BGR for OpenCV display
             cv::Mat img(frame->height, frame->width, CV_8UC3);
             
-            if (!sws_ctx) {
-                sws_ctx = sws_getContext(
-                    frame->width, frame->height, (AVPixelFormat)frame->format,
-                    frame->width, frame->height, AV_PIX_FMT_BGR24,
-                    SWS_BILINEAR, nullptr, nullptr, nullptr
-                );
-            }
+            // Rebuilt only when size/format change (e.g. after a codec switch)
+            sws_ctx = sws_getCachedContext(sws_ctx,
+                frame->width, frame->height, (AVPixelFormat)frame->format,
+                frame->width, frame->height, AV_PIX_FMT_BGR24,
+                SWS_BILINEAR, nullptr, nullptr, nullptr
+            );
             
             uint8_t* dst_data[1] = { img.data };
             int dst_linesize[1] = { (int)img.step[0] };
             sws_scale(sws_ctx, frame->data, frame->linesize, 0, frame->height,
                       dst_data, dst_linesize);
             
-            // Add to display queue - use the external global queue
-            {
-                std::lock_guard<std::mutex> lock(display_mutex);
-                if (display_queue.size() > 10) display_queue.pop(); // Prevent overflow
-                display_queue.push(img.clone());
-            }
-            display_cv.notify_one();
+            // The display picks the newest due frame at its next refresh
+            display_scheduler().submit(std::move(img), pts_us);
         }
         av_frame_free(&frame);
     }
+    int64_t elapsed_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - decode_start).count();
+    decode_ns += elapsed_ns;
+    decode_time.observe(elapsed_ns / 1000);
     
     av_packet_free(&pkt);
 }
 
 FFmpegReceiver::~FFmpegReceiver() {
+    audio.reset();
+    if (slabs) {
+        auto st = slabs->stats();
+        std::cout << "Reassembly: " << st.acquires << " frames, high water " << st.high_water_bytes / 1024
+                  << " KB, " << st.reserved_bytes / 1024 << " KB reserved, recycle rate "
+                  << static_cast<int>(st.recycleRate() * 100) << "%" << std::endl;
+    }
     if (sws_ctx) sws_freeContext(sws_ctx);
-    if (decoder_ctx) avcodec_free_context(&decoder_ctx);
+    if (decoder_ctx) codec_pool().release(decoder_key, decoder_ctx); // reused by the next call
     if (sock >= 0) close(sock);
 }
\ No newline at end of file
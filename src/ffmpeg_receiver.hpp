@@ -6,12 +6,28 @@
 #include <queue>
 #include <mutex>
 #include <condition_variable>
+#include <chrono>
+#include <atomic>
+#include <string>
+#include <memory>
+#include <array>
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
 #include <unistd.h>
 #include <opencv2/opencv.hpp>
 
+#include "codec_pool.hpp"
+#include "video_codec.hpp"
+#include "media_packet.hpp"
+#include "audio_receiver.hpp"
+#include "media_rx.hpp"
+#include "frame_slab.hpp"
+#include "stream_recorder.hpp"
+#include "net_trace.hpp"
+#include "media_crypto.hpp"
+#include "control_channel.hpp"
+
 extern "C" {
 #include <libavcodec/avcodec.h>
 #include <libavutil/imgutils.h>
@@ -22,12 +38,72 @@ class FFmpegReceiver {
 private:
     int sock = -1;
     AVCodecContext* decoder_ctx = nullptr;
+    std::string decoder_key;
+    VideoCodec decoder_codec = VideoCodec::H264;
     SwsContext* sws_ctx = nullptr;
+    std::atomic<bool> running{true};
+    std::chrono::steady_clock::time_point start_time;
+    bool first_frame_seen = false;
+    std::unique_ptr<AudioReceiver> audio; // nullptr if audio could not be set up
+    MediaRx rx;
+    int64_t last_expiry_us = 0;
+    int64_t last_trim_us = 0;
+    std::unique_ptr<TraceWriter> trace; // capture mode
+    std::shared_ptr<MediaCrypto> crypto; // nullptr = plain datagrams accepted
+    std::array<uint8_t, MEDIA_HEADER_SIZE + MEDIA_MAX_PAYLOAD> opened; // one decrypted datagram
+
+    // A frame being reassembled from its fragments, in its own slab block
+    struct PendingFrame {
+        bool used = false;
+        uint64_t key = 0; // kind << 32 | seq
+        MediaHeader header;
+        FrameSlabAllocator::Block block;
+        size_t received = 0;            // bytes, counting each fragment once
+        std::vector<uint64_t> arrived;  // bit per fragment index; keeps its capacity across frames
+        int64_t first_seen_us = 0;
+    };
+    static constexpr size_t MAX_PENDING = 32;
+    std::array<PendingFrame, MAX_PENDING> pending; // fixed slots: no allocation per frame
+    std::unique_ptr<FrameSlabAllocator> slabs;
+    uint64_t oversize_frames = 0;
+    StreamRecorder* recorder = nullptr; // not owned
+    ControlChannel* control = nullptr;  // not owned
+
+    bool initializeDecoding(size_t max_frame_bytes, bool live);
+    bool selectDecoder(VideoCodec codec);
+    void handleFragment(const MediaHeader& header, const uint8_t* payload, size_t len, int64_t arrival_us);
+    void handleControl(const MediaHeader& header, const uint8_t* data, size_t len, int64_t arrival_us);
+    PendingFrame* pendingSlot(uint64_t key);
+    void releasePending(PendingFrame& frame);
+    void dropIncomplete(PendingFrame& frame);
+    void expirePending(int64_t now_us);
 
 public:
-    bool initialize(int existing_sock_fd, uint16_t listen_port);
+    std::atomic<uint64_t> frames_completed{0};
+    std::atomic<uint64_t> frames_expired{0};  // incomplete when dropped
+    std::atomic<uint64_t> frames_decoded{0};
+    std::atomic<int64_t> decode_ns{0};
+
+    // Frames larger than max_frame_bytes are dropped
+    bool initialize(int existing_sock_fd, uint16_t listen_port, size_t max_frame_bytes = DEFAULT_MAX_FRAME_BYTES);
+    // No socket and no audio device; the caller feeds handleDatagram and steps audioPlayout()
+    bool initializeReplay(size_t max_frame_bytes = DEFAULT_MAX_FRAME_BYTES);
+    // Capture mode: log every datagram with its arrival time; call before run()
+    bool startTrace(const std::string& path);
     void run();
-    void processVideoPacket(const std::vector<uint8_t>& data);
+    // Entry point for every received datagram; arrival_us is the local media clock
+    void handleDatagram(const uint8_t* data, size_t len, int64_t arrival_us);
+    AudioReceiver* audioPlayout() { return audio.get(); }
+    // Also record every complete frame; set before run()
+    void setRecorder(StreamRecorder* r) { recorder = r; }
+    // Feed c with receive statistics and hand it the peer's control messages; set before run()
+    void setControl(ControlChannel* c) { control = c; }
+    // Accept only media sealed with c's keys and answer its KEY datagrams; set before run()
+    void setCrypto(std::shared_ptr<MediaCrypto> c) { crypto = std::move(c); }
+    // Makes run() return within one socket timeout; safe to call from any thread
+    void stop();
+    void processVideoPacket(const uint8_t* data, size_t size, int64_t pts_us);
+    FrameSlabAllocator::Stats reassemblyStats() const { return slabs->stats(); }
     ~FFmpegReceiver();
 };
 
@@ -1,33 +1,235 @@
 #include "ffmpeg_sender.hpp"
+#include "metrics.hpp"
+#include "change_detector.hpp"
 
-// Packet structure for network transmission
-struct VideoPacket {
-    uint32_t size;
-    uint8_t type; // 1 = video, 2 = audio
-    std::vector<uint8_t> data;
-};
+#include <cerrno>
+#ifdef __linux__
+#include <netinet/udp.h>
+#endif
 
-// Global frame queue for display - make sure these are properly defined
-std::queue<cv::Mat> display_queue;
-std::mutex display_mutex;
-std::condition_variable display_cv;
+// One GSO send must stay under the 64 KB UDP limit
+constexpr size_t GSO_MAX_FRAGMENTS = 44;
+// Static scenes: refresh rate and share of the bitrate target
+constexpr int STATIC_FPS = 3;
+constexpr int STATIC_BITRATE_DIVISOR = 4;
 
-bool FFmpegSender::initialize(const std::string& dest_ip, uint16_t dest_port) {
+static Counter& video_frames_sent = metrics().counter("gopher_video_frames_sent_total", "Encoded video frames sent");
+static Counter& video_bytes_sent = metrics().counter("gopher_video_bytes_sent_total", "Encoded video bytes sent");
+static Counter& audio_frames_sent = metrics().counter("gopher_audio_frames_sent_total", "Opus frames sent");
+static Counter& fragments_sent = metrics().counter("gopher_fragments_sent_total", "Media datagrams sent");
+static Histogram& encode_time = metrics().histogram("gopher_video_encode_seconds", "Time to encode one frame");
+static Counter& frames_skipped = metrics().counter("gopher_video_frames_skipped_total",
+                                                   "Captured frames not encoded because the scene was static");
+static Gauge& static_scene = metrics().gauge("gopher_video_static_scene", "1 while the sender treats the scene as static");
+static Counter& frames_unkeyed = metrics().counter("gopher_frames_unkeyed_total",
+                                                   "Frames not sent because the call's keys were not exchanged yet");
+static Histogram& detect_time = metrics().histogram("gopher_change_detect_seconds", "Change detection per frame",
+                                                    {50, 100, 200, 400, 800, 1600, 3200});
+
+bool FFmpegSender::initialize(const std::string& dest_ip, uint16_t dest_port, VideoCodec codec) {
+    settings.codec = codec;
+    if (!warmup()) return false;
+    attach(dest_ip, dest_port, codec);
+    return true;
+}
+
+bool FFmpegSender::openEncoder(const CodecSettings& next) {
+    std::string key = encoder_pool_key(next);
+    AVCodecContext* ctx = codec_pool().acquire(key, [&next] { return open_video_encoder(next); });
+    if (!ctx) return false;
+    
+    if (encoder_ctx) {
+        set_video_bit_rate(encoder_ctx, settings, settings.bit_rate); // may have been lowered for a static scene
+        codec_pool().release(encoder_key, encoder_ctx);
+    }
+    encoder_ctx = ctx;
+    encoder_key = key;
+    settings = next;
+    sent_codec = static_cast<uint8_t>(next.codec);
+    sent_size = static_cast<uint32_t>(next.width) << 16 | static_cast<uint32_t>(next.height);
+    last_pts = -1; // pts are per encoder time base
+    return true;
+}
+
+bool FFmpegSender::openEncoder(VideoCodec codec) {
+    CodecSettings next = settings;
+    next.codec = codec;
+    return openEncoder(next);
+}
+
+void FFmpegSender::setProfile(const MediaProfile& profile) {
+    std::lock_guard<std::mutex> lock(profile_mutex);
+    if (!capture_open) {
+        // Everything applies when warmup() opens the camera
+        capture = profile.capture;
+        VideoCodec codec = settings.codec;
+        settings = profile.encode;
+        settings.codec = codec;
+        profile_name = profile.name;
+    } else {
+        pending_profile = profile;
+        profile_pending = true;
+    }
+}
+
+// Encoder thread. Capture keeps running; only the scaler and encoder change.
+bool FFmpegSender::applyPendingProfile(AVFrame* yuv_frame) {
+    MediaProfile profile;
+    {
+        std::lock_guard<std::mutex> lock(profile_mutex);
+        profile = pending_profile;
+    }
+    
+    CodecSettings next = profile.encode;
+    next.codec = settings.codec; // negotiated for the call, not part of a profile
+    const AVCodecParameters* par = input_ctx->streams[video_stream_idx]->codecpar;
+    if (profile.capture.width != capture.width || profile.capture.height != capture.height ||
+        profile.capture.fps != capture.fps || profile.capture.pixel_format != capture.pixel_format) {
+        std::cout << "Capture stays at " << par->width << "x" << par->height
+                  << " until the camera is reopened" << std::endl;
+    }
+    clampToCapture(next);
+    
+    // Pooled, so switching back to an earlier profile reuses its encoder
+    if (!openEncoder(next)) {
+        std::cerr << "Cannot switch to profile " << profile.name << ", keeping the current one" << std::endl;
+        return false;
+    }
+    
+    sws_ctx = sws_getCachedContext(sws_ctx,
+        par->width, par->height, (AVPixelFormat)par->format,
+        settings.width, settings.height, AV_PIX_FMT_YUV420P,
+        SWS_BILINEAR, nullptr, nullptr, nullptr);
+    av_frame_unref(yuv_frame);
+    yuv_frame->format = AV_PIX_FMT_YUV420P;
+    yuv_frame->width = settings.width;
+    yuv_frame->height = settings.height;
+    av_frame_get_buffer(yuv_frame, 0);
+    
+    // The receiver needs parameter sets for the new size
+    force_idr = true;
+    std::cout << "Switched to " << describe_profile(profile) << std::endl;
+    return true;
+}
+
+// Never encode above the capture size: upscaling only costs bits
+void FFmpegSender::clampToCapture(CodecSettings& s) const {
+    const AVCodecParameters* par = input_ctx->streams[video_stream_idx]->codecpar;
+    if (s.width <= par->width && s.height <= par->height) return;
+    double scale = std::min(double(par->width) / s.width, double(par->height) / s.height);
+    s.width = static_cast<int>(s.width * scale) & ~1;
+    s.height = static_cast<int>(s.height * scale) & ~1;
+    std::cout << "Encoding at " << s.width << "x" << s.height << ", the capture size" << std::endl;
+}
+
+void FFmpegSender::attach(const std::string& dest_ip, uint16_t dest_port, VideoCodec codec) {
+    requested_codec = static_cast<uint8_t>(codec);
+    {
+        std::lock_guard<std::mutex> lock(dest_mutex);
+        dest_addr.sin_family = AF_INET;
+        dest_addr.sin_port = htons(dest_port);
+        inet_pton(AF_INET, dest_ip.c_str(), &dest_addr.sin_addr);
+        attach_time = std::chrono::steady_clock::now();
+    }
+    // Receiver joins mid-stream: the next encoded frame must be decodable on its own
+    force_idr = true;
+    first_packet_pending = true;
+    attached = true;
+}
+
+void FFmpegSender::setTransmitSocket(int fd) {
+    std::lock_guard<std::mutex> lock(dest_mutex);
+    tx_sock = fd;
+}
+
+void FFmpegSender::setCrypto(std::shared_ptr<MediaCrypto> c) {
+    std::lock_guard<std::mutex> lock(dest_mutex);
+    crypto = std::move(c);
+    crypto_confirmed = false;
+}
+
+// Sends our KEY datagram when it is due. True once media can go out encrypted.
+bool FFmpegSender::exchangeKeys(MediaCrypto& c, int fd, const sockaddr_in& dest) {
+    if (c.keyPacketDue(media_clock_us())) {
+        uint8_t packet[MediaCrypto::KEY_PACKET_SIZE];
+        size_t len = c.writeKeyPacket(packet);
+        sendto(fd, packet, len, 0, (const sockaddr*)&dest, sizeof(dest));
+    }
+    if (!c.ready() || !c.peerReady()) return false;
+    // Everything before this was dropped, so the peer needs a keyframe to start from
+    if (!crypto_confirmed.exchange(true)) {
+        std::cout << "Call encrypted with " << media_cipher_name(c.cipher()) << std::endl;
+        force_idr = true;
+    }
+    return true;
+}
+
+void FFmpegSender::sendControl(const uint8_t* payload, size_t len) {
+    if (len > MEDIA_MAX_PAYLOAD) return;
+    
+    sockaddr_in dest_addr;
+    std::shared_ptr<MediaCrypto> crypto;
+    int fd;
+    {
+        // Checked together: a call torn down after this point still sends sealed or not at all
+        std::lock_guard<std::mutex> lock(dest_mutex);
+        if (!attached || !this->crypto) return;
+        dest_addr = this->dest_addr;
+        crypto = this->crypto;
+        fd = tx_sock >= 0 ? tx_sock : sock;
+    }
+    
+    MediaHeader hdr;
+    hdr.type = MEDIA_KIND_CONTROL;
+    hdr.seq = control_seq++;
+    hdr.frame_size = len;
+    uint8_t datagram[MEDIA_HEADER_SIZE + MEDIA_MAX_PAYLOAD + MEDIA_TAG_SIZE];
+    if (!crypto->ready() || !crypto->peerReady()) return;
+    hdr.flags = MEDIA_FLAG_ENCRYPTED;
+    write_media_header(datagram, hdr);
+    if (!crypto->sealFrame(MEDIA_KIND_CONTROL, payload, len, datagram, sizeof(datagram))) return;
+    size_t wire_len = MEDIA_HEADER_SIZE + len + MEDIA_TAG_SIZE;
+    sendto(fd, datagram, wire_len, 0, (const sockaddr*)&dest_addr, sizeof(dest_addr));
+}
+
+void FFmpegSender::setContentAdaptive(bool enabled) {
+    content_adaptive = enabled;
+}
+
+void FFmpegSender::detach() {
+    std::lock_guard<std::mutex> lock(dest_mutex);
+    attached = false;
+}
+
+void FFmpegSender::stop() {
+    {
+        std::lock_guard<std::mutex> lock(dest_mutex);
+        attached = false;
+    }
+    running = false;
+}
+
+bool FFmpegSender::warmup() {
     // Initialize FFmpeg
     avdevice_register_all();
     
     // Setup network
     sock = socket(AF_INET, SOCK_DGRAM, 0);
-    dest_addr.sin_family = AF_INET;
-    dest_addr.sin_port = htons(dest_port);
-    inet_pton(AF_INET, dest_ip.c_str(), &dest_addr.sin_addr);
+    setupTransmit();
+    
+    // From here on setProfile() hands profiles to run() instead
+    {
+        std::lock_guard<std::mutex> lock(profile_mutex);
+        capture_open = true;
+    }
     
     // Open camera input (macOS avfoundation)
     const AVInputFormat* input_fmt = av_find_input_format("avfoundation");
     AVDictionary* options = nullptr;
-    av_dict_set(&options, "video_size", "1280x720", 0);
-    av_dict_set(&options, "framerate", "30", 0);
-    av_dict_set(&options, "pixel_format", "uyvy422", 0);
+    std::string video_size = std::to_string(capture.width) + "x" + std::to_string(capture.height);
+    av_dict_set(&options, "video_size", video_size.c_str(), 0);
+    av_dict_set(&options, "framerate", std::to_string(capture.fps).c_str(), 0);
+    av_dict_set(&options, "pixel_format", capture.pixel_format.c_str(), 0);
     
     if (avformat_open_input(&input_ctx, "0:", input_fmt, &options) < 0) {
         std::cerr << "Failed to open camera" << std::endl;
@@ -52,37 +254,10 @@ bool FFmpegSender::initialize(const std::string& dest_ip, uint16_t dest_port) {
         return false;
     }
     
-    // Setup hardware encoder (VideoToolbox on macOS)
-    const AVCodec* encoder = avcodec_find_encoder_by_name("h264_videotoolbox");
-    if (!encoder) {
-        // Fallback to software encoder
-        encoder = avcodec_find_encoder(AV_CODEC_ID_H264);
-        std::cout << "Using software encoder" << std::endl;
-    } else {
-        std::cout << "Using hardware encoder (VideoToolbox)" << std::endl;
-    }
-    
-    encoder_ctx = avcodec_alloc_context3(encoder);
-    encoder_ctx->width = 1280;
-    encoder_ctx->height = 720;
-    encoder_ctx->time_base = {1, 30};
-    encoder_ctx->framerate = {30, 1};
-    encoder_ctx->pix_fmt = AV_PIX_FMT_YUV420P;
-    encoder_ctx->bit_rate = 2000000; // 2 Mbps
-    encoder_ctx->gop_size = 30;
-    encoder_ctx->max_b_frames = 0; // Low latency
-    
-    // Hardware encoder specific options
-    AVDictionary* enc_opts = nullptr;
-    if (strcmp(encoder->name, "h264_videotoolbox") == 0) {
-        av_dict_set(&enc_opts, "realtime", "1", 0);
-        av_dict_set(&enc_opts, "quality", "0.5", 0);
-    } else {
-        av_dict_set(&enc_opts, "preset", "ultrafast", 0);
-        av_dict_set(&enc_opts, "tune", "zerolatency", 0);
-    }
-    
-    if (avcodec_open2(encoder_ctx, encoder, &enc_opts) < 0) {
+    // Default encoder; attach() may switch to the codec negotiated for the call
+    CodecSettings initial = settings;
+    clampToCapture(initial);
+    if (!openEncoder(initial)) {
         std::cerr << "Failed to open encoder" << std::endl;
         return false;
     }
@@ -91,10 +266,20 @@ bool FFmpegSender::initialize(const std::string& dest_ip, uint16_t dest_port) {
     AVCodecParameters* par = input_ctx->streams[video_stream_idx]->codecpar;
     sws_ctx = sws_getContext(
         par->width, par->height, (AVPixelFormat)par->format,
-        1280, 720, AV_PIX_FMT_YUV420P,
+        settings.width, settings.height, AV_PIX_FMT_YUV420P,
         SWS_BILINEAR, nullptr, nullptr, nullptr
     );
     
+    // Setup decoder for input stream
+    const AVCodec* decoder = avcodec_find_decoder(par->codec_id);
+    decoder_ctx = avcodec_alloc_context3(decoder);
+    avcodec_parameters_to_context(decoder_ctx, par);
+    if (avcodec_open2(decoder_ctx, decoder, nullptr) < 0) {
+        std::cerr << "Failed to open capture decoder" << std::endl;
+        return false;
+    }
+    
+    std::cout << "Capture " << par->width << "x" << par->height << ", profile " << profile_name << std::endl;
     return true;
 }
 
@@ -105,37 +290,89 @@ void FFmpegSender::run() {
     
     // Allocate YUV frame buffer
     yuv_frame->format = AV_PIX_FMT_YUV420P;
-    yuv_frame->width = 1280;
-    yuv_frame->height = 720;
+    yuv_frame->width = settings.width;
+    yuv_frame->height = settings.height;
     av_frame_get_buffer(yuv_frame, 0);
     
-    // Setup decoder for input stream
-    const AVCodec* decoder = avcodec_find_decoder(input_ctx->streams[video_stream_idx]->codecpar->codec_id);
-    AVCodecContext* decoder_ctx = avcodec_alloc_context3(decoder);
-    avcodec_parameters_to_context(decoder_ctx, input_ctx->streams[video_stream_idx]->codecpar);
-    avcodec_open2(decoder_ctx, decoder, nullptr);
-    
-    int64_t frame_count = 0;
+    int64_t pts_origin_us = media_clock_us();
+    int64_t next_due_us = 0;
+    // Capture time of recent frames, indexed by encoder pts, for the wire header
+    constexpr int64_t CAPTURE_RING = 64;
+    int64_t capture_us[CAPTURE_RING] = {};
+    ChangeDetector detector;
+    ContentAdaptivePolicy policy(settings.fps, STATIC_FPS);
     
     // while (av_read_frame(input_ctx, input_pkt) >= 0) {
-    while (true) {
-      while (av_read_frame(input_ctx, input_pkt) >= 0) {
-        if (input_pkt->stream_index == video_stream_idx) {
+    while (running) {
+      while (running && av_read_frame(input_ctx, input_pkt) >= 0) {
+        // Standby: keep draining the camera so it stays hot, but skip decode/encode
+        if (input_pkt->stream_index == video_stream_idx && attached) {
             // Decode input frame
             if (avcodec_send_packet(decoder_ctx, input_pkt) >= 0) {
                 while (avcodec_receive_frame(decoder_ctx, raw_frame) >= 0) {
-                    // Convert to YUV420P for encoder
+                    // Profile switch requested mid-call
+                    if (profile_pending.exchange(false) && applyPendingProfile(yuv_frame)) {
+                        policy = ContentAdaptivePolicy(settings.fps, STATIC_FPS);
+                        detector.reset();
+                    }
+                    
+                    // Codec negotiated for this call differs from the warm one
+                    VideoCodec wanted = static_cast<VideoCodec>(requested_codec.load());
+                    if (wanted != settings.codec && !openEncoder(wanted)) {
+                        std::cerr << "Keeping " << codec_name(settings.codec) << " encoder" << std::endl;
+                        requested_codec = static_cast<uint8_t>(settings.codec);
+                    }
+                    
+                    // The camera may run faster than the profile's frame rate
+                    int64_t now_us = media_clock_us();
+                    bool force = force_idr.exchange(false);
+                    const int64_t interval_us = 1000000 / settings.fps;
+                    if (!force && now_us < next_due_us - 2000) continue;
+                    next_due_us = now_us - next_due_us > interval_us ? now_us + interval_us
+                                                                     : next_due_us + interval_us;
+                    
+                    // Convert to YUV420P at the encode size
                     sws_scale(sws_ctx, 
                             raw_frame->data, raw_frame->linesize, 0, raw_frame->height,
                             yuv_frame->data, yuv_frame->linesize);
                     
-                    yuv_frame->pts = frame_count++;
+                    if (content_adaptive) {
+                        if (force) policy.reset();
+                        detector.analyze(yuv_frame->data[0], yuv_frame->linesize[0],
+                                         yuv_frame->width, yuv_frame->height);
+                        detect_time.observe(media_clock_us() - now_us);
+                        bool encode = policy.shouldEncode(detector, now_us, force);
+                        
+                        // Static scenes need a fraction of the bits (libx264 applies this mid-stream)
+                        int64_t target = policy.isStatic() ? settings.bit_rate / STATIC_BITRATE_DIVISOR
+                                                           : settings.bit_rate;
+                        if (settings.rate_control != RateControl::CQ && encoder_ctx->bit_rate != target) {
+                            set_video_bit_rate(encoder_ctx, settings, target);
+                            static_scene.set(policy.isStatic());
+                        }
+                        if (!encode) {
+                            frames_skipped.inc();
+                            continue;
+                        }
+                        detector.commit();
+                        policy.applyRoi(detector, yuv_frame);
+                    }
+                    
+                    // pts from the capture clock: gaps from skipped frames are real durations
+                    int64_t pts = av_rescale(now_us - pts_origin_us, settings.fps, 1000000);
+                    if (pts <= last_pts) pts = last_pts + 1;
+                    last_pts = pts;
+                    capture_us[pts % CAPTURE_RING] = now_us;
+                    yuv_frame->pts = pts;
+                    yuv_frame->pict_type = force ? AV_PICTURE_TYPE_I : AV_PICTURE_TYPE_NONE;
                     
                     // Encode frame
+                    int64_t encode_start_us = media_clock_us();
                     if (avcodec_send_frame(encoder_ctx, yuv_frame) >= 0) {
                         AVPacket* enc_pkt = av_packet_alloc();
                         while (avcodec_receive_packet(encoder_ctx, enc_pkt) >= 0) {
-                            sendPacket(enc_pkt, 1); // type 1 = video
+                            encode_time.observe(media_clock_us() - encode_start_us);
+                            sendPacket(enc_pkt, MEDIA_KIND_VIDEO, capture_us[enc_pkt->pts % CAPTURE_RING]);
                             av_packet_unref(enc_pkt);
                         }
                         av_packet_free(&enc_pkt);
@@ -148,53 +385,149 @@ void FFmpegSender::run() {
   }
     
     // Cleanup
-    avcodec_free_context(&decoder_ctx);
     av_frame_free(&raw_frame);
     av_frame_free(&yuv_frame);
     av_packet_free(&input_pkt);
 }
 
-void FFmpegSender::sendPacket(AVPacket* pkt, uint8_t type) {
-    // Send packet size + type header
-    uint32_t total_size = htonl(pkt->size + 1);
-    sendto(sock, &total_size, sizeof(total_size), 0, 
-           (sockaddr*)&dest_addr, sizeof(dest_addr));
-    sendto(sock, &type, 1, 0, 
-           (sockaddr*)&dest_addr, sizeof(dest_addr));
+void FFmpegSender::setupTransmit() {
+#ifdef UDP_SEGMENT
+    // Probe once; sendFragments() turns it off again if the route can't segment
+    int probe = 0;
+    socklen_t len = sizeof(probe);
+    use_gso = getsockopt(sock, SOL_UDP, UDP_SEGMENT, &probe, &len) == 0;
+#endif
+}
+
+// Sends iov[2*i], iov[2*i+1] (header, payload slice) as datagram i
+void FFmpegSender::sendFragments(int fd, iovec* iov, size_t fragments, size_t segment_size,
+                                 const sockaddr_in& dest) {
+    size_t sent = 0;
+    
+    while (sent < fragments) {
+        msghdr msg{};
+        msg.msg_name = const_cast<sockaddr_in*>(&dest);
+        msg.msg_namelen = sizeof(dest);
+        msg.msg_iov = iov + 2 * sent;
+        
+#ifdef UDP_SEGMENT
+        if (use_gso && fragments - sent > 1) {
+            // Every fragment but the frame's last is exactly one segment long, so
+            // the kernel splits the iovec chain right at each header
+            size_t batch = std::min(fragments - sent, GSO_MAX_FRAGMENTS);
+            char control[CMSG_SPACE(sizeof(uint16_t))] = {};
+            msg.msg_iovlen = 2 * batch;
+            msg.msg_control = control;
+            msg.msg_controllen = sizeof(control);
+            cmsghdr* cm = CMSG_FIRSTHDR(&msg);
+            cm->cmsg_level = SOL_UDP;
+            cm->cmsg_type = UDP_SEGMENT;
+            cm->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+            uint16_t segment = segment_size;
+            memcpy(CMSG_DATA(cm), &segment, sizeof(segment));
+            
+            ssize_t n = sendmsg(fd, &msg, 0);
+            if (n < 0 && (errno == EIO || errno == EINVAL || errno == ENOPROTOOPT)) {
+                std::cerr << "UDP segmentation offload unavailable, sending fragments individually" << std::endl;
+                use_gso = false;
+                continue;
+            }
+            sent += batch; // a failed batch is lost like any dropped datagram
+            continue;
+        }
+#endif
+        msg.msg_iovlen = 2;
+        sendmsg(fd, &msg, 0);
+        sent++;
+    }
+}
+
+void FFmpegSender::setRecorder(StreamRecorder* r) {
+    std::lock_guard<std::mutex> lock(recorder_mutex);
+    uint32_t size = sent_size;
+    if (r) r->setVideoSize(size >> 16, size & 0xffff);
+    recorder = r;
+}
+
+void FFmpegSender::sendPacket(AVPacket* pkt, uint8_t kind, int64_t pts_us) {
+    if (!attached) return;
+    
+    {
+        // Recording references the encoder's buffer; the muxing happens elsewhere
+        std::lock_guard<std::mutex> lock(recorder_mutex);
+        if (recorder) recorder->writePacket(kind, static_cast<VideoCodec>(sent_codec.load()), pkt, pts_us);
+    }
+    
+    sockaddr_in dest_addr;
+    std::chrono::steady_clock::time_point attached_at;
+    std::shared_ptr<MediaCrypto> crypto;
+    int fd;
+    {
+        // Checked together: a call torn down after this point still sends sealed or not at all
+        std::lock_guard<std::mutex> lock(dest_mutex);
+        if (!attached || !this->crypto) return;
+        dest_addr = this->dest_addr;
+        attached_at = attach_time;
+        crypto = this->crypto;
+        fd = tx_sock >= 0 ? tx_sock : sock;
+    }
+    if (!exchangeKeys(*crypto, fd, dest_addr)) {
+        frames_unkeyed.inc();
+        return;
+    }
     
-    // Send packet data in chunks to avoid UDP size limits
-    const size_t MAX_CHUNK = 1400;
-    size_t offset = 0;
-    while (offset < pkt->size) {
-        size_t chunk_size = std::min(MAX_CHUNK, (size_t)(pkt->size - offset));
-        sendto(sock, pkt->data + offset, chunk_size, 0,
-               (sockaddr*)&dest_addr, sizeof(dest_addr));
-        offset += chunk_size;
+    // Audio and video threads share this socket; every fragment carries its own header
+    MediaHeader hdr;
+    hdr.type = kind == MEDIA_KIND_VIDEO ? pack_media_type(kind, static_cast<VideoCodec>(sent_codec.load())) : kind;
+    hdr.flags = (pkt->flags & AV_PKT_FLAG_KEY) ? MEDIA_FLAG_KEYFRAME : 0;
+    hdr.seq = kind == MEDIA_KIND_VIDEO ? video_seq++ : audio_seq++;
+    hdr.pts_us = pts_us;
+    hdr.frame_size = pkt->size;
+    
+    const size_t fragments = (pkt->size + MEDIA_MAX_PAYLOAD - 1) / MEDIA_MAX_PAYLOAD;
+    // Each fragment is sealed straight into its slot of one wire buffer, [header][ciphertext][tag],
+    // and the slots are laid out so a GSO batch can still cut them at fixed offsets
+    thread_local std::vector<uint8_t> wire;
+    const size_t stride = MEDIA_HEADER_SIZE + MEDIA_MAX_PAYLOAD + MEDIA_TAG_SIZE;
+    wire.resize(fragments * stride);
+    hdr.flags |= MEDIA_FLAG_ENCRYPTED;
+    std::vector<iovec> iov(fragments * 2);
+    for (size_t i = 0; i < fragments; i++) {
+        size_t offset = i * MEDIA_MAX_PAYLOAD;
+        size_t chunk_size = std::min(MEDIA_MAX_PAYLOAD, (size_t)(pkt->size - offset));
+        hdr.frag_offset = offset;
+        uint8_t* slot = &wire[i * stride];
+        write_media_header(slot, hdr);
+        iov[2 * i] = { slot, MEDIA_HEADER_SIZE };
+        iov[2 * i + 1] = { slot + MEDIA_HEADER_SIZE, chunk_size + MEDIA_TAG_SIZE };
+    }
+    if (!crypto->sealFrame(kind, pkt->data, pkt->size, wire.data(), stride)) {
+        std::cerr << "Failed to encrypt a frame" << std::endl;
+        return;
+    }
+    sendFragments(fd, iov.data(), fragments, stride, dest_addr);
+    fragments_sent.inc(fragments);
+    if (kind == MEDIA_KIND_VIDEO) {
+        video_frames_sent.inc();
+        video_bytes_sent.inc(pkt->size);
+    } else {
+        audio_frames_sent.inc();
+    }
+
+    if (kind == MEDIA_KIND_VIDEO && first_packet_pending.exchange(false)) {
+        auto elapsed = std::chrono::steady_clock::now() - attached_at;
+        ttff_ms = std::chrono::duration_cast<std::chrono::milliseconds>(elapsed).count();
+        std::cout << "Time to first frame: " << ttff_ms.load() << " ms" << std::endl;
     }
 }
 
 FFmpegSender::~FFmpegSender() {
     if (sws_ctx) sws_freeContext(sws_ctx);
-    if (encoder_ctx) avcodec_free_context(&encoder_ctx);
+    if (decoder_ctx) avcodec_free_context(&decoder_ctx);
+    if (encoder_ctx) {
+        set_video_bit_rate(encoder_ctx, settings, settings.bit_rate);
+        codec_pool().release(encoder_key, encoder_ctx); // reused by the next call
+    }
     if (input_ctx) avformat_close_input(&input_ctx);
     if (sock >= 0) close(sock);
 }
-
-// Display thread function
-void displayThread() {
-    cv::namedWindow("Received Video", cv::WINDOW_AUTOSIZE);
-    
-    while (true) {
-        std::unique_lock<std::mutex> lock(display_mutex);
-        display_cv.wait(lock, [] { return !display_queue.empty(); });
-        
-        cv::Mat frame = display_queue.front();
-        display_queue.pop();
-        lock.unlock();
-        
-        cv::imshow("Received Video", frame);
-        if (cv::waitKey(1) == 27) break; // ESC to exit
-    }
-    
-    cv::destroyAllWindows();
-}
\ No newline at end of file
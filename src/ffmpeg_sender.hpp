@@ -7,12 +7,23 @@
 #include <queue>
 #include <mutex>
 #include <condition_variable>
+#include <atomic>
+#include <chrono>
+#include <memory>
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
+#include <sys/uio.h>
 #include <unistd.h>
 #include <opencv2/opencv.hpp>
 
+#include "codec_pool.hpp"
+#include "video_codec.hpp"
+#include "media_packet.hpp"
+#include "stream_recorder.hpp"
+#include "media_profile.hpp"
+#include "media_crypto.hpp"
+
 extern "C" {
 #include <libavdevice/avdevice.h>
 #include <libavformat/avformat.h>
@@ -21,28 +32,90 @@ extern "C" {
 #include <libswscale/swscale.h>
 }
 
+/*
+  Capture + encode pipeline. warmup() opens the camera, encoder and scaler
+  up front so the pipeline can sit in standby (capturing, not encoding)
+  until attach() gives it a destination; the first frame after attach is
+  forced to an IDR so the receiver can start decoding immediately.
+*/
 class FFmpegSender {
 private:
     int sock = -1;
     sockaddr_in dest_addr{};
+    int tx_sock = -1;                      // guarded by dest_mutex; not owned, -1 = sock
+    std::shared_ptr<MediaCrypto> crypto;   // guarded by dest_mutex; nullptr = nothing is sent
+    std::atomic<bool> crypto_confirmed{false};
+    std::mutex dest_mutex;
+    std::atomic<bool> running{true};
+    std::atomic<bool> attached{false};     // written under dest_mutex
+    std::atomic<bool> force_idr{false};
+    std::atomic<bool> first_packet_pending{false};
+    std::chrono::steady_clock::time_point attach_time;
+    std::atomic<int64_t> ttff_ms{-1};
+    std::atomic<uint8_t> requested_codec{0};
+    std::atomic<uint32_t> video_seq{0};
+    std::atomic<uint32_t> audio_seq{0};
+    std::atomic<uint32_t> control_seq{0};
+    CodecSettings settings;                // encoder thread; the codec is negotiated per call
+    std::atomic<uint8_t> sent_codec{0};    // settings.codec and width << 16 | height of the open
+    std::atomic<uint32_t> sent_size{0};    // encoder, for sendPacket() callers on other threads
+    CaptureSettings capture;               // fixed once warmup() has started
+    std::mutex profile_mutex;
+    bool capture_open = false;             // guarded by profile_mutex
+    std::string profile_name = "720p";
+    MediaProfile pending_profile;          // mid-call switch, applied by run()
+    std::atomic<bool> profile_pending{false};
+    int64_t last_pts = -1;
+    std::atomic<bool> content_adaptive{true}; // skip frames and add ROI for static scenes
+
     AVFormatContext* input_ctx = nullptr;
+    AVCodecContext* decoder_ctx = nullptr;
     AVCodecContext* encoder_ctx = nullptr;
+    std::string encoder_key;
     SwsContext* sws_ctx = nullptr;
     int video_stream_idx = -1;
 
+    // Transmit path: sealed fragments leave as iovecs over one wire buffer
+    std::atomic<bool> use_gso{false};      // UDP_SEGMENT: one sendmsg per batch of fragments
+
+    StreamRecorder* recorder = nullptr; // not owned
+    std::mutex recorder_mutex;
+
+    bool openEncoder(const CodecSettings& next);
+    bool openEncoder(VideoCodec codec);
+    bool applyPendingProfile(AVFrame* yuv_frame);
+    void clampToCapture(CodecSettings& s) const;
+    void setupTransmit();
+    void sendFragments(int fd, iovec* iov, size_t fragments, size_t segment, const sockaddr_in& dest);
+    bool exchangeKeys(MediaCrypto& c, int fd, const sockaddr_in& dest);
+
 public:
-    bool initialize(const std::string& dest_ip, uint16_t dest_port);
+    // Before warmup(): capture and encode settings. Afterwards: encode size, rate and
+    // encoder options switch at the next frame without reopening the camera.
+    void setProfile(const MediaProfile& profile);
+    bool warmup();
+    void attach(const std::string& dest_ip, uint16_t dest_port, VideoCodec codec = VideoCodec::H264);
+    void detach();
+    // Send from fd (not owned) instead of our own socket, so the peer sees the address it
+    // punched its NAT open for (rendezvous.hpp); -1 goes back to our own
+    void setTransmitSocket(int fd);
+    // Change detection driven frame skipping, bitrate and ROI (on by default)
+    void setContentAdaptive(bool enabled);
+    // Makes run() return; safe to call from any thread
+    void stop();
+    bool initialize(const std::string& dest_ip, uint16_t dest_port, VideoCodec codec = VideoCodec::H264);
     void run();
-    void sendPacket(AVPacket* pkt, uint8_t type);
+    // Fragments and sends one encoded frame; thread-safe so audio can share the socket
+    void sendPacket(AVPacket* pkt, uint8_t kind, int64_t pts_us);
+    // One control channel message to the peer (control_channel.hpp); dropped until keys are exchanged
+    void sendControl(const uint8_t* payload, size_t len);
+    // Encrypt everything sent from now on with c, exchanging keys first; without one nothing is sent
+    void setCrypto(std::shared_ptr<MediaCrypto> c);
+    // Also hand every sent packet to r (nullptr to stop); returns once no send is using the old one
+    void setRecorder(StreamRecorder* r);
+    // Milliseconds from the last attach() to its first packet on the wire, -1 if none yet
+    int64_t timeToFirstFrameMs() const { return ttff_ms.load(); }
     ~FFmpegSender();
 };
 
-// External display variables
-extern std::queue<cv::Mat> display_queue;
-extern std::mutex display_mutex;
-extern std::condition_variable display_cv;
-
-// Display thread function
-void displayThread();
-
 #endif // FFMPEG_SENDER_HPP
\ No newline at end of file
@@ -0,0 +1,91 @@
+#include "frame_slab.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+
+FrameSlabAllocator::FrameSlabAllocator(size_t max_frame_bytes, size_t padding)
+    : max_frame_bytes(max_frame_bytes), padding(padding) {
+    free_lists.resize(classFor(max_frame_bytes) + 1);
+    used_since_trim.assign(free_lists.size(), false);
+    // Free lists never need to grow on the hot path
+    for (auto& list : free_lists) list.reserve(32);
+    owned.reserve(free_lists.size() * 32);
+}
+
+FrameSlabAllocator::~FrameSlabAllocator() {
+    for (uint8_t* p : owned) free(p);
+}
+
+int FrameSlabAllocator::classFor(size_t size) {
+    int size_class = 0;
+    while (classSize(size_class) < size) size_class++;
+    return size_class;
+}
+
+FrameSlabAllocator::Block FrameSlabAllocator::acquire(size_t size) {
+    Block block;
+    if (size > max_frame_bytes) return block;
+    acquires.fetch_add(1, std::memory_order_relaxed);
+
+    block.size_class = classFor(size);
+    block.capacity = classSize(block.size_class);
+    used_since_trim[block.size_class] = true;
+    auto& list = free_lists[block.size_class];
+    if (!list.empty()) {
+        block.data = list.back();
+        list.pop_back();
+        recycled.fetch_add(1, std::memory_order_relaxed);
+    } else {
+        // Cache-line aligned; a class is only ever allocated up to its peak concurrency
+        if (posix_memalign(reinterpret_cast<void**>(&block.data), 64, block.capacity + padding) != 0) {
+            return Block{};
+        }
+        owned.push_back(block.data);
+        heap_allocs.fetch_add(1, std::memory_order_relaxed);
+        reserved_bytes.fetch_add(block.capacity + padding, std::memory_order_relaxed);
+    }
+    memset(block.data + size, 0, padding);
+
+    size_t in_use = bytes_in_use.fetch_add(block.capacity, std::memory_order_relaxed) + block.capacity;
+    if (in_use > high_water_bytes.load(std::memory_order_relaxed)) {
+        high_water_bytes.store(in_use, std::memory_order_relaxed);
+    }
+    return block;
+}
+
+void FrameSlabAllocator::release(Block& block) {
+    if (!block.data) return;
+    free_lists[block.size_class].push_back(block.data);
+    bytes_in_use.fetch_sub(block.capacity, std::memory_order_relaxed);
+    block = Block{};
+}
+
+size_t FrameSlabAllocator::trimIdle() {
+    size_t freed = 0;
+    for (size_t size_class = 0; size_class < free_lists.size(); size_class++) {
+        auto& list = free_lists[size_class];
+        if (!used_since_trim[size_class] && !list.empty()) {
+            for (uint8_t* p : list) {
+                owned.erase(std::find(owned.begin(), owned.end(), p));
+                free(p);
+                freed += classSize(size_class) + padding;
+            }
+            list.clear(); // keeps its capacity: refilling it later allocates only the blocks
+        }
+        used_since_trim[size_class] = false;
+    }
+    reserved_bytes.fetch_sub(freed, std::memory_order_relaxed);
+    return freed;
+}
+
+FrameSlabAllocator::Stats FrameSlabAllocator::stats() const {
+    Stats s;
+    s.acquires = acquires.load(std::memory_order_relaxed);
+    s.recycled = recycled.load(std::memory_order_relaxed);
+    s.heap_allocs = heap_allocs.load(std::memory_order_relaxed);
+    s.bytes_in_use = bytes_in_use.load(std::memory_order_relaxed);
+    s.high_water_bytes = high_water_bytes.load(std::memory_order_relaxed);
+    s.reserved_bytes = reserved_bytes.load(std::memory_order_relaxed);
+    return s;
+}
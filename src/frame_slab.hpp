@@ -0,0 +1,78 @@
+#ifndef FRAME_SLAB_HPP
+#define FRAME_SLAB_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Default upper bound on one reassembled frame (a 4K keyframe fits easily)
+constexpr size_t DEFAULT_MAX_FRAME_BYTES = 8 * 1024 * 1024;
+
+/*
+  Size-classed slab allocator for frames under reassembly. Each in-flight
+  frame gets one contiguous block (its arena) from the smallest power-of-two
+  class that fits, 4 KB up to the configured limit. Released blocks go back
+  on their class's free list, so once a call has seen its largest keyframe,
+  reception allocates nothing. trimIdle() hands the free blocks of classes
+  nobody asked for since the previous trim back to the heap, so one burst
+  of huge frames does not stay reserved for the life of the process.
+
+  Not thread-safe: owned and used by the receive thread. Stats are atomics
+  so they can be read from anywhere.
+*/
+class FrameSlabAllocator {
+public:
+    struct Block {
+        uint8_t* data = nullptr;
+        size_t capacity = 0; // usable bytes, not counting padding
+        int size_class = -1;
+    };
+
+    struct Stats {
+        uint64_t acquires;
+        uint64_t recycled;       // acquires served from a free list
+        uint64_t heap_allocs;
+        size_t bytes_in_use;
+        size_t high_water_bytes; // peak bytes handed out at once
+        size_t reserved_bytes;   // everything ever allocated, free or not
+        double recycleRate() const { return acquires ? double(recycled) / acquires : 0.0; }
+    };
+
+    // padding: extra zeroed bytes after each frame (decoders read past the end)
+    explicit FrameSlabAllocator(size_t max_frame_bytes = DEFAULT_MAX_FRAME_BYTES, size_t padding = 64);
+    ~FrameSlabAllocator();
+
+    // Block with capacity >= size and its padding zeroed; data == nullptr if size exceeds the limit
+    Block acquire(size_t size);
+    void release(Block& block);
+    // Frees the free-listed blocks of every class not acquired since the last call; returns bytes freed
+    size_t trimIdle();
+
+    size_t maxFrameBytes() const { return max_frame_bytes; }
+    Stats stats() const;
+
+    FrameSlabAllocator(const FrameSlabAllocator&) = delete;
+    FrameSlabAllocator& operator=(const FrameSlabAllocator&) = delete;
+
+private:
+    static constexpr int MIN_CLASS_SHIFT = 12; // 4 KB
+
+    size_t max_frame_bytes;
+    size_t padding;
+    std::vector<std::vector<uint8_t*>> free_lists; // per size class
+    std::vector<bool> used_since_trim;             // per size class
+    std::vector<uint8_t*> owned;
+
+    std::atomic<uint64_t> acquires{0};
+    std::atomic<uint64_t> recycled{0};
+    std::atomic<uint64_t> heap_allocs{0};
+    std::atomic<size_t> bytes_in_use{0};
+    std::atomic<size_t> high_water_bytes{0};
+    std::atomic<size_t> reserved_bytes{0};
+
+    static int classFor(size_t size);
+    static size_t classSize(int size_class) { return size_t(1) << (size_class + MIN_CLASS_SHIFT); }
+};
+
+#endif // FRAME_SLAB_HPP
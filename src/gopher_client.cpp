@@ -13,6 +13,9 @@
 #include <chrono>
 #include <queue>
 #include <condition_variable>
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
 
 //video specific includes
 #include <opencv2/opencv.hpp>
@@ -36,20 +39,24 @@ extern "C" {
 #include "gopherd_helper.hpp"
 #include "ffmpeg_sender.hpp"
 #include "ffmpeg_receiver.hpp"
+#include "announcer.hpp"
+#include "gopher_session.hpp"
+#include "rendezvous.hpp"
+#include "display_scheduler.hpp"
+#include "metrics.hpp"
+#include "thread_policy.hpp"
 
 #ifdef __APPLE__
 #include <VideoToolbox/VideoToolbox.h>
 #endif
 
-// Declare external variables from ffmpeg_sender.cpp
-extern std::queue<cv::Mat> display_queue;
-extern std::mutex display_mutex;
-extern std::condition_variable display_cv;
-
 struct Gopher {
   std::string name;
   std::string ip;
   uint16_t port;
+  std::string codecs; // decodable video codecs advertised by the peer
+  std::string key;    // identity key for call encryption, empty from older clients
+  std::string candidates; // endpoints to check, from a rendezvous daemon only
 };
 
 Gopher me_gopher;
@@ -57,7 +64,6 @@ Gopher them_gopher;
 
 std::string gopher_name;
 uint16_t listening_port;
-std::vector<std::thread> threads;
 std::mutex gopher_mutex;
 
 std::queue<cv::Mat> frame_queue;
@@ -105,28 +111,7 @@ char getch() {
   return ch;
 }
 
-int broadcast(){
-  int sock = socket(AF_INET, SOCK_DGRAM, 0);
-  int broadcast_enable = 1;
-
-  setsockopt(sock, SOL_SOCKET, SO_BROADCAST, &broadcast_enable, sizeof(broadcast_enable));
-
-  sockaddr_in addr{}; 
-  addr.sin_family = AF_INET;
-  addr.sin_port = htons(43753);
-  addr.sin_addr.s_addr = inet_addr("255.255.255.255");
-
-  std::string message = "name:" + gopher_name + ";ip:" + get_local_ip() + ";port:" +  std::to_string(listening_port) + ";";
-
-  while(true){
-    // send the broadcast message
-    // std::cout << "Broadcasting: " << message << "\n";
-    sendto(sock, message.c_str(), message.size(), 0, (struct sockaddr*)&addr, sizeof(addr));
-    sleep(5);
-  }
-}
-
-std::vector<Gopher> query_daemon_for_gophers() {
+std::vector<Gopher> query_daemon_for_gophers(const std::string& daemon_ip = "127.0.0.1") {
   std::vector<Gopher> result;
   int sock = socket(AF_INET, SOCK_STREAM, 0);
   if (sock < 0) return result;
@@ -134,24 +119,29 @@ std::vector<Gopher> query_daemon_for_gophers() {
   sockaddr_in addr{};
   addr.sin_family = AF_INET;
   addr.sin_port = htons(DAEMON_PORT);
-  inet_pton(AF_INET, "127.0.0.1", &addr.sin_addr);
+  inet_pton(AF_INET, daemon_ip.c_str(), &addr.sin_addr);
 
   if (connect(sock, (sockaddr*)&addr, sizeof(addr)) == 0) {
+    // Daemon closes the connection after the listing
+    std::string listing;
     char buffer[2048];
-    int n = read(sock, buffer, sizeof(buffer) - 1);
-    if (n > 0) {
-      buffer[n] = '\0';
-
-      std::istringstream iss(buffer);
-      std::string line;
-      while (std::getline(iss, line)) {
-        std::istringstream ls(line);
-        std::string name, ip, port_str;
-        if (std::getline(ls, name, ',') &&
-            std::getline(ls, ip, ',') &&
-            std::getline(ls, port_str)) {
-          result.push_back(Gopher{name, ip, static_cast<uint16_t>(std::stoi(port_str))});
-        }
+    int n;
+    while ((n = read(sock, buffer, sizeof(buffer))) > 0) {
+      listing.append(buffer, n);
+    }
+
+    std::istringstream iss(listing);
+    std::string line;
+    while (std::getline(iss, line)) {
+      std::istringstream ls(line);
+      std::string name, ip, port_str, codecs, key, candidates;
+      if (std::getline(ls, name, ',') &&
+          std::getline(ls, ip, ',') &&
+          std::getline(ls, port_str, ',')) {
+        std::getline(ls, codecs, ','); // absent from older daemons
+        std::getline(ls, key, ',');
+        std::getline(ls, candidates);
+        result.push_back(Gopher{name, ip, static_cast<uint16_t>(std::stoi(port_str)), codecs, key, candidates});
       }
     }
   }
@@ -159,6 +149,21 @@ std::vector<Gopher> query_daemon_for_gophers() {
   return result;
 }
 
+// Peers registered with the rendezvous daemon, then local ones it does not know about
+std::vector<Gopher> query_gophers(const std::string& rendezvous_ip) {
+  if (rendezvous_ip.empty()) return query_daemon_for_gophers();
+  std::vector<Gopher> result = query_daemon_for_gophers(rendezvous_ip);
+  result.erase(std::remove_if(result.begin(), result.end(),
+                              [](const Gopher& g) { return g.candidates.empty(); }), result.end());
+  for (auto& local : query_daemon_for_gophers()) {
+    bool known = std::any_of(result.begin(), result.end(), [&](const Gopher& g) {
+      return !local.key.empty() && g.key == local.key;
+    });
+    if (!known) result.push_back(local);
+  }
+  return result;
+}
+
 int create_listening_socket(uint16_t& out_port) {
   int sock = socket(AF_INET, SOCK_DGRAM, 0);
   
@@ -178,22 +183,6 @@ int create_listening_socket(uint16_t& out_port) {
 
 //---------------------------------------------
 
-void ffmpeg_sending_thread(const std::string& ip, uint16_t port) {
-    FFmpegSender sender;
-    if (sender.initialize(ip, port)) {
-        std::cout << "Starting FFmpeg sender to " << ip << ":" << port << std::endl;
-        sender.run();
-    }
-}
-
-void ffmpeg_listener_thread(int existing_sock_fd, uint16_t listen_port) {
-    FFmpegReceiver receiver;
-    if (receiver.initialize(existing_sock_fd, listen_port)) {
-        std::cout << "Starting FFmpeg receiver on port " << listen_port << std::endl; 
-        receiver.run();
-    }
-}
-
 struct AVPacketData {
     std::vector<uint8_t> data;
     bool is_video;
@@ -216,14 +205,156 @@ void setup_hardware_acceleration() {
     #endif
 }
 
-int main() {
+static void usage() {
+    std::cerr << "usage: gopher_client [--cold] [--codec LIST] [--audio SOURCE] [--max-frame-mb N]\n"
+                 "                     [--record DIR [--record-side sent|received|both]] [--trace DIR]\n"
+                 "                     [--metrics-port N] [--refresh-hz N] [--no-adaptive] [--profile NAME]\n"
+                 "                     [--profile-file PATH] [--video key=value] [--rendezvous HOST[:PORT]]\n"
+                 "                     [--pin-threads] [--no-rt] [--thread-stats]\n";
+}
+
+// Whole-string decimal in [min, max]; false on anything else
+static bool parse_int_arg(const char* text, long min, long max, int& out) {
+    errno = 0;
+    char* end = nullptr;
+    long value = strtol(text, &end, 10);
+    if (errno != 0 || end == text || *end != '\0' || value < min || value > max) return false;
+    out = static_cast<int>(value);
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+    // --cold: open camera and encoder only once a peer is selected
+    // --codec vp9+vp8+h264: encoder preference for negotiation
+    // --audio device|file:<path>|sine[:hz]|none: what to send as call audio
+    // --max-frame-mb N: largest incoming frame to reassemble
+    // --record DIR [--record-side sent|received|both]: save calls as fragmented MP4
+    // --trace DIR: capture received datagrams for offline replay (gopher_replay)
+    // --metrics-port N: serve Prometheus metrics on 127.0.0.1:N
+    // --refresh-hz N: display refresh cadence (default 60)
+    // --no-adaptive: encode every frame at full rate even when the scene is static
+    // --profile NAME: capture/encode preset (360p, 540p, 720p, 1080p or one from --profile-file)
+    // --profile-file PATH: extra profiles, see media_profile.hpp
+    // --video key=value: override one profile setting, e.g. --video bitrate=1.5M --video rate_control=cbr
+    // --rendezvous HOST[:PORT]: also list and call peers registered with the gopherd --rendezvous on HOST
+    // --pin-threads: keep capture/encode and receive/decode on separate cores (CCXs where there are several)
+    // --no-rt: leave thread priorities alone
+    // --thread-stats: per-thread CPU time and context switches after each call and at exit
+    // During a call keys 1-9 switch to the Nth listed profile
+    bool warm_standby = true;
+    std::string audio_source = "device";
+    size_t max_frame_bytes = DEFAULT_MAX_FRAME_BYTES;
+    std::string record_dir;
+    std::string record_side = "both";
+    std::string trace_dir;
+    int metrics_port = 0;
+    int refresh_hz = DEFAULT_REFRESH_HZ;
+    bool content_adaptive = true;
+    std::string profile_name = "720p";
+    std::vector<std::string> profile_files;
+    std::vector<std::string> video_options;
+    std::string rendezvous_server;
+    ThreadPolicy thread_policy;
+    bool show_thread_stats = false;
+    std::vector<VideoCodec> codec_preference = default_codec_preference();
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--cold") warm_standby = false;
+        if (arg == "--codec" && i + 1 < argc) codec_preference = parse_codec_list(argv[++i]);
+        if (arg == "--audio" && i + 1 < argc) audio_source = argv[++i];
+        if (arg == "--max-frame-mb" && i + 1 < argc) {
+            int mb = 0;
+            if (!parse_int_arg(argv[++i], 1, 1024, mb)) {
+                std::cerr << "--max-frame-mb takes a size from 1 to 1024" << std::endl;
+                usage();
+                return 2;
+            }
+            max_frame_bytes = size_t(mb) * 1024 * 1024;
+        }
+        if (arg == "--record" && i + 1 < argc) record_dir = argv[++i];
+        if (arg == "--record-side" && i + 1 < argc) record_side = argv[++i];
+        if (arg == "--trace" && i + 1 < argc) trace_dir = argv[++i];
+        if (arg == "--metrics-port" && i + 1 < argc && !parse_int_arg(argv[++i], 0, 65535, metrics_port)) {
+            std::cerr << "--metrics-port takes a port from 0 (off) to 65535" << std::endl;
+            usage();
+            return 2;
+        }
+        if (arg == "--refresh-hz" && i + 1 < argc && !parse_int_arg(argv[++i], 1, 1000, refresh_hz)) {
+            std::cerr << "--refresh-hz takes a rate from 1 to 1000" << std::endl;
+            usage();
+            return 2;
+        }
+        if (arg == "--no-adaptive") content_adaptive = false;
+        if (arg == "--profile" && i + 1 < argc) profile_name = argv[++i];
+        if (arg == "--profile-file" && i + 1 < argc) profile_files.push_back(argv[++i]);
+        if (arg == "--video" && i + 1 < argc) video_options.push_back(argv[++i]);
+        if (arg == "--rendezvous" && i + 1 < argc) rendezvous_server = argv[++i];
+        if (arg == "--pin-threads") thread_policy.pin = true;
+        if (arg == "--no-rt") thread_policy.priority = false;
+        if (arg == "--thread-stats") show_thread_stats = true;
+    }
+    set_thread_policy(thread_policy);
+    
+    std::vector<MediaProfile> profiles = builtin_profiles();
+    for (const auto& path : profile_files) {
+        if (!load_profile_file(path, profiles)) return 1;
+    }
+    const MediaProfile* chosen = find_profile(profiles, profile_name);
+    if (!chosen) {
+        std::cerr << "Unknown profile " << profile_name << ", available:" << std::endl;
+        for (const auto& p : profiles) std::cerr << "  " << describe_profile(p) << std::endl;
+        return 1;
+    }
+    MediaProfile profile = *chosen;
+    for (const auto& option : video_options) {
+        size_t eq = option.find('=');
+        std::string error = "expected key=value";
+        if (eq == std::string::npos ||
+            !set_profile_option(profile, option.substr(0, eq), option.substr(eq + 1), profiles, error)) {
+            std::cerr << "--video " << option << ": " << error << std::endl;
+            return 1;
+        }
+    }
+    std::cout << "Video profile " << describe_profile(profile) << std::endl;
+    
+    // Identity for this run: announced in discovery, mixed into every call's keys
+    MediaKeyPair identity;
+    if (!MediaKeyPair::generate(identity)) {
+        std::cerr << "Failed to generate an identity key" << std::endl;
+        return 1;
+    }
+    
     ensure_daemon_running("./gopherd");
+    MetricsServer metrics_server;
+    if (metrics_port > 0) metrics_server.start(metrics_port);
     setup_hardware_acceleration();
+    
+    // Warm standby: capture, encoder and scaler come up while the user picks a peer
+    FFmpegSender warm_sender;
+    warm_sender.setContentAdaptive(content_adaptive);
+    warm_sender.setProfile(profile);
+    std::thread warm_thread;
+    if (warm_standby) {
+        warm_thread = std::thread([&warm_sender] {
+            apply_thread_policy(ThreadRole::CAPTURE);
+            if (warm_sender.warmup()) warm_sender.run();
+        });
+    }
 
     std::vector<std::string> menu = {"Exit"};
     int selected = 0;
     
     int listening_socket = create_listening_socket(listening_port);
+    GopherSession session(listening_socket, listening_port, warm_standby ? &warm_sender : nullptr,
+                          audio_source);
+    session.setMaxFrameBytes(max_frame_bytes);
+    session.setContentAdaptive(content_adaptive);
+    session.setProfile(profile);
+    session.setIdentity(identity);
+    if (!record_dir.empty()) {
+        session.setRecording(record_dir, record_side != "received", record_side != "sent");
+    }
+    if (!trace_dir.empty()) session.setTrace(trace_dir);
     
     std::cout << "Thank you for using Gopher! Please provide a friendly name for your Gopher:\n";
     std::getline(std::cin, gopher_name);
@@ -234,12 +365,44 @@ int main() {
     
     std::cout << "My IP: " << me_gopher.ip << ":" << me_gopher.port << std::endl;
     
-    threads.emplace_back(broadcast);
+    // Registers from the listening socket, so the daemon learns the address peers must punch through to
+    RendezvousClient rendezvous;
+    std::string rendezvous_ip;
+    if (!rendezvous_server.empty()) {
+        Announcement self;
+        self.name = gopher_name;
+        self.port = listening_port;
+        self.codecs = format_codec_list(supported_decoders());
+        self.key = identity.publicHex();
+        if (!rendezvous.initialize(rendezvous_server, listening_socket, self, get_local_ip)) {
+            // The warm thread uses warm_sender: it has to end before main does
+            warm_sender.stop();
+            if (warm_thread.joinable()) warm_thread.join();
+            close(listening_socket);
+            return 1;
+        }
+        rendezvous.start();
+        rendezvous_ip = rendezvous.relayAddress().ip;
+    }
+    
+    Announcer announcer;
+    auto peer_keys = [] {
+        std::vector<std::string> keys;
+        for (const auto& g : query_daemon_for_gophers()) {
+            if (g.name == me_gopher.name && g.port == me_gopher.port) continue;
+            keys.push_back(g.name + "|" + g.ip + "|" + std::to_string(g.port));
+        }
+        return keys;
+    };
+    if (announcer.initialize(gopher_name, listening_port, format_codec_list(supported_decoders()),
+                             identity.publicHex(), get_local_ip, peer_keys)) {
+        announcer.start();
+    }
     
     while (true) {
         system("clear");
         
-        auto gophers = query_daemon_for_gophers();
+        auto gophers = query_gophers(rendezvous_ip);
         
         menu.clear();
         menu.push_back("Exit");
@@ -282,32 +445,72 @@ int main() {
             }
             
             if (found) {
-                std::cout << "Connecting to " << selected_gopher.name << "..." << std::endl;
-                threads.emplace_back(ffmpeg_sending_thread, selected_gopher.ip, selected_gopher.port);
-                threads.emplace_back(ffmpeg_listener_thread, listening_socket, listening_port);
-                    
-                // Display received video
-                cv::namedWindow("Received Video", cv::WINDOW_AUTOSIZE);
-                    
-                while (true) {
-                    std::unique_lock<std::mutex> lock(display_mutex);
-                    display_cv.wait(lock, [] { return !display_queue.empty(); });
-                    
-                    cv::Mat frame = display_queue.front();
-                    display_queue.pop();
-                    lock.unlock();
+                VideoCodec codec = negotiate_codec(codec_preference, parse_codec_list(selected_gopher.codecs));
+                std::cout << "Connecting to " << selected_gopher.name << " using "
+                          << codec_name(codec) << "..." << std::endl;
+                std::string peer_ip = selected_gopher.ip;
+                uint16_t peer_port = selected_gopher.port;
+                bool relayed = false;
+                if (!selected_gopher.candidates.empty()) {
+                    // The peer checks paths towards us at the same time, once its user picks us too
+                    std::cout << "Checking paths to " << selected_gopher.name << "..." << std::endl;
+                    PathCandidate relay = rendezvous.relayAddress();
+                    PathChoice path;
+                    if (select_path(listening_socket, parse_candidates(selected_gopher.candidates), &relay,
+                                    PATH_CHECK_TIMEOUT_MS, path) && !path.relayed) {
+                        peer_ip = path.ip;
+                        peer_port = path.port;
+                        std::cout << "Direct path " << peer_ip << ":" << peer_port;
+                        if (path.rtt_us >= 0) std::cout << ", rtt " << path.rtt_us / 1000.0 << " ms";
+                        std::cout << std::endl;
+                    } else {
+                        std::cout << "No direct path, relaying through " << relay.ip << std::endl;
+                        rendezvous.relayTo(selected_gopher.key);
+                        peer_ip = relay.ip;
+                        peer_port = relay.port;
+                        relayed = true;
+                    }
+                }
+                if (!session.start(peer_ip, peer_port, codec, selected_gopher.key)) {
+                    if (relayed) rendezvous.relayTo("");
+                    continue;
+                }
                     
-                    cv::imshow("Received Video", frame);
-                    if (cv::waitKey(1) == 27) break; // ESC to exit
+                std::cout << "Keys 1-" << std::min<size_t>(9, profiles.size()) << " switch video profile:" << std::endl;
+                for (size_t i = 0; i < profiles.size() && i < 9; i++) {
+                    std::cout << "  " << i + 1 << " " << describe_profile(profiles[i]) << std::endl;
                 }
                 
-                cv::destroyAllWindows();
+                // Newest due frame at each refresh; stale ones are dropped, never queued
+                present_frames("Received Video", refresh_hz, [&](int key) {
+                    size_t index = key - '1';
+                    if (key >= '1' && key <= '9' && index < profiles.size()) {
+                        session.switchProfile(profiles[index]);
+                    }
+                });
+                session.stop();
+                if (relayed) rendezvous.relayTo("");
                 std::cout << "Stopped receiving video." << std::endl;
+                LinkStats link = session.linkStats();
+                if (link.rtt_samples > 0) {
+                    std::cout << "Link: rtt " << link.srtt_us / 1000.0 << " ms (min " << link.min_rtt_us / 1000.0
+                              << "), peer lost " << link.remote.frames_lost << " of "
+                              << link.remote.frames_lost + link.remote.frames_received << " frames, jitter "
+                              << link.remote.jitter_us / 1000.0 << " ms" << std::endl;
+                }
+                if (show_thread_stats) print_thread_stats(std::cout);
             }
         }
         
         std::this_thread::sleep_for(std::chrono::milliseconds(100));
     }
     
+    announcer.stop(); // sends goodbye
+    rendezvous.stop();
+    session.stop();
+    warm_sender.stop();
+    if (warm_thread.joinable()) warm_thread.join();
+    close(listening_socket);
+    if (show_thread_stats) print_thread_stats(std::cout);
     return 0;
 }
\ No newline at end of file
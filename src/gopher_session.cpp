@@ -0,0 +1,176 @@
+#include "gopher_session.hpp"
+#include "thread_policy.hpp"
+#include "display_scheduler.hpp"
+
+#include <ctime>
+
+GopherSession::GopherSession(int listening_socket, uint16_t listening_port, FFmpegSender* warm_sender,
+                             const std::string& audio_source)
+    : listening_socket(listening_socket), listening_port(listening_port), warm_sender(warm_sender),
+      audio_source(audio_source) {}
+
+void GopherSession::setRecording(const std::string& dir, bool sent, bool received) {
+    record_dir = dir;
+    record_sent = sent;
+    record_received = received;
+}
+
+void GopherSession::setTrace(const std::string& dir) {
+    trace_dir = dir;
+}
+
+// <dir>/gopher-20250101-120000-<side>.<ext>
+static std::string recording_path(const std::string& dir, const char* side, const char* ext = "mp4") {
+    char stamp[32];
+    time_t now = time(nullptr);
+    strftime(stamp, sizeof(stamp), "%Y%m%d-%H%M%S", localtime(&now));
+    return dir + "/gopher-" + stamp + "-" + side + "." + ext;
+}
+
+bool GopherSession::start(const std::string& peer_ip, uint16_t peer_port, VideoCodec codec,
+                          const std::string& peer_key) {
+    if (active) stop();
+
+    // Media is never sent in the clear
+    std::array<uint8_t, MEDIA_KEY_SIZE> peer_identity;
+    if (!parse_media_key(peer_key, peer_identity)) {
+        std::cerr << "Peer does not advertise an encryption key; it needs a newer Gopher" << std::endl;
+        return false;
+    }
+    auto crypto = std::make_shared<MediaCrypto>();
+    if (!crypto->initialize(identity, peer_identity)) return false;
+
+    // The listening socket is shared across calls (its port is what we announce);
+    // the receiver gets its own descriptor for it and closes that on teardown
+    int recv_sock = dup(listening_socket);
+    if (recv_sock < 0) {
+        std::cerr << "Failed to duplicate listening socket" << std::endl;
+        return false;
+    }
+
+    // Discard anything still queued from a previous call
+    uint8_t scratch[2048];
+    while (recv(recv_sock, scratch, sizeof(scratch), MSG_DONTWAIT) > 0) {}
+
+    receiver = std::make_unique<FFmpegReceiver>();
+    bool receiver_ready;
+    {
+        // The decoder's threads start here and keep the mask they start with
+        ThreadRoleScope decode_role(ThreadRole::RECEIVE);
+        receiver_ready = receiver->initialize(recv_sock, listening_port, max_frame_bytes);
+    }
+    if (!receiver_ready) {
+        receiver.reset();
+        close(recv_sock);
+        return false;
+    }
+    if (!record_dir.empty() && record_received) {
+        // Whether the peer sends audio is only known once it does; the recorder waits for it
+        received_recorder = std::make_unique<StreamRecorder>();
+        if (received_recorder->open(recording_path(record_dir, "received"), true)) {
+            receiver->setRecorder(received_recorder.get());
+        } else {
+            received_recorder.reset(); // the call goes ahead unrecorded
+        }
+    }
+    if (!trace_dir.empty()) {
+        receiver->startTrace(recording_path(trace_dir, "received", "gtrace"));
+    }
+    receiver->setCrypto(crypto);
+    control = std::make_unique<ControlChannel>();
+    for (auto& s : link_subscribers) control->subscribe(s);
+    receiver->setControl(control.get());
+    std::cout << "Starting FFmpeg receiver on port " << listening_port << std::endl;
+    receiver_thread = std::thread([r = receiver.get()] {
+        apply_thread_policy(ThreadRole::RECEIVE);
+        r->run();
+    });
+
+    if (!record_dir.empty() && record_sent) {
+        sent_recorder = std::make_unique<StreamRecorder>();
+        if (!sent_recorder->open(recording_path(record_dir, "sent"), audio_source != "none")) {
+            sent_recorder.reset();
+        }
+    }
+    if (warm_sender) {
+        warm_sender->setRecorder(sent_recorder.get());
+        warm_sender->setCrypto(crypto);
+        warm_sender->setTransmitSocket(listening_socket);
+        warm_sender->attach(peer_ip, peer_port, codec);
+    } else {
+        sender = std::make_unique<FFmpegSender>();
+        sender->setRecorder(sent_recorder.get());
+        sender->setContentAdaptive(content_adaptive);
+        sender->setCrypto(crypto);
+        sender->setTransmitSocket(listening_socket);
+        sender->setProfile(profile);
+        sender_thread = std::thread([s = sender.get(), peer_ip, peer_port, codec] {
+            apply_thread_policy(ThreadRole::CAPTURE);
+            if (s->initialize(peer_ip, peer_port, codec)) {
+                std::cout << "Starting FFmpeg sender to " << peer_ip << ":" << peer_port << std::endl;
+                s->run();
+            }
+        });
+    }
+
+    // Reports and pings are dropped, like audio, until the sender is attached and keyed
+    control->start([s = warm_sender ? warm_sender : sender.get()](const uint8_t* p, size_t n) {
+        s->sendControl(p, n);
+    });
+
+    // Audio frames sent before a cold sender has attached are simply dropped
+    if (audio_source != "none") {
+        audio_sender = std::make_unique<AudioSender>();
+        if (audio_sender->initialize(audio_source, warm_sender ? warm_sender : sender.get())) {
+            if (sent_recorder) sent_recorder->setAudioPreSkip(audio_sender->preSkip());
+            audio_sender->start();
+        } else {
+            audio_sender.reset(); // carry on video only
+        }
+    }
+
+    active = true;
+    return true;
+}
+
+void GopherSession::stop() {
+    // Audio first: it sends through the video sender's socket
+    audio_sender.reset();
+    if (control) control->stop();
+    if (receiver) receiver->stop();
+    if (sender) sender->stop();
+    if (warm_sender) {
+        warm_sender->detach(); // back to standby
+        warm_sender->setRecorder(nullptr);
+        warm_sender->setCrypto(nullptr);
+        warm_sender->setTransmitSocket(-1);
+    }
+
+    if (receiver_thread.joinable()) receiver_thread.join();
+    if (sender_thread.joinable()) sender_thread.join();
+
+    // Destructors close sockets and hand codec contexts back to the pool
+    receiver.reset();
+    sender.reset();
+    if (control) last_link = control->stats();
+    control.reset();
+    // Nothing feeds them any more; drain and finalize the files
+    sent_recorder.reset();
+    received_recorder.reset();
+
+    // Frames from this call must not show up in the next one, nor be timed against its audio
+    playout_clock().reset();
+    display_scheduler().clear();
+
+    active = false;
+}
+
+void GopherSession::switchProfile(const MediaProfile& p) {
+    profile = p;
+    if (warm_sender) warm_sender->setProfile(p);
+    else if (sender) sender->setProfile(p);
+}
+
+GopherSession::~GopherSession() {
+    stop();
+}
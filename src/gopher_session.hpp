@@ -0,0 +1,83 @@
+#ifndef GOPHER_SESSION_HPP
+#define GOPHER_SESSION_HPP
+
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "ffmpeg_sender.hpp"
+#include "ffmpeg_receiver.hpp"
+#include "audio_sender.hpp"
+#include "stream_recorder.hpp"
+#include "control_channel.hpp"
+
+/*
+  One call with one peer. The session owns its receiver (and, in cold mode,
+  its sender), their sockets and threads; stop() cancels and joins all of
+  them so back-to-back calls never leave a running encoder or a second
+  receiver behind. With a warm sender the session only attaches/detaches it.
+  Media goes out from the listening socket, so the peer sees it come from
+  the address it discovered (and punched its NAT open for). Audio, when
+  enabled, is captured per call and sent through the video sender. Each
+  call also runs a control channel for receiver reports and RTT probes in
+  both directions.
+*/
+class GopherSession {
+private:
+    int listening_socket;
+    uint16_t listening_port;
+    FFmpegSender* warm_sender;                // not owned, may be nullptr
+    std::string audio_source;                 // AudioSender source, "none" = no audio
+    size_t max_frame_bytes = DEFAULT_MAX_FRAME_BYTES;
+    std::unique_ptr<FFmpegSender> sender;     // cold mode only
+    std::unique_ptr<FFmpegReceiver> receiver;
+    std::unique_ptr<AudioSender> audio_sender;
+    std::unique_ptr<ControlChannel> control;
+    std::vector<ControlChannel::Subscriber> link_subscribers; // attached to every call's channel
+    std::string record_dir;                   // empty = no recording
+    bool record_sent = false;
+    bool record_received = false;
+    std::unique_ptr<StreamRecorder> sent_recorder;
+    std::unique_ptr<StreamRecorder> received_recorder;
+    std::string trace_dir;                    // empty = no receive trace
+    bool content_adaptive = true;
+    MediaProfile profile;                     // cold sender's capture and encode settings
+    MediaKeyPair identity;                    // advertised in discovery
+    std::thread sender_thread;
+    std::thread receiver_thread;
+    LinkStats last_link;
+    bool active = false;
+
+public:
+    GopherSession(int listening_socket, uint16_t listening_port, FFmpegSender* warm_sender = nullptr,
+                  const std::string& audio_source = "none");
+    // peer_key: the peer's discovery identity key (hex); calls without one are refused
+    bool start(const std::string& peer_ip, uint16_t peer_port, VideoCodec codec, const std::string& peer_key);
+    void stop();
+    // Largest video frame the receiver will reassemble; applies from the next start()
+    void setMaxFrameBytes(size_t bytes) { max_frame_bytes = bytes; }
+    // Record each call's outgoing and/or incoming media to fragmented MP4s in dir
+    void setRecording(const std::string& dir, bool sent, bool received);
+    // Capture every received datagram of each call to a .gtrace in dir, for gopher_replay
+    void setTrace(const std::string& dir);
+    // Our identity key pair; its public half must be the one we announce
+    void setIdentity(const MediaKeyPair& id) { identity = id; }
+    // Static-scene frame skipping and ROI in the sender (the warm sender is configured by its owner)
+    void setContentAdaptive(bool enabled) { content_adaptive = enabled; }
+    // Profile for cold senders; applies from the next start()
+    void setProfile(const MediaProfile& p) { profile = p; }
+    // Mid-call switch of the running sender's encode settings (warm or cold)
+    void switchProfile(const MediaProfile& p);
+    // Called with fresh link statistics during every call, from the receive thread
+    void subscribeLinkStats(ControlChannel::Subscriber s) { link_subscribers.push_back(std::move(s)); }
+    // RTT and loss of the current (or last) call
+    LinkStats linkStats() const { return control ? control->stats() : last_link; }
+    bool isActive() const { return active; }
+    ~GopherSession();
+
+    GopherSession(const GopherSession&) = delete;
+    GopherSession& operator=(const GopherSession&) = delete;
+};
+
+#endif // GOPHER_SESSION_HPP
@@ -8,6 +8,11 @@
 #include <cstring>
 #include <ctime>
 #include <csignal>
+#include <cerrno>
+#include <climits>
+#include <cstdlib>
+#include <algorithm>
+#include <atomic>
 
 #ifdef _WIN32
   #include <winsock2.h>
@@ -20,16 +25,34 @@
   #include <unistd.h>
 #endif
 
+#ifdef __linux__
+  #include <sys/uio.h>
+#endif
+
+#include "discovery.hpp"
+#include "media_packet.hpp"
+#include "metrics.hpp"
+#include "thread_policy.hpp"
+
 
 
-constexpr uint16_t BROADCAST_PORT = 43753;
+constexpr uint16_t BROADCAST_PORT = DISCOVERY_PORT;
 constexpr uint16_t QUERY_PORT     = 43823;
 constexpr int TIMEOUT_SECONDS     = 30;
+constexpr int RECV_BATCH          = 64;   // datagrams pulled per recvmmsg call
+constexpr int ANNOUNCE_BUF_SIZE   = 1024;
+constexpr uint16_t METRICS_PORT   = 43825; // loopback only; --metrics-port 0 disables
 
 struct Gopher {
   std::string name;
   std::string ip;
   uint16_t port;
+  std::chrono::steady_clock::time_point expires;
+  std::string codecs;
+  std::string key;
+  std::string candidates;  // rendezvous only: "host+reflexive" endpoints
+  sockaddr_in reflexive{}; // rendezvous only: where its NAT maps the client's media socket
+  in_addr contacted{};     // rendezvous only: our address it registered with, the only one its NAT lets in
 };
 
 std::vector<Gopher> gophers;
@@ -136,17 +159,524 @@ void signal_handler(int sig) {
     running = 0;
 }
 
+// Kernel receive-queue drops summed over all shards (from SO_RXQ_OVFL)
+std::atomic<uint64_t> rx_kernel_drops{0};
+
+static Counter& announcements_total = metrics().counter("gopherd_announcements_total", "Announcements accepted");
+static Counter& goodbyes_total = metrics().counter("gopherd_goodbyes_total", "Goodbye announcements");
+static Counter& parse_errors_total = metrics().counter("gopherd_announce_parse_errors_total",
+                                                       "Datagrams on the discovery port that did not parse");
+static Counter& kernel_drops_total = metrics().counter("gopherd_kernel_drops_total",
+                                                       "Announcements dropped by the kernel (SO_RXQ_OVFL)");
+static Gauge& registry_size = metrics().gauge("gopherd_registry_size", "Live peers in the registry");
+static Counter& queries_total = metrics().counter("gopherd_queries_total", "Peer list queries served");
+static Histogram& query_time = metrics().histogram("gopherd_query_seconds", "Time to serve one peer list query");
+static Counter& registrations_total = metrics().counter("gopherd_rendezvous_registrations_total",
+                                                        "Registrations on the rendezvous socket");
+static Counter& registrations_refused_total = metrics().counter("gopherd_rendezvous_registrations_refused_total",
+                                                                "Registrations for a key or peer held from another address");
+static Counter& relay_requests_total = metrics().counter("gopherd_relay_requests_total",
+                                                         "Relay routes opened");
+static Counter& relay_refused_total = metrics().counter("gopherd_relay_refused_total",
+                                                        "Relay requests for unknown peers or from unregistered clients");
+static Counter& relayed_datagrams_total = metrics().counter("gopherd_relayed_datagrams_total",
+                                                            "Media datagrams forwarded between relayed peers");
+static Counter& relayed_bytes_total = metrics().counter("gopherd_relayed_bytes_total", "Bytes of relayed media");
+static Counter& relay_unrouted_total = metrics().counter("gopherd_relay_unrouted_total",
+                                                         "Media datagrams from clients without a relay route");
+
+// Drop peers whose announced ttl ran out. Caller holds gopher_mutex.
+void expire_gophers(std::chrono::steady_clock::time_point now) {
+    gophers.erase(std::remove_if(gophers.begin(), gophers.end(),
+        [&](const Gopher& g) { return g.expires <= now; }), gophers.end());
+    registry_size.set(gophers.size());
+}
+
+// Apply a burst of announcements under a single acquisition of gopher_mutex
+void apply_announcements(const std::vector<Announcement>& batch) {
+    if (batch.empty()) return;
+
+    auto now = std::chrono::steady_clock::now();
+    std::lock_guard<std::mutex> lock(gopher_mutex);
+    for (const auto& a : batch) {
+        // Remove duplicates and add new gopher; what rendezvous learned about it survives
+        std::string candidates;
+        sockaddr_in reflexive{};
+        in_addr contacted{};
+        gophers.erase(std::remove_if(gophers.begin(), gophers.end(),
+            [&](const Gopher& g) {
+                if (g.name != a.name || g.ip != a.ip || g.port != a.port) return false;
+                candidates = g.candidates;
+                reflexive = g.reflexive;
+                contacted = g.contacted;
+                return true;
+            }), gophers.end());
+
+        if (a.goodbye) {
+            goodbyes_total.inc();
+            continue;
+        }
+        announcements_total.inc();
+
+        int ttl = std::min(std::max(a.ttl, 1), 3600);
+        gophers.push_back(Gopher{a.name, a.ip, a.port, now + std::chrono::seconds(ttl), a.codecs, a.key,
+                                 candidates, reflexive, contacted});
+    }
+    expire_gophers(now);
+}
+
+static uint64_t endpoint_id(const sockaddr_in& a) {
+    return static_cast<uint64_t>(ntohl(a.sin_addr.s_addr)) << 16 | ntohs(a.sin_port);
+}
+
+// An announcement on the rendezvous socket; from is where the client's NAT maps its media socket,
+// local our address it was sent to. Registrations carry no proof of the key, so a key (or peer)
+// already registered from one reflexive address cannot be replaced or removed from another until it
+// expires; otherwise anyone could take over a peer's relay route by registering its key.
+void apply_registration(const Announcement& a, const sockaddr_in& from, in_addr local) {
+    auto now = std::chrono::steady_clock::now();
+    std::lock_guard<std::mutex> lock(gopher_mutex);
+    expire_gophers(now);
+    for (const auto& g : gophers) {
+        if (g.candidates.empty() || endpoint_id(g.reflexive) == endpoint_id(from)) continue;
+        bool same_peer = g.name == a.name && g.ip == a.ip && g.port == a.port;
+        if (same_peer || (!a.key.empty() && g.key == a.key)) {
+            registrations_refused_total.inc();
+            return;
+        }
+    }
+    gophers.erase(std::remove_if(gophers.begin(), gophers.end(),
+        [&](const Gopher& g) {
+            return g.name == a.name && g.ip == a.ip && g.port == a.port;
+        }), gophers.end());
+
+    if (a.goodbye) {
+        goodbyes_total.inc();
+    } else {
+        registrations_total.inc();
+        char ip[INET_ADDRSTRLEN];
+        inet_ntop(AF_INET, &from.sin_addr, ip, sizeof(ip));
+        std::string host = a.ip + ":" + std::to_string(a.port);
+        std::string reflexive = std::string(ip) + ":" + std::to_string(ntohs(from.sin_port));
+        int ttl = std::min(std::max(a.ttl, 1), 3600);
+        gophers.push_back(Gopher{a.name, a.ip, a.port, now + std::chrono::seconds(ttl), a.codecs, a.key,
+                                 reflexive == host ? host : host + "+" + reflexive, from, local});
+    }
+    expire_gophers(now);
+}
+
+int open_rendezvous_socket(uint16_t port) {
+    int sock = socket(AF_INET, SOCK_DGRAM, 0);
+    if (sock < 0) return -1;
+
+    struct timeval timeout;
+    timeout.tv_sec = 1;
+    timeout.tv_usec = 0;
+    setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    // Relayed calls put whole video frames through here
+    int bufsize = 4 << 20;
+    setsockopt(sock, SOL_SOCKET, SO_RCVBUF, &bufsize, sizeof(bufsize));
+    setsockopt(sock, SOL_SOCKET, SO_SNDBUF, &bufsize, sizeof(bufsize));
+    // Relayed media must leave from the address each peer registered with
+    int pktinfo = 1;
+    setsockopt(sock, IPPROTO_IP, IP_PKTINFO, &pktinfo, sizeof(pktinfo));
+
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = INADDR_ANY;
+    if (bind(sock, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+        close(sock);
+        return -1;
+    }
+    return sock;
+}
+
+/*
+  Rendezvous socket (discovery.hpp): registrations, relay requests and the
+  media of relayed calls, told apart by the first byte (media datagrams
+  start with MEDIA_VERSION, everything else is text). A relay route
+  forwards one direction only, from the requester's reflexive address to
+  its peer's, and lapses unless renewed. On a multihomed host each
+  datagram leaves from the address its destination registered with, since
+  that is the only one the destination's NAT expects. A registration
+  cannot displace a live one for the same key or peer from another
+  address (apply_registration). Only this thread touches routes.
+*/
+void rendezvous_server(int sock) {
+    apply_thread_policy(ThreadRole::BACKGROUND, "rendezvous");
+    struct RelayRoute {
+        sockaddr_in dest;
+        in_addr source;
+        std::chrono::steady_clock::time_point expires;
+    };
+    std::unordered_map<uint64_t, RelayRoute> routes;
+    const auto route_lifetime = std::chrono::seconds(3 * RENDEZVOUS_INTERVAL_S);
+    auto last_prune = std::chrono::steady_clock::now();
+    char buffer[2048];
+    char control[CMSG_SPACE(sizeof(in_pktinfo))];
+
+    while (running) {
+        sockaddr_in from{};
+        iovec iov{buffer, sizeof(buffer)};
+        msghdr msg{};
+        msg.msg_name = &from;
+        msg.msg_namelen = sizeof(from);
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+        int n = recvmsg(sock, &msg, 0);
+        if (n < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) continue;
+            break;
+        }
+        if (n == 0 || from.sin_family != AF_INET) continue;
+        auto now = std::chrono::steady_clock::now();
+
+        if (static_cast<uint8_t>(buffer[0]) == MEDIA_VERSION) {
+            auto it = routes.find(endpoint_id(from));
+            if (it == routes.end() || it->second.expires <= now) {
+                relay_unrouted_total.inc();
+                continue;
+            }
+            // Same buffers, now outbound: the payload as received, our source address in IP_PKTINFO
+            iov.iov_len = n;
+            msg.msg_name = &it->second.dest;
+            msg.msg_namelen = sizeof(it->second.dest);
+            msg.msg_controllen = sizeof(control);
+            cmsghdr* cm = CMSG_FIRSTHDR(&msg);
+            cm->cmsg_level = IPPROTO_IP;
+            cm->cmsg_type = IP_PKTINFO;
+            cm->cmsg_len = CMSG_LEN(sizeof(in_pktinfo));
+            in_pktinfo info{};
+            info.ipi_spec_dst = it->second.source;
+            memcpy(CMSG_DATA(cm), &info, sizeof(info));
+            sendmsg(sock, &msg, 0);
+            relayed_datagrams_total.inc();
+            relayed_bytes_total.inc(n);
+            continue;
+        }
+
+        std::string key, peer_key;
+        Announcement a;
+        if (parse_relay_request(buffer, n, key, peer_key)) {
+            // Only from the address the requester registered, and only towards a registered peer
+            bool requester_known = false;
+            bool peer_known = false;
+            sockaddr_in dest{};
+            in_addr source{};
+            {
+                std::lock_guard<std::mutex> lock(gopher_mutex);
+                for (const auto& g : gophers) {
+                    if (g.candidates.empty()) continue;
+                    if (g.key == key && endpoint_id(g.reflexive) == endpoint_id(from)) requester_known = true;
+                    if (g.key == peer_key) {
+                        dest = g.reflexive;
+                        source = g.contacted;
+                        peer_known = true;
+                    }
+                }
+            }
+            if (requester_known && peer_known) {
+                auto& route = routes[endpoint_id(from)];
+                if (route.expires <= now) relay_requests_total.inc();
+                route = RelayRoute{dest, source, now + route_lifetime};
+            } else {
+                relay_refused_total.inc();
+            }
+        } else if (parse_announcement(buffer, n, a)) {
+            in_addr local{};
+            for (cmsghdr* c = CMSG_FIRSTHDR(&msg); c; c = CMSG_NXTHDR(&msg, c)) {
+                if (c->cmsg_level == IPPROTO_IP && c->cmsg_type == IP_PKTINFO) {
+                    in_pktinfo info;
+                    memcpy(&info, CMSG_DATA(c), sizeof(info));
+                    local = info.ipi_addr;
+                }
+            }
+            apply_registration(a, from, local);
+        } else {
+            parse_errors_total.inc();
+        }
+
+        if (now - last_prune > route_lifetime) {
+            last_prune = now;
+            for (auto it = routes.begin(); it != routes.end();) {
+                it = it->second.expires <= now ? routes.erase(it) : std::next(it);
+            }
+        }
+    }
+    close(sock);
+}
+
+int open_announce_socket(bool reuse_port) {
+    int sock = socket(AF_INET, SOCK_DGRAM, 0);
+    if (sock < 0) return -1;
+
+    // Set socket timeout to allow checking running flag
+    struct timeval timeout;
+    timeout.tv_sec = 1;
+    timeout.tv_usec = 0;
+    setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+    int reuse = 1;
+    setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+#ifdef SO_REUSEPORT
+    if (reuse_port && setsockopt(sock, SOL_SOCKET, SO_REUSEPORT, &reuse, sizeof(reuse)) < 0) {
+        std::cerr << "[gopherd] SO_REUSEPORT unavailable: " << strerror(errno) << "\n";
+    }
+#endif
+    // Headroom for announcement storms (kernel clamps to net.core.rmem_max)
+    int rcvbuf = 1 << 20;
+    setsockopt(sock, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+#ifdef IP_PKTINFO
+    // Needed to tell unicast from broadcast/multicast when sharding
+    int pktinfo = 1;
+    setsockopt(sock, IPPROTO_IP, IP_PKTINFO, &pktinfo, sizeof(pktinfo));
+#endif
+#ifdef SO_RXQ_OVFL
+    // Ask the kernel to attach its running drop counter to each datagram
+    int ovfl = 1;
+    setsockopt(sock, SOL_SOCKET, SO_RXQ_OVFL, &ovfl, sizeof(ovfl));
+#endif
+
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(BROADCAST_PORT);
+    addr.sin_addr.s_addr = INADDR_ANY;
+
+    if (bind(sock, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+        close(sock);
+        return -1;
+    }
+
+    ip_mreq mreq{};
+    inet_pton(AF_INET, MCAST_GROUP_V4, &mreq.imr_multiaddr);
+    mreq.imr_interface.s_addr = INADDR_ANY;
+    if (setsockopt(sock, IPPROTO_IP, IP_ADD_MEMBERSHIP, &mreq, sizeof(mreq)) < 0) {
+        std::cerr << "[gopherd] Failed to join " << MCAST_GROUP_V4 << ": " << strerror(errno) << "\n";
+    }
+    return sock;
+}
+
+int open_announce_socket_v6() {
+    int sock = socket(AF_INET6, SOCK_DGRAM, 0);
+    if (sock < 0) return -1;
+
+    struct timeval timeout;
+    timeout.tv_sec = 1;
+    timeout.tv_usec = 0;
+    setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+    int on = 1;
+    setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    setsockopt(sock, IPPROTO_IPV6, IPV6_V6ONLY, &on, sizeof(on));
+
+    sockaddr_in6 addr{};
+    addr.sin6_family = AF_INET6;
+    addr.sin6_port = htons(BROADCAST_PORT);
+    addr.sin6_addr = in6addr_any;
+
+    if (bind(sock, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+        close(sock);
+        return -1;
+    }
+
+    ipv6_mreq mreq{};
+    inet_pton(AF_INET6, MCAST_GROUP_V6, &mreq.ipv6mr_multiaddr);
+    mreq.ipv6mr_interface = 0; // default interface
+    if (setsockopt(sock, IPPROTO_IPV6, IPV6_JOIN_GROUP, &mreq, sizeof(mreq)) < 0) {
+        close(sock);
+        return -1;
+    }
+    return sock;
+}
+
+/*
+  One receiver shard. With shard_count > 1 every shard binds its own
+  SO_REUSEPORT socket; the kernel hashes unicast announcements across them,
+  but broadcast/multicast copies land on every socket, so for those each
+  shard only keeps senders that hash to it and the registry sees each
+  datagram once.
+*/
+void udp_receiver(int sock, int shard, int shard_count) {
+    apply_thread_policy(ThreadRole::BACKGROUND, ("rx-shard-" + std::to_string(shard)).c_str());
+    std::vector<Announcement> batch;
+    batch.reserve(RECV_BATCH);
+    uint32_t last_ovfl = 0;
+    auto last_drop_report = std::chrono::steady_clock::now();
+
+#ifdef __linux__
+    auto owns_sender = [&](const sockaddr_storage& from) {
+        if (shard_count <= 1 || from.ss_family != AF_INET) return true;
+        const sockaddr_in& sender = reinterpret_cast<const sockaddr_in&>(from);
+        uint32_t h = ntohl(sender.sin_addr.s_addr) * 2654435761u ^ ntohs(sender.sin_port);
+        return static_cast<int>(h % shard_count) == shard;
+    };
+#endif
+
+    auto note_overflow = [&](uint32_t ovfl) {
+        // The counter is cumulative per socket and wraps at 2^32
+        if (ovfl == last_ovfl) return;
+        uint32_t delta = ovfl - last_ovfl;
+        last_ovfl = ovfl;
+        uint64_t total = rx_kernel_drops.fetch_add(delta, std::memory_order_relaxed) + delta;
+        kernel_drops_total.inc(delta);
+
+        auto now = std::chrono::steady_clock::now();
+        if (now - last_drop_report >= std::chrono::seconds(5)) {
+            last_drop_report = now;
+            std::cerr << "[gopherd] shard " << shard << ": kernel dropped " << delta
+                      << " announcements (" << total << " total)\n";
+        }
+    };
+
+#ifdef __linux__
+    // Batched path: one syscall drains up to RECV_BATCH queued announcements
+    static thread_local char buffers[RECV_BATCH][ANNOUNCE_BUF_SIZE];
+    static thread_local char controls[RECV_BATCH][CMSG_SPACE(sizeof(uint32_t)) +
+                                                  CMSG_SPACE(sizeof(in_pktinfo))];
+    sockaddr_storage senders[RECV_BATCH];
+    iovec iovs[RECV_BATCH];
+    mmsghdr msgs[RECV_BATCH];
+
+    while (running) {
+        for (int i = 0; i < RECV_BATCH; i++) {
+            iovs[i].iov_base = buffers[i];
+            iovs[i].iov_len = ANNOUNCE_BUF_SIZE;
+            msgs[i] = mmsghdr{};
+            msgs[i].msg_hdr.msg_name = &senders[i];
+            msgs[i].msg_hdr.msg_namelen = sizeof(senders[i]);
+            msgs[i].msg_hdr.msg_iov = &iovs[i];
+            msgs[i].msg_hdr.msg_iovlen = 1;
+            msgs[i].msg_hdr.msg_control = controls[i];
+            msgs[i].msg_hdr.msg_controllen = sizeof(controls[i]);
+        }
+
+        // MSG_WAITFORONE: block (up to SO_RCVTIMEO) for the first, then take what is queued
+        int n = recvmmsg(sock, msgs, RECV_BATCH, MSG_WAITFORONE, nullptr);
+        if (n < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) {
+                continue; // Timeout, check running flag
+            }
+            break;
+        }
+
+        batch.clear();
+        for (int i = 0; i < n; i++) {
+            msghdr& hdr = msgs[i].msg_hdr;
+            bool unicast = true;
+            for (cmsghdr* c = CMSG_FIRSTHDR(&hdr); c; c = CMSG_NXTHDR(&hdr, c)) {
+                if (c->cmsg_level == SOL_SOCKET && c->cmsg_type == SO_RXQ_OVFL) {
+                    uint32_t ovfl;
+                    memcpy(&ovfl, CMSG_DATA(c), sizeof(ovfl));
+                    note_overflow(ovfl);
+                } else if (c->cmsg_level == IPPROTO_IP && c->cmsg_type == IP_PKTINFO) {
+                    // Header destination differs from the local address for broadcast/multicast
+                    in_pktinfo info;
+                    memcpy(&info, CMSG_DATA(c), sizeof(info));
+                    unicast = info.ipi_addr.s_addr == info.ipi_spec_dst.s_addr;
+                }
+            }
+
+            if (!unicast && !owns_sender(senders[i])) continue;
+
+            Announcement a;
+            if (parse_announcement(buffers[i], msgs[i].msg_len, a)) {
+                batch.push_back(std::move(a));
+            } else {
+                parse_errors_total.inc();
+            }
+        }
+        apply_announcements(batch);
+    }
+#else
+    char buffer[ANNOUNCE_BUF_SIZE];
+    sockaddr_storage sender;
+
+    while (running) {
+        socklen_t sender_len = sizeof(sender);
+        int n = recvfrom(sock, buffer, sizeof(buffer), 0,
+                         (struct sockaddr*)&sender, &sender_len);
+        if (n < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                continue; // Timeout, check running flag
+            }
+            break;
+        }
+        batch.clear();
+        Announcement a;
+        if (parse_announcement(buffer, n, a)) {
+            batch.push_back(std::move(a));
+        } else {
+            parse_errors_total.inc();
+        }
+        apply_announcements(batch);
+    }
+#endif
+
+    close(sock);
+}
+
+static void usage() {
+    std::cerr << "usage: gopherd [--rendezvous] [--rendezvous-port N] [--rx-shards N] [--metrics-port N]\n"
+                 "               [--thread-stats] [PARENT_PID]\n";
+}
+
+// Whole-string decimal in [min, max]; false on anything else
+static bool parse_int_arg(const char* text, long min, long max, int& out) {
+    errno = 0;
+    char* end = nullptr;
+    long value = strtol(text, &end, 10);
+    if (errno != 0 || end == text || *end != '\0' || value < min || value > max) return false;
+    out = static_cast<int>(value);
+    return true;
+}
+
 int main(int argc, char* argv[]) {
     signal(SIGTERM, signal_handler);
     signal(SIGINT, signal_handler);
     
     pid_t parent_pid = -1;
-    if (argc > 1) {
-        parent_pid = static_cast<pid_t>(std::stoi(argv[1]));
+    int rx_shards = 1;
+    int metrics_port = METRICS_PORT;
+    int rendezvous_port = 0; // --rendezvous: also introduce and relay clients on other segments
+    bool show_thread_stats = false; // --thread-stats: per-thread CPU time and context switches at exit
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        bool ok = true;
+        if (arg == "--rendezvous") {
+            rendezvous_port = RENDEZVOUS_PORT;
+        } else if (arg == "--rendezvous-port" && i + 1 < argc) {
+            ok = parse_int_arg(argv[++i], 1, 65535, rendezvous_port);
+        } else if (arg == "--rx-shards" && i + 1 < argc) {
+            ok = parse_int_arg(argv[++i], 1, 64, rx_shards);
+        } else if (arg == "--metrics-port" && i + 1 < argc) {
+            ok = parse_int_arg(argv[++i], 0, 65535, metrics_port);
+        } else if (arg == "--thread-stats") {
+            show_thread_stats = true;
+        } else if (!arg.empty() && arg[0] != '-') {
+            int pid = 0;
+            ok = parse_int_arg(arg.c_str(), 1, INT_MAX, pid);
+            parent_pid = static_cast<pid_t>(pid);
+        } else {
+            ok = false;
+        }
+        if (!ok) {
+            std::cerr << "[gopherd] Invalid argument " << arg;
+            if (arg != argv[i]) std::cerr << " " << argv[i]; // the flag's value
+            std::cerr << "\n";
+            usage();
+            return 2;
+        }
     }
+#ifndef __linux__
+    rx_shards = 1; // sharding relies on recvmmsg/IP_PKTINFO
+#endif
     
     // Parent monitoring thread with proper error handling
     std::thread monitor_thread([parent_pid]() {
+        apply_thread_policy(ThreadRole::BACKGROUND, "monitor");
         while (running) {
 #ifdef _WIN32
             if (parent_pid > 0) {
@@ -182,86 +712,9 @@ int main(int argc, char* argv[]) {
         }
     });
     
-    // Modified UDP listener with running flag
-    auto udp_listener_safe = []() {
-#ifdef _WIN32
-        WSADATA wsaData;
-        WSAStartup(MAKEWORD(2, 2), &wsaData);
-#endif
-        int sock = socket(AF_INET, SOCK_DGRAM, 0);
-        if (sock < 0) return;
-        
-        // Set socket timeout to allow checking running flag
-        struct timeval timeout;
-        timeout.tv_sec = 1;
-        timeout.tv_usec = 0;
-        setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
-        
-        int reuse = 1;
-        setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
-        
-        sockaddr_in addr{};
-        addr.sin_family = AF_INET;
-        addr.sin_port = htons(BROADCAST_PORT);
-        addr.sin_addr.s_addr = INADDR_ANY;
-        
-        if (bind(sock, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
-            close(sock);
-            return;
-        }
-        
-        char buffer[1024];
-        sockaddr_in sender;
-        socklen_t sender_len = sizeof(sender);
-        
-        while (running) {
-            int n = recvfrom(sock, buffer, sizeof(buffer) - 1, 0, 
-                           (struct sockaddr*)&sender, &sender_len);
-            if (n < 0) {
-                if (errno == EAGAIN || errno == EWOULDBLOCK) {
-                    continue; // Timeout, check running flag
-                }
-                break;
-            }
-            
-            buffer[n] = '\0';
-            
-            // Parse message safely
-            std::string msg(buffer);
-            size_t name_pos = msg.find("name:");
-            size_t ip_pos = msg.find(";ip:");
-            size_t port_pos = msg.find(";port:");
-            
-            if (name_pos == std::string::npos || ip_pos == std::string::npos || 
-                port_pos == std::string::npos) continue;
-            
-            std::string name = msg.substr(name_pos + 5, ip_pos - (name_pos + 5));
-            std::string ip = msg.substr(ip_pos + 4, port_pos - (ip_pos + 4));
-            
-            try {
-                uint16_t port = static_cast<uint16_t>(std::stoi(msg.substr(port_pos + 6)));
-                
-                std::lock_guard<std::mutex> lock(gopher_mutex);
-                
-                // Remove duplicates and add new gopher
-                gophers.erase(std::remove_if(gophers.begin(), gophers.end(),
-                    [&](const Gopher& g) {
-                        return g.name == name && g.ip == ip && g.port == port;
-                    }), gophers.end());
-                
-                gophers.push_back(Gopher{name, ip, port});
-                
-            } catch (const std::exception& e) {
-                // Invalid port number, skip
-                continue;
-            }
-        }
-        
-        close(sock);
-    };
-    
     // Modified TCP server with running flag  
     auto tcp_server_safe = []() {
+        apply_thread_policy(ThreadRole::BACKGROUND, "tcp-query");
         int sock = socket(AF_INET, SOCK_STREAM, 0);
         if (sock < 0) return;
         
@@ -298,30 +751,79 @@ int main(int argc, char* argv[]) {
                 break;
             }
             
-            std::lock_guard<std::mutex> lock(gopher_mutex);
+            auto accepted = std::chrono::steady_clock::now();
             std::string response;
-            
-            for (const auto& g : gophers) {
-                response += g.name + "," + g.ip + "," + std::to_string(g.port) + "\n";
+            {
+                std::lock_guard<std::mutex> lock(gopher_mutex);
+                expire_gophers(accepted);
+                for (const auto& g : gophers) {
+                    response += g.name + "," + g.ip + "," + std::to_string(g.port) + "," + g.codecs + "," +
+                                g.key;
+                    if (!g.candidates.empty()) response += "," + g.candidates;
+                    response += "\n";
+                }
             }
             
             send(conn, response.c_str(), response.length(), 0);
             close(conn);
+            queries_total.inc();
+            query_time.observe(std::chrono::duration_cast<std::chrono::microseconds>(
+                std::chrono::steady_clock::now() - accepted).count());
         }
         
         close(sock);
     };
     
-    std::thread udp_thread(udp_listener_safe);
+#ifdef _WIN32
+    WSADATA wsaData;
+    WSAStartup(MAKEWORD(2, 2), &wsaData);
+#endif
+    // Sockets are bound up front so every shard joins the SO_REUSEPORT group
+    std::vector<std::thread> udp_threads;
+    for (int shard = 0; shard < rx_shards; shard++) {
+        int sock = open_announce_socket(rx_shards > 1);
+        if (sock < 0) {
+            std::cerr << "[gopherd] Failed to bind announcement socket (shard " << shard << ")\n";
+            break;
+        }
+        udp_threads.emplace_back(udp_receiver, sock, shard, rx_shards);
+    }
+    int sock6 = open_announce_socket_v6();
+    if (sock6 >= 0) {
+        udp_threads.emplace_back(udp_receiver, sock6, 0, 1);
+    } else {
+        std::cerr << "[gopherd] IPv6 discovery unavailable\n";
+    }
     std::thread tcp_thread(tcp_server_safe);
+    std::thread rendezvous_thread;
+    if (rendezvous_port > 0) {
+        int sock = open_rendezvous_socket(rendezvous_port);
+        if (sock >= 0) {
+            std::cerr << "[gopherd] Rendezvous on UDP port " << rendezvous_port << "\n";
+            rendezvous_thread = std::thread(rendezvous_server, sock);
+        } else {
+            std::cerr << "[gopherd] Failed to bind rendezvous port " << rendezvous_port << "\n";
+        }
+    }
+    MetricsServer metrics_server;
+    if (metrics_port > 0) metrics_server.start(metrics_port);
     
     // Wait for shutdown signal
     monitor_thread.join();
     
     // Clean shutdown
     running = 0;
-    if (udp_thread.joinable()) udp_thread.join();
+    for (auto& t : udp_threads) {
+        if (t.joinable()) t.join();
+    }
     if (tcp_thread.joinable()) tcp_thread.join();
+    if (rendezvous_thread.joinable()) rendezvous_thread.join();
+    metrics_server.stop();
     
+    if (rx_kernel_drops.load() > 0) {
+        std::cerr << "[gopherd] Kernel dropped " << rx_kernel_drops.load()
+                  << " announcements during this run\n";
+    }
+    if (show_thread_stats) print_thread_stats(std::cerr);
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,308 @@
+#include "media_crypto.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <openssl/evp.h>
+#include <openssl/kdf.h>
+
+#if defined(__aarch64__) && defined(__linux__)
+#include <sys/auxv.h>
+#include <asm/hwcap.h>
+#endif
+
+constexpr size_t NONCE_SIZE = 12;
+constexpr const char* KEY_INFO = "gopher media v1";
+
+MediaCipher preferred_media_cipher() {
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+    return __builtin_cpu_supports("aes") && __builtin_cpu_supports("pclmul") ? MediaCipher::AES_256_GCM
+                                                                             : MediaCipher::CHACHA20_POLY1305;
+#elif defined(__aarch64__) && defined(__APPLE__)
+    return MediaCipher::AES_256_GCM; // every Apple silicon core has the crypto extensions
+#elif defined(__aarch64__) && defined(__linux__)
+    unsigned long caps = getauxval(AT_HWCAP);
+    return (caps & HWCAP_AES) && (caps & HWCAP_PMULL) ? MediaCipher::AES_256_GCM
+                                                      : MediaCipher::CHACHA20_POLY1305;
+#else
+    return MediaCipher::CHACHA20_POLY1305;
+#endif
+}
+
+const char* media_cipher_name(MediaCipher cipher) {
+    return cipher == MediaCipher::AES_256_GCM ? "aes-256-gcm" : "chacha20-poly1305";
+}
+
+static const EVP_CIPHER* evp_cipher(MediaCipher cipher) {
+    return cipher == MediaCipher::AES_256_GCM ? EVP_aes_256_gcm() : EVP_chacha20_poly1305();
+}
+
+bool MediaKeyPair::generate(MediaKeyPair& out) {
+    EVP_PKEY* key = nullptr;
+    EVP_PKEY_CTX* ctx = EVP_PKEY_CTX_new_id(EVP_PKEY_X25519, nullptr);
+    bool ok = ctx && EVP_PKEY_keygen_init(ctx) > 0 && EVP_PKEY_keygen(ctx, &key) > 0;
+    size_t priv_len = MEDIA_KEY_SIZE, pub_len = MEDIA_KEY_SIZE;
+    ok = ok && EVP_PKEY_get_raw_private_key(key, out.private_key.data(), &priv_len) > 0 &&
+         EVP_PKEY_get_raw_public_key(key, out.public_key.data(), &pub_len) > 0;
+    EVP_PKEY_free(key);
+    EVP_PKEY_CTX_free(ctx);
+    return ok;
+}
+
+std::string MediaKeyPair::publicHex() const {
+    std::string hex;
+    char byte[3];
+    for (uint8_t b : public_key) {
+        snprintf(byte, sizeof(byte), "%02x", b);
+        hex += byte;
+    }
+    return hex;
+}
+
+bool parse_media_key(const std::string& hex, std::array<uint8_t, MEDIA_KEY_SIZE>& out) {
+    if (hex.size() != 2 * MEDIA_KEY_SIZE) return false;
+    for (size_t i = 0; i < MEDIA_KEY_SIZE; i++) {
+        unsigned v;
+        if (sscanf(hex.c_str() + 2 * i, "%2x", &v) != 1) return false;
+        out[i] = static_cast<uint8_t>(v);
+    }
+    return true;
+}
+
+// X25519(priv, pub) appended to out
+static bool x25519(const std::array<uint8_t, MEDIA_KEY_SIZE>& priv, const std::array<uint8_t, MEDIA_KEY_SIZE>& pub,
+                   uint8_t* out) {
+    EVP_PKEY* ours = EVP_PKEY_new_raw_private_key(EVP_PKEY_X25519, nullptr, priv.data(), priv.size());
+    EVP_PKEY* theirs = EVP_PKEY_new_raw_public_key(EVP_PKEY_X25519, nullptr, pub.data(), pub.size());
+    EVP_PKEY_CTX* ctx = ours ? EVP_PKEY_CTX_new(ours, nullptr) : nullptr;
+    size_t len = MEDIA_KEY_SIZE;
+    // Fails on low-order public keys (all-zero shared secret)
+    bool ok = ctx && theirs && EVP_PKEY_derive_init(ctx) > 0 && EVP_PKEY_derive_set_peer(ctx, theirs) > 0 &&
+              EVP_PKEY_derive(ctx, out, &len) > 0 && len == MEDIA_KEY_SIZE;
+    EVP_PKEY_CTX_free(ctx);
+    EVP_PKEY_free(theirs);
+    EVP_PKEY_free(ours);
+    return ok;
+}
+
+static bool hkdf_sha256(const uint8_t* ikm, size_t ikm_len, const uint8_t* salt, size_t salt_len,
+                        const uint8_t* info, size_t info_len, uint8_t* out, size_t out_len) {
+    EVP_PKEY_CTX* ctx = EVP_PKEY_CTX_new_id(EVP_PKEY_HKDF, nullptr);
+    bool ok = ctx && EVP_PKEY_derive_init(ctx) > 0 && EVP_PKEY_CTX_set_hkdf_md(ctx, EVP_sha256()) > 0 &&
+              EVP_PKEY_CTX_set1_hkdf_salt(ctx, salt, salt_len) > 0 &&
+              EVP_PKEY_CTX_set1_hkdf_key(ctx, ikm, ikm_len) > 0 &&
+              EVP_PKEY_CTX_add1_hkdf_info(ctx, info, info_len) > 0 && EVP_PKEY_derive(ctx, out, &out_len) > 0;
+    EVP_PKEY_CTX_free(ctx);
+    return ok;
+}
+
+// Key schedule set once; each datagram then only changes the nonce
+static EVP_CIPHER_CTX* new_aead(MediaCipher cipher, const uint8_t* key, bool encrypt) {
+    EVP_CIPHER_CTX* ctx = EVP_CIPHER_CTX_new();
+    if (ctx && EVP_CipherInit_ex(ctx, evp_cipher(cipher), nullptr, key, nullptr, encrypt ? 1 : 0) > 0) return ctx;
+    EVP_CIPHER_CTX_free(ctx);
+    return nullptr;
+}
+
+// Low nibble of the type byte, as media_type_kind() reads it
+static uint8_t header_kind(uint8_t type) { return type & 0x0f; }
+
+// kind | 0 0 0 | seq | frag_offset, straight from the big-endian header
+static void datagram_nonce(const uint8_t* header, uint8_t* nonce) {
+    nonce[0] = header_kind(header[1]);
+    nonce[1] = nonce[2] = nonce[3] = 0;
+    memcpy(nonce + 4, header + 4, 4);
+    memcpy(nonce + 8, header + 20, 4);
+}
+
+static int kind_index(uint8_t kind) {
+    return kind == MEDIA_KIND_VIDEO ? 0 : kind == MEDIA_KIND_AUDIO ? 1 : kind == MEDIA_KIND_CONTROL ? 2 : -1;
+}
+
+bool MediaCrypto::initialize(const MediaKeyPair& id, const std::array<uint8_t, MEDIA_KEY_SIZE>& peer_id,
+                             MediaCipher cipher) {
+    identity = id;
+    peer_identity = peer_id;
+    tx_cipher = cipher;
+    if (!MediaKeyPair::generate(ephemeral)) {
+        std::cerr << "Failed to generate a call key" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+size_t MediaCrypto::writeKeyPacket(uint8_t* out) const {
+    MediaHeader hdr;
+    hdr.type = MEDIA_KIND_CONTROL;
+    hdr.frame_size = KEY_PACKET_SIZE - MEDIA_HEADER_SIZE;
+    write_media_header(out, hdr);
+    uint8_t* payload = out + MEDIA_HEADER_SIZE;
+    payload[0] = CONTROL_KEY;
+    payload[1] = static_cast<uint8_t>(tx_cipher);
+    payload[2] = (ready() ? KEY_FLAG_HAVE_PEER : 0) | (peerReady() ? 0 : KEY_FLAG_NEED_ACK);
+    memcpy(payload + 3, ephemeral.public_key.data(), MEDIA_KEY_SIZE);
+    return KEY_PACKET_SIZE;
+}
+
+bool MediaCrypto::handleKeyPacket(const uint8_t* datagram, size_t len) {
+    if (len < KEY_PACKET_SIZE || datagram[MEDIA_HEADER_SIZE] != CONTROL_KEY) return false;
+    const uint8_t* payload = datagram + MEDIA_HEADER_SIZE;
+    MediaCipher rx_cipher = static_cast<MediaCipher>(payload[1]);
+    if (rx_cipher != MediaCipher::AES_256_GCM && rx_cipher != MediaCipher::CHACHA20_POLY1305) return false;
+
+    if (!ready()) {
+        memcpy(peer_ephemeral.data(), payload + 3, MEDIA_KEY_SIZE);
+        if (!deriveKeys(rx_cipher)) return false;
+    } else if (memcmp(peer_ephemeral.data(), payload + 3, MEDIA_KEY_SIZE) != 0) {
+        return false; // one key per call
+    }
+    if (payload[2] & KEY_FLAG_HAVE_PEER) peer_has_key.store(true, std::memory_order_release);
+    if (payload[2] & KEY_FLAG_NEED_ACK) reply_due.store(true, std::memory_order_release);
+    return true;
+}
+
+bool MediaCrypto::keyPacketDue(int64_t now_us) {
+    int64_t last = last_key_us.load(std::memory_order_relaxed);
+    bool due = reply_due.load(std::memory_order_acquire) || (!peerReady() && now_us - last >= KEY_RESEND_US);
+    // One of the sending threads wins
+    if (!due || !last_key_us.compare_exchange_strong(last, now_us)) return false;
+    reply_due.store(false, std::memory_order_relaxed);
+    return true;
+}
+
+bool MediaCrypto::deriveKeys(MediaCipher rx_cipher) {
+    uint8_t ikm[2 * MEDIA_KEY_SIZE];
+    if (!x25519(ephemeral.private_key, peer_ephemeral, ikm) ||
+        !x25519(identity.private_key, peer_identity, ikm + MEDIA_KEY_SIZE)) {
+        std::cerr << "Rejecting the peer's call key" << std::endl;
+        return false;
+    }
+
+    // Both ends build the same salt: the two ephemeral keys in byte order
+    uint8_t salt[2 * MEDIA_KEY_SIZE];
+    bool ours_first = ephemeral.public_key < peer_ephemeral;
+    memcpy(salt, ours_first ? ephemeral.public_key.data() : peer_ephemeral.data(), MEDIA_KEY_SIZE);
+    memcpy(salt + MEDIA_KEY_SIZE, ours_first ? peer_ephemeral.data() : ephemeral.public_key.data(), MEDIA_KEY_SIZE);
+
+    // Per direction: the info names the sending side's ephemeral key
+    const size_t label = strlen(KEY_INFO);
+    uint8_t info[64];
+    uint8_t tx_key[MEDIA_KEY_SIZE], rx_key[MEDIA_KEY_SIZE];
+    memcpy(info, KEY_INFO, label);
+    memcpy(info + label, ephemeral.public_key.data(), MEDIA_KEY_SIZE);
+    bool ok = hkdf_sha256(ikm, sizeof(ikm), salt, sizeof(salt), info, label + MEDIA_KEY_SIZE, tx_key, sizeof(tx_key));
+    memcpy(info + label, peer_ephemeral.data(), MEDIA_KEY_SIZE);
+    ok = ok && hkdf_sha256(ikm, sizeof(ikm), salt, sizeof(salt), info, label + MEDIA_KEY_SIZE, rx_key, sizeof(rx_key));
+
+    for (int i = 0; ok && i < KIND_COUNT; i++) {
+        std::lock_guard<std::mutex> lock(tx[i].mutex);
+        tx[i].ctx = new_aead(tx_cipher, tx_key, true);
+        rx[i] = new_aead(rx_cipher, rx_key, false);
+        ok = tx[i].ctx && rx[i];
+    }
+    OPENSSL_cleanse(ikm, sizeof(ikm));
+    OPENSSL_cleanse(tx_key, sizeof(tx_key));
+    OPENSSL_cleanse(rx_key, sizeof(rx_key));
+    if (!ok) {
+        std::cerr << "Failed to set up media encryption" << std::endl;
+        return false;
+    }
+    keys_ready.store(true, std::memory_order_release);
+    return true;
+}
+
+bool MediaCrypto::sealFrame(uint8_t kind, const uint8_t* payload, size_t size, uint8_t* out, size_t stride) {
+    int index = kind_index(kind);
+    if (index < 0 || !ready()) return false;
+
+    // One lock and one cipher context for the whole frame; only the nonce changes per fragment
+    std::lock_guard<std::mutex> lock(tx[index].mutex);
+    EVP_CIPHER_CTX* ctx = tx[index].ctx;
+    uint8_t nonce[NONCE_SIZE];
+    for (size_t offset = 0; offset < size; offset += MEDIA_MAX_PAYLOAD, out += stride) {
+        int chunk = static_cast<int>(std::min(MEDIA_MAX_PAYLOAD, size - offset));
+        int n = 0;
+        datagram_nonce(out, nonce);
+        if (EVP_EncryptInit_ex(ctx, nullptr, nullptr, nullptr, nonce) <= 0 ||
+            EVP_EncryptUpdate(ctx, nullptr, &n, out, MEDIA_HEADER_SIZE) <= 0 ||
+            EVP_EncryptUpdate(ctx, out + MEDIA_HEADER_SIZE, &n, payload + offset, chunk) <= 0 ||
+            EVP_EncryptFinal_ex(ctx, out + MEDIA_HEADER_SIZE + n, &n) <= 0 ||
+            EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_AEAD_GET_TAG, MEDIA_TAG_SIZE, out + MEDIA_HEADER_SIZE + chunk) <= 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool MediaCrypto::replayed(int index, uint32_t seq, uint32_t fragment) const {
+    const ReplayWindow& window = replay[index];
+    if (!window.started) return false;
+    int32_t behind = static_cast<int32_t>(window.highest - seq);
+    if (behind < 0) return false;                                      // newer than anything opened
+    if (behind >= static_cast<int32_t>(REPLAY_WINDOW)) return true;    // too old to tell: refuse
+    const ReplaySlot& slot = window.slots[seq % REPLAY_WINDOW];
+    if (!slot.used || slot.seq != seq) return false;
+    size_t word = fragment / 64;
+    return word < slot.fragments.size() && (slot.fragments[word] >> (fragment % 64) & 1);
+}
+
+// Only after authentication, so forged seqs cannot slide the window
+void MediaCrypto::markOpened(int index, uint32_t seq, uint32_t fragment) {
+    ReplayWindow& window = replay[index];
+    int32_t ahead = static_cast<int32_t>(seq - window.highest);
+    if (!window.started || ahead > 0) {
+        // Slots the window slides onto belonged to seqs that just fell out of it
+        uint32_t steps = window.started ? std::min<uint32_t>(ahead, REPLAY_WINDOW) : REPLAY_WINDOW;
+        for (uint32_t i = 0; i < steps; i++) window.slots[(seq - i) % REPLAY_WINDOW].used = false;
+        window.highest = seq;
+        window.started = true;
+    }
+    ReplaySlot& slot = window.slots[seq % REPLAY_WINDOW];
+    if (!slot.used || slot.seq != seq) {
+        slot.used = true;
+        slot.seq = seq;
+        std::fill(slot.fragments.begin(), slot.fragments.end(), 0);
+    }
+    size_t word = fragment / 64;
+    if (word >= slot.fragments.size()) slot.fragments.resize(word + 1, 0);
+    slot.fragments[word] |= uint64_t(1) << (fragment % 64);
+}
+
+bool MediaCrypto::open(const MediaHeader& header, const uint8_t* datagram, size_t len, uint8_t* out,
+                       size_t& out_len) {
+    int index = kind_index(header_kind(header.type));
+    if (index < 0 || !ready() || !(header.flags & MEDIA_FLAG_ENCRYPTED)) return false;
+    if (len < MEDIA_HEADER_SIZE + MEDIA_TAG_SIZE || len - MEDIA_HEADER_SIZE - MEDIA_TAG_SIZE > MEDIA_MAX_PAYLOAD) {
+        return false;
+    }
+    const uint32_t fragment = header.frag_offset / MEDIA_MAX_PAYLOAD;
+    if (replayed(index, header.seq, fragment)) return false;
+
+    EVP_CIPHER_CTX* ctx = rx[index];
+    int chunk = static_cast<int>(len - MEDIA_HEADER_SIZE - MEDIA_TAG_SIZE);
+    uint8_t nonce[NONCE_SIZE];
+    uint8_t tag[MEDIA_TAG_SIZE];
+    int n = 0;
+    datagram_nonce(datagram, nonce);
+    memcpy(tag, datagram + MEDIA_HEADER_SIZE + chunk, MEDIA_TAG_SIZE);
+    if (EVP_DecryptInit_ex(ctx, nullptr, nullptr, nullptr, nonce) <= 0 ||
+        EVP_DecryptUpdate(ctx, nullptr, &n, datagram, MEDIA_HEADER_SIZE) <= 0 ||
+        EVP_DecryptUpdate(ctx, out, &n, datagram + MEDIA_HEADER_SIZE, chunk) <= 0 ||
+        EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_AEAD_SET_TAG, MEDIA_TAG_SIZE, tag) <= 0 ||
+        EVP_DecryptFinal_ex(ctx, out + n, &n) <= 0) {
+        return false;
+    }
+    markOpened(index, header.seq, fragment);
+    out_len = chunk;
+    return true;
+}
+
+MediaCrypto::~MediaCrypto() {
+    for (int i = 0; i < KIND_COUNT; i++) {
+        EVP_CIPHER_CTX_free(tx[i].ctx);
+        EVP_CIPHER_CTX_free(rx[i]);
+    }
+    OPENSSL_cleanse(identity.private_key.data(), MEDIA_KEY_SIZE);
+    OPENSSL_cleanse(ephemeral.private_key.data(), MEDIA_KEY_SIZE);
+}
@@ -0,0 +1,160 @@
+#ifndef MEDIA_CRYPTO_HPP
+#define MEDIA_CRYPTO_HPP
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "media_packet.hpp"
+
+typedef struct evp_cipher_ctx_st EVP_CIPHER_CTX;
+
+constexpr size_t MEDIA_KEY_SIZE = 32; // X25519 keys and AEAD keys alike
+constexpr size_t MEDIA_TAG_SIZE = 16;
+
+enum class MediaCipher : uint8_t {
+    AES_256_GCM = 1,
+    CHACHA20_POLY1305 = 2,
+};
+
+// AES-GCM where the CPU has AES instructions (AES-NI, ARMv8 crypto), ChaCha20-Poly1305 elsewhere
+MediaCipher preferred_media_cipher();
+const char* media_cipher_name(MediaCipher cipher);
+
+// X25519 key pair
+struct MediaKeyPair {
+    std::array<uint8_t, MEDIA_KEY_SIZE> private_key{};
+    std::array<uint8_t, MEDIA_KEY_SIZE> public_key{};
+
+    static bool generate(MediaKeyPair& out);
+    std::string publicHex() const;
+};
+
+bool parse_media_key(const std::string& hex, std::array<uint8_t, MEDIA_KEY_SIZE>& out);
+
+/*
+  Per-call media encryption. Each client has an identity key pair whose
+  public half goes out with its discovery announcements. Each call also
+  makes an ephemeral pair, and the two sides swap the ephemeral public keys
+  in KEY control datagrams on the media socket:
+
+    header  type MEDIA_KIND_CONTROL, frame_size = payload length
+    0  u8   CONTROL_KEY
+    1  u8   cipher  MediaCipher this side encrypts with
+    2  u8   flags   KEY_FLAG_HAVE_PEER: the sender already has our key
+                    KEY_FLAG_NEED_ACK: it has not seen us report having its key
+    3  32B  ephemeral public key
+
+  Both sides send KEY every 200 ms until the peer reports having their key,
+  and answer each KEY flagged NEED_ACK, so a lost datagram only costs a
+  resend.
+  Media goes out once both directions are keyed.
+
+  Each direction's key is HKDF-SHA256 over X25519(ephemeral, ephemeral) and
+  X25519(identity, identity), with the sending side's ephemeral key in the
+  info. A forged KEY datagram therefore only works with the identity key
+  from discovery.
+
+  Media datagrams are [header][ciphertext][16 byte tag]. The header is
+  authenticated and carries MEDIA_FLAG_ENCRYPTED. frame_size and
+  frag_offset still count plaintext bytes. The nonce is the kind, seq and
+  frag_offset, which never repeat under one key. open() keeps a sliding
+  window per kind over the last REPLAY_WINDOW seqs, one bit per fragment,
+  and refuses an authentic datagram it has already opened or one older
+  than the window. A replayed capture therefore never reaches reassembly.
+
+  Control messages other than KEY (control_channel.hpp) are sealed the
+  same way, as single-fragment MEDIA_KIND_CONTROL datagrams.
+
+  Sealing is safe from several threads. Each kind has its own cipher
+  context, so audio and video never wait on each other. Opening is for the
+  receive thread only.
+*/
+class MediaCrypto {
+public:
+    static constexpr uint8_t CONTROL_KEY = 1;
+    static constexpr uint8_t KEY_FLAG_HAVE_PEER = 0x01;
+    static constexpr uint8_t KEY_FLAG_NEED_ACK = 0x02;
+    static constexpr size_t KEY_PACKET_SIZE = MEDIA_HEADER_SIZE + 3 + MEDIA_KEY_SIZE;
+    static constexpr int64_t KEY_RESEND_US = 200000;
+
+    MediaCrypto() = default;
+    ~MediaCrypto();
+    MediaCrypto(const MediaCrypto&) = delete;
+    MediaCrypto& operator=(const MediaCrypto&) = delete;
+
+    // peer_identity: the public key the peer advertised in discovery
+    bool initialize(const MediaKeyPair& identity, const std::array<uint8_t, MEDIA_KEY_SIZE>& peer_identity,
+                    MediaCipher cipher = preferred_media_cipher());
+
+    // Whether to send our KEY datagram now: every KEY_RESEND_US until the peer
+    // reports having our key, and in reply to each KEY that asks for one
+    bool keyPacketDue(int64_t now_us);
+    // Our KEY datagram; returns its length (KEY_PACKET_SIZE)
+    size_t writeKeyPacket(uint8_t* out) const;
+    // A received KEY datagram; derives both keys the first time. False if malformed.
+    bool handleKeyPacket(const uint8_t* datagram, size_t len);
+
+    // We can encrypt: the peer's key has arrived
+    bool ready() const { return keys_ready.load(std::memory_order_acquire); }
+    // The peer can decrypt what we send: it has reported our key
+    bool peerReady() const { return peer_has_key.load(std::memory_order_acquire); }
+    MediaCipher cipher() const { return tx_cipher; }
+
+    /*
+      Encrypts a frame of `size` bytes into `out` in one pass, one fragment
+      per `stride` bytes. Fragment i is [header][ciphertext][tag]. Its header
+      must already be written at out + i * stride, with MEDIA_FLAG_ENCRYPTED
+      set. The ciphertext goes straight into the fragment buffer and
+      `payload` is never written. All fragments are full size
+      (MEDIA_MAX_PAYLOAD) except the last.
+    */
+    bool sealFrame(uint8_t kind, const uint8_t* payload, size_t size, uint8_t* out, size_t stride);
+    // Decrypts one datagram's payload into out (up to MEDIA_MAX_PAYLOAD); false if it is not
+    // authentic, or is a replay
+    bool open(const MediaHeader& header, const uint8_t* datagram, size_t len, uint8_t* out, size_t& out_len);
+
+private:
+    struct CipherState {
+        std::mutex mutex; // sealing only
+        EVP_CIPHER_CTX* ctx = nullptr;
+    };
+
+    MediaKeyPair identity;
+    MediaKeyPair ephemeral;
+    std::array<uint8_t, MEDIA_KEY_SIZE> peer_identity{};
+    std::array<uint8_t, MEDIA_KEY_SIZE> peer_ephemeral{};
+    MediaCipher tx_cipher = MediaCipher::AES_256_GCM;
+    std::atomic<bool> keys_ready{false};     // also: we have the peer's key
+    std::atomic<bool> peer_has_key{false};
+    std::atomic<bool> reply_due{false};
+    std::atomic<int64_t> last_key_us{-KEY_RESEND_US};
+    static constexpr int KIND_COUNT = 3;
+    CipherState tx[KIND_COUNT];              // by kind: video, audio, control
+    EVP_CIPHER_CTX* rx[KIND_COUNT] = {};
+
+    // Anti-replay, receive thread only. Slot seq % REPLAY_WINDOW holds the fragments
+    // opened for seq; its bitmap keeps its capacity as the window slides.
+    static constexpr uint32_t REPLAY_WINDOW = 128;
+    struct ReplaySlot {
+        bool used = false;
+        uint32_t seq = 0;
+        std::vector<uint64_t> fragments;
+    };
+    struct ReplayWindow {
+        bool started = false;
+        uint32_t highest = 0;
+        std::array<ReplaySlot, REPLAY_WINDOW> slots;
+    };
+    ReplayWindow replay[KIND_COUNT];
+
+    bool deriveKeys(MediaCipher rx_cipher);
+    bool replayed(int index, uint32_t seq, uint32_t fragment) const;
+    void markOpened(int index, uint32_t seq, uint32_t fragment);
+};
+
+#endif // MEDIA_CRYPTO_HPP
@@ -0,0 +1,91 @@
+#ifndef MEDIA_PACKET_HPP
+#define MEDIA_PACKET_HPP
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <chrono>
+#include <arpa/inet.h>
+
+/*
+  Every media datagram starts with a fixed header so audio and video
+  fragments can share one socket and be reassembled independently:
+
+    0  u8   version (MEDIA_VERSION)
+    1  u8   type     pack_media_type(kind, codec)
+    2  u8   flags    MEDIA_FLAG_*
+    3  u8   reserved
+    4  u32  seq      per-kind frame sequence number
+    8  i64  pts_us   sender media clock at capture
+   16  u32  frame_size   total bytes of the encoded frame
+   20  u32  frag_offset  where this fragment's payload starts in the frame,
+                         a multiple of MEDIA_MAX_PAYLOAD
+
+  All fields are big endian. The payload follows the header. Encrypted
+  datagrams (MEDIA_FLAG_ENCRYPTED) carry ciphertext and a 16 byte tag
+  instead, see media_crypto.hpp. MEDIA_KIND_CONTROL datagrams are single
+  fragment messages between the two ends of a call.
+*/
+
+constexpr uint8_t MEDIA_VERSION       = 2;
+constexpr size_t  MEDIA_HEADER_SIZE   = 24;
+constexpr size_t  MEDIA_MAX_PAYLOAD   = 1400; // keeps datagrams under a 1500 MTU
+
+constexpr uint8_t MEDIA_KIND_VIDEO    = 1;
+constexpr uint8_t MEDIA_KIND_AUDIO    = 2;
+constexpr uint8_t MEDIA_KIND_CONTROL  = 3;
+
+constexpr uint8_t MEDIA_FLAG_KEYFRAME = 0x01;
+constexpr uint8_t MEDIA_FLAG_ENCRYPTED = 0x02;
+
+struct MediaHeader {
+    uint8_t type = 0;
+    uint8_t flags = 0;
+    uint32_t seq = 0;
+    int64_t pts_us = 0;
+    uint32_t frame_size = 0;
+    uint32_t frag_offset = 0;
+};
+
+inline void write_media_header(uint8_t* out, const MediaHeader& h) {
+    out[0] = MEDIA_VERSION;
+    out[1] = h.type;
+    out[2] = h.flags;
+    out[3] = 0;
+    uint32_t seq = htonl(h.seq);
+    uint32_t pts_hi = htonl(static_cast<uint32_t>(static_cast<uint64_t>(h.pts_us) >> 32));
+    uint32_t pts_lo = htonl(static_cast<uint32_t>(static_cast<uint64_t>(h.pts_us)));
+    uint32_t size = htonl(h.frame_size);
+    uint32_t offset = htonl(h.frag_offset);
+    memcpy(out + 4, &seq, 4);
+    memcpy(out + 8, &pts_hi, 4);
+    memcpy(out + 12, &pts_lo, 4);
+    memcpy(out + 16, &size, 4);
+    memcpy(out + 20, &offset, 4);
+}
+
+// Returns false for short datagrams or unknown versions
+inline bool read_media_header(const uint8_t* in, size_t len, MediaHeader& h) {
+    if (len < MEDIA_HEADER_SIZE || in[0] != MEDIA_VERSION) return false;
+    uint32_t seq, pts_hi, pts_lo, size, offset;
+    memcpy(&seq, in + 4, 4);
+    memcpy(&pts_hi, in + 8, 4);
+    memcpy(&pts_lo, in + 12, 4);
+    memcpy(&size, in + 16, 4);
+    memcpy(&offset, in + 20, 4);
+    h.type = in[1];
+    h.flags = in[2];
+    h.seq = ntohl(seq);
+    h.pts_us = static_cast<int64_t>((static_cast<uint64_t>(ntohl(pts_hi)) << 32) | ntohl(pts_lo));
+    h.frame_size = ntohl(size);
+    h.frag_offset = ntohl(offset);
+    return true;
+}
+
+// Sender-side media clock shared by the audio and video pipelines
+inline int64_t media_clock_us() {
+    using namespace std::chrono;
+    return duration_cast<microseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+#endif // MEDIA_PACKET_HPP
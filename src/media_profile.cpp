@@ -0,0 +1,195 @@
+#include "media_profile.hpp"
+
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+static MediaProfile make_profile(const char* name, int capture_w, int capture_h, int w, int h, int fps,
+                                 int64_t bit_rate, int gop) {
+    MediaProfile p;
+    p.name = name;
+    p.capture.width = capture_w;
+    p.capture.height = capture_h;
+    p.capture.fps = 30;
+    p.encode.width = w;
+    p.encode.height = h;
+    p.encode.fps = fps;
+    p.encode.bit_rate = bit_rate;
+    p.encode.gop = gop;
+    return p;
+}
+
+std::vector<MediaProfile> builtin_profiles() {
+    return {
+        make_profile("360p", 1280, 720, 640, 360, 24, 500000, 48),
+        make_profile("540p", 1280, 720, 960, 540, 30, 1200000, 60),
+        make_profile("720p", 1280, 720, 1280, 720, 30, 2000000, 30),
+        make_profile("1080p", 1920, 1080, 1920, 1080, 30, 4500000, 60),
+    };
+}
+
+const MediaProfile* find_profile(const std::vector<MediaProfile>& profiles, const std::string& name) {
+    for (const auto& p : profiles) {
+        if (p.name == name) return &p;
+    }
+    return nullptr;
+}
+
+static std::string trim(const std::string& s) {
+    size_t start = s.find_first_not_of(" \t\r");
+    if (start == std::string::npos) return "";
+    size_t end = s.find_last_not_of(" \t\r");
+    return s.substr(start, end - start + 1);
+}
+
+static bool parse_int(const std::string& value, int& out) {
+    try {
+        size_t used = 0;
+        out = std::stoi(value, &used);
+        return used == value.size();
+    } catch (...) {
+        return false;
+    }
+}
+
+// "1280x720" and "1280x720@30" (fps may be null)
+static bool parse_size(const std::string& value, int& w, int& h, int* fps) {
+    int n = 0, f = 0;
+    if (fps && sscanf(value.c_str(), "%dx%d@%d%n", &w, &h, &f, &n) == 3 && n == (int)value.size()) {
+        *fps = f;
+    } else if (!(sscanf(value.c_str(), "%dx%d%n", &w, &h, &n) == 2 && n == (int)value.size())) {
+        return false;
+    }
+    // 4:2:0 needs even dimensions
+    return w >= 16 && h >= 16 && w % 2 == 0 && h % 2 == 0 && (!fps || *fps > 0);
+}
+
+// "2000000", "2000k", "2M"
+static bool parse_bit_rate(const std::string& value, int64_t& out) {
+    if (value.empty()) return false;
+    char unit = value.back();
+    double scale = unit == 'k' || unit == 'K' ? 1e3 : unit == 'm' || unit == 'M' ? 1e6 : 1;
+    std::string number = scale == 1 ? value : value.substr(0, value.size() - 1);
+    try {
+        size_t used = 0;
+        double v = std::stod(number, &used);
+        if (used != number.size() || v <= 0) return false;
+        out = static_cast<int64_t>(v * scale);
+        return true;
+    } catch (...) {
+        return false;
+    }
+}
+
+bool set_profile_option(MediaProfile& p, const std::string& key, const std::string& value,
+                        const std::vector<MediaProfile>& profiles, std::string& error) {
+    bool ok = true;
+    CodecSettings& e = p.encode;
+    if (key == "base") {
+        const MediaProfile* base = find_profile(profiles, value);
+        if (base) {
+            std::string name = p.name;
+            p = *base;
+            p.name = name;
+        } else {
+            error = "unknown base profile '" + value + "'";
+            return false;
+        }
+    } else if (key == "capture") {
+        ok = parse_size(value, p.capture.width, p.capture.height, &p.capture.fps);
+    } else if (key == "capture_format") {
+        p.capture.pixel_format = value;
+        ok = !value.empty();
+    } else if (key == "size") {
+        ok = parse_size(value, e.width, e.height, nullptr);
+    } else if (key == "fps") {
+        ok = parse_int(value, e.fps) && e.fps > 0;
+    } else if (key == "bitrate") {
+        ok = parse_bit_rate(value, e.bit_rate);
+    } else if (key == "rate_control") {
+        ok = parse_rate_control(value, e.rate_control);
+    } else if (key == "quality") {
+        ok = parse_int(value, e.quality) && e.quality >= 0;
+    } else if (key == "gop") {
+        ok = parse_int(value, e.gop) && e.gop > 0;
+    } else if (key == "preset") {
+        e.preset = value;
+    } else if (key == "tune") {
+        e.tune = value;
+    } else if (key == "threads") {
+        ok = parse_int(value, e.threads) && e.threads >= 0;
+    } else if (key == "hardware") {
+        ok = value == "yes" || value == "no";
+        e.allow_hardware = value == "yes";
+    } else {
+        error = "unknown setting '" + key + "'";
+        return false;
+    }
+    if (!ok) error = "bad value '" + value + "' for " + key;
+    return ok;
+}
+
+bool load_profile_file(const std::string& path, std::vector<MediaProfile>& profiles) {
+    std::ifstream in(path);
+    if (!in) {
+        std::cerr << "Cannot open profile file " << path << std::endl;
+        return false;
+    }
+
+    std::vector<MediaProfile> loaded;
+    std::string line;
+    int line_no = 0;
+    while (std::getline(in, line)) {
+        line_no++;
+        size_t comment = line.find_first_of("#;");
+        if (comment != std::string::npos) line.erase(comment);
+        line = trim(line);
+        if (line.empty()) continue;
+
+        if (line.front() == '[' && line.back() == ']') {
+            MediaProfile p;
+            p.name = trim(line.substr(1, line.size() - 2));
+            loaded.push_back(p);
+            continue;
+        }
+
+        size_t eq = line.find('=');
+        std::string error = "expected key = value";
+        if (loaded.empty()) {
+            error = "setting outside a [profile] section";
+        } else if (eq != std::string::npos) {
+            // `base` may name a built-in or a profile earlier in this file
+            std::vector<MediaProfile> known = profiles;
+            known.insert(known.end(), loaded.begin(), loaded.end() - 1);
+            if (set_profile_option(loaded.back(), trim(line.substr(0, eq)), trim(line.substr(eq + 1)),
+                                   known, error)) {
+                continue;
+            }
+        }
+        std::cerr << path << ":" << line_no << ": " << error << std::endl;
+        return false;
+    }
+
+    for (auto& p : loaded) {
+        bool replaced = false;
+        for (auto& existing : profiles) {
+            if (existing.name == p.name) {
+                existing = p;
+                replaced = true;
+            }
+        }
+        if (!replaced) profiles.push_back(p);
+    }
+    return true;
+}
+
+std::string describe_profile(const MediaProfile& p) {
+    std::ostringstream out;
+    out << p.name << ": capture " << p.capture.width << "x" << p.capture.height << "@" << p.capture.fps
+        << ", encode " << p.encode.width << "x" << p.encode.height << "@" << p.encode.fps << " "
+        << p.encode.bit_rate / 1000 << " kb/s " << rate_control_name(p.encode.rate_control);
+    if (p.encode.rate_control == RateControl::CQ) out << " q" << p.encode.quality;
+    out << ", gop " << p.encode.gop;
+    return out.str();
+}
@@ -0,0 +1,59 @@
+#ifndef MEDIA_PROFILE_HPP
+#define MEDIA_PROFILE_HPP
+
+#include <string>
+#include <vector>
+
+#include "video_codec.hpp"
+
+// What the camera is opened with; fixed once capture is running
+struct CaptureSettings {
+    int width = 1280;
+    int height = 720;
+    int fps = 30;
+    std::string pixel_format = "uyvy422";
+};
+
+/*
+  A named capture + encode configuration. Built-in presets cover the usual
+  links (360p for VPN users up to 1080p on wired desks); a profile file can
+  add more or override them:
+
+    # gopher-profiles.ini
+    [desk]
+    base = 1080p           ; start from a preset, then override
+    bitrate = 6M
+    rate_control = cbr
+
+    [vpn]
+    capture = 1280x720@30
+    size = 640x360
+    fps = 20
+    bitrate = 400k
+    preset = veryfast
+    tune = zerolatency
+    threads = 2
+
+  Keys: base, capture (WxH@fps), capture_format, size (WxH), fps, bitrate
+  (plain, k or M), rate_control (cbr|vbr|cq), quality, gop, preset, tune,
+  threads, hardware (yes|no). The same key=value pairs work on the command
+  line. The codec itself is negotiated per call and is not part of a
+  profile.
+*/
+struct MediaProfile {
+    std::string name = "720p";
+    CaptureSettings capture;
+    CodecSettings encode;
+};
+
+std::vector<MediaProfile> builtin_profiles();
+const MediaProfile* find_profile(const std::vector<MediaProfile>& profiles, const std::string& name);
+// Adds profiles from an INI-style file, replacing any with the same name; errors go to stderr
+bool load_profile_file(const std::string& path, std::vector<MediaProfile>& profiles);
+// One key=value setting; `profiles` resolves `base`. False (with a message) on a bad key or value.
+bool set_profile_option(MediaProfile& profile, const std::string& key, const std::string& value,
+                        const std::vector<MediaProfile>& profiles, std::string& error);
+// "720p: capture 1280x720@30, encode 1280x720@30 2000 kb/s vbr, gop 30"
+std::string describe_profile(const MediaProfile& profile);
+
+#endif // MEDIA_PROFILE_HPP
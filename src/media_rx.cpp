@@ -0,0 +1,139 @@
+#include "media_rx.hpp"
+
+#include <iostream>
+#include <cerrno>
+#include <cstring>
+#include <sys/socket.h>
+
+bool MediaRx::initialize(int sock, bool prefer_io_uring) {
+    this->sock = sock;
+    prefer_uring = prefer_io_uring;
+    return true;
+}
+
+void MediaRx::run(const std::atomic<bool>& running, const DatagramHandler& handler) {
+#ifdef GOPHER_HAVE_IO_URING
+    // Set up on the receive thread: the ring is single-issuer
+    if (prefer_uring && !buf_ring) uring_active = setupUring();
+    if (uring_active) {
+        runUring(running, handler);
+        return;
+    }
+#endif
+    runSocket(running, handler);
+}
+
+void MediaRx::runSocket(const std::atomic<bool>& running, const DatagramHandler& handler) {
+    uint8_t recv_buffer[RING_BUFFER_SIZE];
+    while (running) {
+        ssize_t n = recvfrom(sock, recv_buffer, sizeof(recv_buffer), 0, nullptr, nullptr);
+        if (n > 0) handler(recv_buffer, n);
+    }
+}
+
+#ifdef GOPHER_HAVE_IO_URING
+constexpr int BUFFER_GROUP = 0;
+
+bool MediaRx::setupUring() {
+    // Only this thread touches the ring; let the kernel skip cross-thread wakeups
+    io_uring_params params{};
+    params.flags = IORING_SETUP_SINGLE_ISSUER | IORING_SETUP_DEFER_TASKRUN;
+    int ret = io_uring_queue_init_params(64, &ring, &params);
+    if (ret < 0) {
+        params = io_uring_params{};
+        ret = io_uring_queue_init_params(64, &ring, &params);
+    }
+    if (ret < 0) {
+        std::cerr << "io_uring unavailable (" << strerror(-ret) << "), using recvfrom" << std::endl;
+        return false;
+    }
+
+    // Buffer ring (5.19+): the kernel picks a free buffer for each datagram
+    buf_ring = io_uring_setup_buf_ring(&ring, RING_BUFFERS, BUFFER_GROUP, 0, &ret);
+    if (!buf_ring) {
+        std::cerr << "io_uring buffer rings unsupported (" << strerror(-ret) << "), using recvfrom" << std::endl;
+        io_uring_queue_exit(&ring);
+        return false;
+    }
+    buffers.resize(RING_BUFFERS * RING_BUFFER_SIZE);
+    const int mask = io_uring_buf_ring_mask(RING_BUFFERS);
+    for (unsigned i = 0; i < RING_BUFFERS; i++) {
+        io_uring_buf_ring_add(buf_ring, buffers.data() + i * RING_BUFFER_SIZE, RING_BUFFER_SIZE, i, mask, i);
+    }
+    io_uring_buf_ring_advance(buf_ring, RING_BUFFERS);
+
+    if (!armRecv()) {
+        io_uring_free_buf_ring(&ring, buf_ring, RING_BUFFERS, BUFFER_GROUP);
+        buf_ring = nullptr;
+        io_uring_queue_exit(&ring);
+        return false;
+    }
+    return true;
+}
+
+// One multishot recv keeps producing completions until the kernel ends it
+bool MediaRx::armRecv() {
+    io_uring_sqe* sqe = io_uring_get_sqe(&ring);
+    if (!sqe) return false;
+    io_uring_prep_recv_multishot(sqe, sock, nullptr, 0, 0);
+    sqe->flags |= IOSQE_BUFFER_SELECT;
+    sqe->buf_group = BUFFER_GROUP;
+    return io_uring_submit(&ring) >= 0;
+}
+
+void MediaRx::runUring(const std::atomic<bool>& running, const DatagramHandler& handler) {
+    const int mask = io_uring_buf_ring_mask(RING_BUFFERS);
+    bool warned = false;
+
+    while (running) {
+        __kernel_timespec timeout{0, 200 * 1000 * 1000};
+        io_uring_cqe* cqe;
+        int ret = io_uring_wait_cqe_timeout(&ring, &cqe, &timeout);
+        if (ret == -ETIME || ret == -EINTR) continue;
+        if (ret < 0) break;
+
+        // Drain everything that is ready, then hand the buffers back in one go
+        unsigned head, seen = 0, recycled = 0;
+        bool rearm = false, unsupported = false;
+        io_uring_for_each_cqe(&ring, head, cqe) {
+            seen++;
+            if (!(cqe->flags & IORING_CQE_F_MORE)) rearm = true;
+
+            if (cqe->res < 0) {
+                if (cqe->res == -EINVAL) unsupported = true; // no multishot recv before 6.0
+                // -ENOBUFS: every buffer was in use; the re-arm below resumes reception
+                if (cqe->res != -ENOBUFS && !warned) {
+                    std::cerr << "io_uring recv failed: " << strerror(-cqe->res) << std::endl;
+                    warned = true;
+                }
+                continue;
+            }
+            if (!(cqe->flags & IORING_CQE_F_BUFFER)) continue;
+
+            unsigned bid = cqe->flags >> IORING_CQE_BUFFER_SHIFT;
+            uint8_t* data = buffers.data() + bid * RING_BUFFER_SIZE;
+            if (cqe->res > 0) handler(data, cqe->res);
+
+            io_uring_buf_ring_add(buf_ring, data, RING_BUFFER_SIZE, bid, mask, recycled++);
+        }
+        io_uring_buf_ring_cq_advance(&ring, buf_ring, recycled);
+        if (seen > recycled) io_uring_cq_advance(&ring, seen - recycled);
+
+        if (unsupported || (rearm && running && !armRecv())) {
+            std::cerr << "io_uring recv unavailable, falling back to recvfrom" << std::endl;
+            uring_active = false;
+            runSocket(running, handler);
+            return;
+        }
+    }
+}
+#endif
+
+MediaRx::~MediaRx() {
+#ifdef GOPHER_HAVE_IO_URING
+    if (buf_ring) {
+        io_uring_free_buf_ring(&ring, buf_ring, RING_BUFFERS, BUFFER_GROUP);
+        io_uring_queue_exit(&ring);
+    }
+#endif
+}
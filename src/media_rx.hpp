@@ -0,0 +1,53 @@
+#ifndef MEDIA_RX_HPP
+#define MEDIA_RX_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+#include <functional>
+#include <vector>
+
+#ifdef GOPHER_HAVE_IO_URING
+#include <liburing.h>
+#endif
+
+// Called once per received datagram; the data is only valid for the call
+using DatagramHandler = std::function<void(const uint8_t* data, size_t len)>;
+
+/*
+  Receive loop for the media socket. With io_uring (Linux, built with
+  liburing) a single multishot recv fills buffers from a ring shared with
+  the kernel: no syscall per datagram and no copy before reassembly.
+  Otherwise, or if the kernel lacks buffer rings / multishot recv, it
+  falls back to a plain blocking recvfrom loop.
+*/
+class MediaRx {
+private:
+    int sock = -1;
+    bool prefer_uring = true;
+    bool uring_active = false;
+
+    static constexpr unsigned RING_BUFFERS = 1024; // power of two, as buffer rings require
+    static constexpr size_t RING_BUFFER_SIZE = 2048;
+
+#ifdef GOPHER_HAVE_IO_URING
+    io_uring ring{};
+    io_uring_buf_ring* buf_ring = nullptr;
+    std::vector<uint8_t> buffers;
+
+    bool setupUring();
+    bool armRecv();
+    void runUring(const std::atomic<bool>& running, const DatagramHandler& handler);
+#endif
+    void runSocket(const std::atomic<bool>& running, const DatagramHandler& handler);
+
+public:
+    // Does not take ownership of sock; it needs a receive timeout for the fallback path
+    bool initialize(int sock, bool prefer_io_uring = true);
+    // Picks the backend on first call, then returns within ~200 ms of running going false
+    void run(const std::atomic<bool>& running, const DatagramHandler& handler);
+    const char* backendName() const { return uring_active ? "io_uring" : "recvfrom"; }
+    ~MediaRx();
+};
+
+#endif // MEDIA_RX_HPP
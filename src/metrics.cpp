@@ -0,0 +1,195 @@
+#include "metrics.hpp"
+#include "thread_policy.hpp"
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0 // macOS: SIGPIPE is ignored per socket instead
+#endif
+
+int Counter::stripe() {
+    // Threads take stripes round robin on first use
+    static std::atomic<int> next{0};
+    thread_local int mine = next.fetch_add(1, std::memory_order_relaxed) % STRIPES;
+    return mine;
+}
+
+uint64_t Counter::value() const {
+    uint64_t total = 0;
+    for (const auto& cell : cells) total += cell.value.load(std::memory_order_relaxed);
+    return total;
+}
+
+Histogram::Histogram(std::vector<int64_t> bounds)
+    : bounds_us(std::move(bounds)), buckets(new std::atomic<uint64_t>[bounds_us.size() + 1]) {
+    for (size_t i = 0; i <= bounds_us.size(); i++) buckets[i].store(0, std::memory_order_relaxed);
+}
+
+void Histogram::observe(int64_t us) {
+    size_t i = 0;
+    while (i < bounds_us.size() && us > bounds_us[i]) i++;
+    buckets[i].fetch_add(1, std::memory_order_relaxed);
+    count_.fetch_add(1, std::memory_order_relaxed);
+    sum_us.fetch_add(us, std::memory_order_relaxed);
+}
+
+std::vector<int64_t> latency_buckets_us() {
+    return {500, 1000, 2000, 4000, 8000, 16000, 33000, 66000, 125000, 250000, 500000, 1000000};
+}
+
+MetricsRegistry::Entry* MetricsRegistry::find(const std::string& name, Kind kind) {
+    for (auto& e : entries) {
+        if (e.name == name && e.kind == kind) return &e;
+    }
+    return nullptr;
+}
+
+Counter& MetricsRegistry::counter(const std::string& name, const std::string& help) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (Entry* e = find(name, Kind::Counter)) return *static_cast<Counter*>(e->metric);
+    counters.emplace_back();
+    entries.push_back(Entry{name, help, Kind::Counter, &counters.back()});
+    return counters.back();
+}
+
+Gauge& MetricsRegistry::gauge(const std::string& name, const std::string& help) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (Entry* e = find(name, Kind::Gauge)) return *static_cast<Gauge*>(e->metric);
+    gauges.emplace_back();
+    entries.push_back(Entry{name, help, Kind::Gauge, &gauges.back()});
+    return gauges.back();
+}
+
+Histogram& MetricsRegistry::histogram(const std::string& name, const std::string& help,
+                                      std::vector<int64_t> bounds_us) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (Entry* e = find(name, Kind::Histogram)) return *static_cast<Histogram*>(e->metric);
+    histograms.emplace_back(std::move(bounds_us));
+    entries.push_back(Entry{name, help, Kind::Histogram, &histograms.back()});
+    return histograms.back();
+}
+
+std::string MetricsRegistry::render() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    std::string out;
+    char line[256];
+    for (const auto& e : entries) {
+        const char* type = e.kind == Kind::Counter ? "counter" : e.kind == Kind::Gauge ? "gauge" : "histogram";
+        out += "# HELP " + e.name + " " + e.help + "\n";
+        out += "# TYPE " + e.name + " " + type + "\n";
+
+        if (e.kind == Kind::Counter) {
+            snprintf(line, sizeof(line), "%s %llu\n", e.name.c_str(),
+                     (unsigned long long)static_cast<const Counter*>(e.metric)->value());
+            out += line;
+        } else if (e.kind == Kind::Gauge) {
+            snprintf(line, sizeof(line), "%s %lld\n", e.name.c_str(),
+                     (long long)static_cast<const Gauge*>(e.metric)->value());
+            out += line;
+        } else {
+            const Histogram* h = static_cast<const Histogram*>(e.metric);
+            uint64_t cumulative = 0;
+            for (size_t i = 0; i < h->bounds().size(); i++) {
+                cumulative += h->bucketCount(i);
+                snprintf(line, sizeof(line), "%s_bucket{le=\"%g\"} %llu\n", e.name.c_str(),
+                         h->bounds()[i] / 1e6, (unsigned long long)cumulative);
+                out += line;
+            }
+            cumulative += h->bucketCount(h->bounds().size());
+            snprintf(line, sizeof(line), "%s_bucket{le=\"+Inf\"} %llu\n%s_sum %.6f\n%s_count %llu\n",
+                     e.name.c_str(), (unsigned long long)cumulative, e.name.c_str(), h->sumUs() / 1e6,
+                     e.name.c_str(), (unsigned long long)h->count());
+            out += line;
+        }
+    }
+    return out;
+}
+
+MetricsRegistry& metrics() {
+    static MetricsRegistry registry;
+    return registry;
+}
+
+bool MetricsServer::start(uint16_t port, const std::string& bind_ip) {
+    sock = socket(AF_INET, SOCK_STREAM, 0);
+    if (sock < 0) return false;
+
+    // Wake up periodically so stop() is noticed
+    struct timeval timeout;
+    timeout.tv_sec = 1;
+    timeout.tv_usec = 0;
+    setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+    int reuse = 1;
+    setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    inet_pton(AF_INET, bind_ip.c_str(), &addr.sin_addr);
+
+    if (bind(sock, (sockaddr*)&addr, sizeof(addr)) < 0 || listen(sock, 8) < 0) {
+        std::cerr << "Metrics endpoint unavailable on " << bind_ip << ":" << port << ": "
+                  << strerror(errno) << std::endl;
+        close(sock);
+        sock = -1;
+        return false;
+    }
+
+    running = true;
+    worker = std::thread(&MetricsServer::run, this);
+    std::cout << "Metrics at http://" << bind_ip << ":" << port << "/metrics" << std::endl;
+    return true;
+}
+
+void MetricsServer::run() {
+    apply_thread_policy(ThreadRole::BACKGROUND, "metrics");
+    while (running) {
+        int conn = accept(sock, nullptr, nullptr);
+        if (conn < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) continue;
+            break;
+        }
+
+        // A scrape is one short GET; the request itself is not interpreted
+        struct timeval timeout;
+        timeout.tv_sec = 1;
+        timeout.tv_usec = 0;
+        setsockopt(conn, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        char request[1024];
+        recv(conn, request, sizeof(request), 0);
+
+        std::string body = metrics().render();
+        std::string response = "HTTP/1.0 200 OK\r\n"
+                               "Content-Type: text/plain; version=0.0.4\r\n"
+                               "Content-Length: " + std::to_string(body.size()) + "\r\n"
+                               "Connection: close\r\n\r\n" + body;
+        size_t sent = 0;
+        while (sent < response.size()) {
+            ssize_t n = send(conn, response.data() + sent, response.size() - sent, MSG_NOSIGNAL);
+            if (n <= 0) break;
+            sent += n;
+        }
+        close(conn);
+    }
+}
+
+void MetricsServer::stop() {
+    running = false;
+    if (worker.joinable()) worker.join();
+    if (sock >= 0) {
+        close(sock);
+        sock = -1;
+    }
+}
+
+MetricsServer::~MetricsServer() {
+    stop();
+}
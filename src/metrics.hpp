@@ -0,0 +1,128 @@
+#ifndef METRICS_HPP
+#define METRICS_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/*
+  Process-wide metrics in the Prometheus text format, served by
+  MetricsServer on a local HTTP port.
+
+  Metrics are registered once, typically as namespace-scope references
+  in the file that updates them, and live until the process exits.
+  Updates never lock or allocate:
+    - Counter::inc is a relaxed fetch_add on a cache line owned by the
+      calling thread (counters are striped per thread, summed on scrape);
+    - Gauge::set/add is one relaxed atomic op;
+    - Histogram::observe scans a dozen bucket bounds and does two
+      relaxed fetch_adds.
+  Scrapes read without stopping writers, so one scrape can be a few
+  updates out of step across metrics. That is fine for rates and
+  dashboards.
+*/
+
+class Counter {
+public:
+    static constexpr int STRIPES = 16;
+
+    void inc(uint64_t n = 1) {
+        cells[stripe()].value.fetch_add(n, std::memory_order_relaxed);
+    }
+    uint64_t value() const;
+
+private:
+    struct alignas(64) Cell {
+        std::atomic<uint64_t> value{0};
+    };
+    Cell cells[STRIPES];
+
+    static int stripe();
+};
+
+class Gauge {
+public:
+    void set(int64_t v) { value_.store(v, std::memory_order_relaxed); }
+    void add(int64_t n) { value_.fetch_add(n, std::memory_order_relaxed); }
+    int64_t value() const { return value_.load(std::memory_order_relaxed); }
+
+private:
+    std::atomic<int64_t> value_{0};
+};
+
+// Observations in microseconds; exported in seconds
+class Histogram {
+public:
+    explicit Histogram(std::vector<int64_t> bounds_us);
+    void observe(int64_t us);
+
+    const std::vector<int64_t>& bounds() const { return bounds_us; }
+    uint64_t bucketCount(size_t i) const { return buckets[i].load(std::memory_order_relaxed); }
+    uint64_t count() const { return count_.load(std::memory_order_relaxed); }
+    int64_t sumUs() const { return sum_us.load(std::memory_order_relaxed); }
+
+private:
+    std::vector<int64_t> bounds_us;
+    std::unique_ptr<std::atomic<uint64_t>[]> buckets; // bounds + the +Inf bucket
+    std::atomic<uint64_t> count_{0};
+    std::atomic<int64_t> sum_us{0};
+};
+
+// 0.5 ms .. 1 s, roughly doubling: decode, encode and query latencies
+std::vector<int64_t> latency_buckets_us();
+
+class MetricsRegistry {
+public:
+    // Registering the same name twice returns the same metric
+    Counter& counter(const std::string& name, const std::string& help);
+    Gauge& gauge(const std::string& name, const std::string& help);
+    Histogram& histogram(const std::string& name, const std::string& help,
+                         std::vector<int64_t> bounds_us = latency_buckets_us());
+
+    // Prometheus text exposition format, version 0.0.4
+    std::string render() const;
+
+private:
+    enum class Kind { Counter, Gauge, Histogram };
+    struct Entry {
+        std::string name;
+        std::string help;
+        Kind kind;
+        void* metric;
+    };
+
+    mutable std::mutex mutex; // registration and scrapes only
+    std::vector<Entry> entries;
+    std::deque<Counter> counters; // deques keep references stable
+    std::deque<Gauge> gauges;
+    std::deque<Histogram> histograms;
+
+    Entry* find(const std::string& name, Kind kind);
+};
+
+MetricsRegistry& metrics();
+
+/*
+  Minimal HTTP/1.0 server for scrapes: any GET is answered with the
+  registry's text rendering. Binds to loopback unless told otherwise.
+*/
+class MetricsServer {
+public:
+    bool start(uint16_t port, const std::string& bind_ip = "127.0.0.1");
+    void stop();
+    ~MetricsServer();
+
+private:
+    int sock = -1;
+    std::thread worker;
+    std::atomic<bool> running{false};
+
+    void run();
+};
+
+#endif // METRICS_HPP
@@ -0,0 +1,106 @@
+#include "net_trace.hpp"
+
+#include <cstring>
+#include <iostream>
+
+static size_t put_varint(uint8_t* out, uint64_t value) {
+    size_t n = 0;
+    while (value >= 0x80) {
+        out[n++] = static_cast<uint8_t>(value | 0x80);
+        value >>= 7;
+    }
+    out[n++] = static_cast<uint8_t>(value);
+    return n;
+}
+
+bool TraceWriter::open(const std::string& path, int64_t start_us) {
+    file = fopen(path.c_str(), "wb");
+    if (!file) {
+        std::cerr << "Failed to open trace file " << path << std::endl;
+        return false;
+    }
+    // Large stdio buffer: the receive thread only memcpys until it fills
+    io_buffer.resize(4 * 1024 * 1024);
+    setvbuf(file, io_buffer.data(), _IOFBF, io_buffer.size());
+
+    uint8_t header[16];
+    memcpy(header, NET_TRACE_MAGIC, 8);
+    for (int i = 0; i < 8; i++) header[8 + i] = static_cast<uint8_t>(static_cast<uint64_t>(start_us) >> (56 - 8 * i));
+    fwrite(header, 1, sizeof(header), file);
+    last_us = start_us;
+    std::cout << "Capturing receive trace to " << path << std::endl;
+    return true;
+}
+
+void TraceWriter::write(int64_t arrival_us, const uint8_t* data, size_t len) {
+    if (!file) return;
+    uint8_t prefix[20];
+    int64_t delta = arrival_us > last_us ? arrival_us - last_us : 0;
+    size_t n = put_varint(prefix, static_cast<uint64_t>(delta));
+    n += put_varint(prefix + n, len);
+    fwrite(prefix, 1, n, file);
+    fwrite(data, 1, len, file);
+    last_us += delta;
+    records++;
+}
+
+void TraceWriter::close() {
+    if (!file) return;
+    fclose(file);
+    file = nullptr;
+}
+
+TraceWriter::~TraceWriter() {
+    close();
+}
+
+bool TraceReader::open(const std::string& path) {
+    file = fopen(path.c_str(), "rb");
+    if (!file) return false;
+
+    uint8_t header[16];
+    if (fread(header, 1, sizeof(header), file) != sizeof(header) ||
+        memcmp(header, NET_TRACE_MAGIC, 8) != 0) {
+        std::cerr << path << " is not a Gopher trace" << std::endl;
+        fclose(file);
+        file = nullptr;
+        return false;
+    }
+    uint64_t start = 0;
+    for (int i = 0; i < 8; i++) start = (start << 8) | header[8 + i];
+    start_us = static_cast<int64_t>(start);
+    last_us = start_us;
+    return true;
+}
+
+bool TraceReader::readVarint(uint64_t& out) {
+    out = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        int c = fgetc(file);
+        if (c == EOF) return false;
+        out |= static_cast<uint64_t>(c & 0x7f) << shift;
+        if (!(c & 0x80)) return true;
+    }
+    return false;
+}
+
+bool TraceReader::next(Record& record) {
+    if (!file) return false;
+    uint64_t delta, len;
+    if (!readVarint(delta) || !readVarint(len) || len > 65536) return false;
+    record.data.resize(len);
+    if (fread(record.data.data(), 1, len, file) != len) return false;
+    last_us += static_cast<int64_t>(delta);
+    record.arrival_us = last_us;
+    return true;
+}
+
+void TraceReader::rewind() {
+    if (!file) return;
+    fseek(file, 16, SEEK_SET);
+    last_us = start_us;
+}
+
+TraceReader::~TraceReader() {
+    if (file) fclose(file);
+}
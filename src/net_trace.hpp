@@ -0,0 +1,64 @@
+#ifndef NET_TRACE_HPP
+#define NET_TRACE_HPP
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+/*
+  Compact binary log of received media datagrams, for replaying receiver
+  behaviour offline (gopher_replay). Layout:
+
+    8 bytes  magic "GTRACE1\n"
+    8 bytes  i64 big endian: media clock (us) when the capture started
+    then one record per datagram:
+      varint  microseconds since the previous record (or the start)
+      varint  datagram length
+      bytes   the datagram, header included
+
+  Varints are unsigned LEB128, so a typical record costs 3-4 bytes of
+  overhead on top of the datagram.
+*/
+constexpr char NET_TRACE_MAGIC[8] = {'G', 'T', 'R', 'A', 'C', 'E', '1', '\n'};
+
+class TraceWriter {
+private:
+    FILE* file = nullptr;
+    std::vector<char> io_buffer;
+    int64_t last_us = 0;
+    uint64_t records = 0;
+
+public:
+    bool open(const std::string& path, int64_t start_us);
+    // Buffered; only the receive thread calls this
+    void write(int64_t arrival_us, const uint8_t* data, size_t len);
+    void close();
+    uint64_t recordCount() const { return records; }
+    ~TraceWriter();
+};
+
+class TraceReader {
+private:
+    FILE* file = nullptr;
+    int64_t start_us = 0;
+    int64_t last_us = 0;
+
+    bool readVarint(uint64_t& out);
+
+public:
+    struct Record {
+        int64_t arrival_us;
+        std::vector<uint8_t> data;
+    };
+
+    bool open(const std::string& path);
+    // Reuses record.data's storage; false at end of trace or on a truncated record
+    bool next(Record& record);
+    // Back to the first record
+    void rewind();
+    int64_t startUs() const { return start_us; }
+    ~TraceReader();
+};
+
+#endif // NET_TRACE_HPP
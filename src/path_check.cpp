@@ -0,0 +1,197 @@
+/*
+  gopher_path_check - rendezvous, connectivity checks and relay without a
+  camera. Two instances on different segments (see
+  scripts/netns_rendezvous.sh) register with a gopherd --rendezvous, find
+  each other in its listing, and pick a path with select_path() exactly as
+  gopher_client does. They then stand in for a call: each sends KEY
+  datagrams at 50 per second for N seconds and counts what arrives.
+
+    gopher_path_check --rendezvous HOST[:PORT] --name NAME --peer NAME [--seconds N] [--relay]
+
+  --relay skips the checks and goes straight through the daemon. Exits 0
+  if the path carried at least 90% of the peer's datagrams.
+*/
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "gopherd_helper.hpp"
+#include "media_packet.hpp"
+#include "rendezvous.hpp"
+
+constexpr int SEND_INTERVAL_MS = 20;
+
+struct ListedPeer {
+    std::string key;
+    std::string candidates;
+};
+
+// The rendezvous daemon's peer list, as query_daemon_for_gophers() reads it
+static bool find_peer(const std::string& daemon_ip, const std::string& name, ListedPeer& out) {
+    int sock = socket(AF_INET, SOCK_STREAM, 0);
+    if (sock < 0) return false;
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(DAEMON_PORT);
+    inet_pton(AF_INET, daemon_ip.c_str(), &addr.sin_addr);
+    std::string listing;
+    if (connect(sock, (sockaddr*)&addr, sizeof(addr)) == 0) {
+        char buffer[2048];
+        ssize_t n;
+        while ((n = read(sock, buffer, sizeof(buffer))) > 0) listing.append(buffer, n);
+    }
+    close(sock);
+
+    std::istringstream lines(listing);
+    std::string line;
+    while (std::getline(lines, line)) {
+        std::istringstream fields(line);
+        std::vector<std::string> f;
+        std::string field;
+        while (std::getline(fields, field, ',')) f.push_back(field);
+        if (f.size() >= 6 && f[0] == name) {
+            out = ListedPeer{f[4], f[5]};
+            return true;
+        }
+    }
+    return false;
+}
+
+static std::string random_key() {
+    std::random_device rd;
+    static const char* hex = "0123456789abcdef";
+    std::string key;
+    for (int i = 0; i < 64; i++) key += hex[rd() % 16];
+    return key;
+}
+
+static std::string local_ip_towards(const std::string& ip) {
+    int sock = socket(AF_INET, SOCK_DGRAM, 0);
+    sockaddr_in remote{};
+    remote.sin_family = AF_INET;
+    remote.sin_port = htons(9);
+    inet_pton(AF_INET, ip.c_str(), &remote.sin_addr);
+    std::string result = "127.0.0.1";
+    sockaddr_in local{};
+    socklen_t len = sizeof(local);
+    if (connect(sock, (sockaddr*)&remote, sizeof(remote)) == 0 &&
+        getsockname(sock, (sockaddr*)&local, &len) == 0) {
+        char buf[INET_ADDRSTRLEN];
+        inet_ntop(AF_INET, &local.sin_addr, buf, sizeof(buf));
+        result = buf;
+    }
+    close(sock);
+    return result;
+}
+
+int main(int argc, char* argv[]) {
+    std::string server, name, peer_name;
+    int seconds = 5;
+    bool force_relay = false;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--rendezvous" && i + 1 < argc) server = argv[++i];
+        else if (arg == "--name" && i + 1 < argc) name = argv[++i];
+        else if (arg == "--peer" && i + 1 < argc) peer_name = argv[++i];
+        else if (arg == "--seconds" && i + 1 < argc) seconds = std::stoi(argv[++i]);
+        else if (arg == "--relay") force_relay = true;
+    }
+    if (server.empty() || name.empty() || peer_name.empty()) {
+        std::cerr << "usage: gopher_path_check --rendezvous HOST[:PORT] --name NAME --peer NAME "
+                     "[--seconds N] [--relay]" << std::endl;
+        return 2;
+    }
+
+    int sock = socket(AF_INET, SOCK_DGRAM, 0);
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = INADDR_ANY;
+    bind(sock, (sockaddr*)&addr, sizeof(addr));
+    socklen_t len = sizeof(addr);
+    getsockname(sock, (sockaddr*)&addr, &len);
+
+    Announcement self;
+    self.name = name;
+    self.port = ntohs(addr.sin_port);
+    self.key = random_key();
+    RendezvousClient rendezvous;
+    std::string server_ip;
+    if (!rendezvous.initialize(server, sock, self, [&server_ip] { return local_ip_towards(server_ip); })) return 2;
+    PathCandidate relay = rendezvous.relayAddress();
+    server_ip = relay.ip;
+    rendezvous.start();
+    std::cout << name << ": registered " << local_ip_towards(server_ip) << ":" << self.port << std::endl;
+
+    ListedPeer peer;
+    auto give_up = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+    while (!find_peer(server_ip, peer_name, peer)) {
+        if (std::chrono::steady_clock::now() > give_up) {
+            std::cerr << name << ": " << peer_name << " never registered" << std::endl;
+            return 1;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    }
+    std::cout << name << ": " << peer_name << " candidates " << peer.candidates << std::endl;
+
+    PathChoice path;
+    if (!force_relay &&
+        select_path(sock, parse_candidates(peer.candidates), &relay, PATH_CHECK_TIMEOUT_MS, path) && !path.relayed) {
+        std::cout << name << ": direct path " << path.ip << ":" << path.port;
+        if (path.rtt_us >= 0) std::cout << " rtt " << path.rtt_us / 1000.0 << " ms";
+        std::cout << std::endl;
+    } else {
+        std::cout << name << ": relaying through " << relay.ip << ":" << relay.port << std::endl;
+        rendezvous.relayTo(peer.key);
+        path = PathChoice{relay.ip, relay.port, -1, true};
+        std::this_thread::sleep_for(std::chrono::milliseconds(100)); // route before media
+    }
+
+    sockaddr_in dest{};
+    dest.sin_family = AF_INET;
+    dest.sin_port = htons(path.port);
+    inet_pton(AF_INET, path.ip.c_str(), &dest.sin_addr);
+
+    // Stand-in call: KEY datagrams (which also end a late peer's checks), counted on arrival
+    const int total = seconds * 1000 / SEND_INTERVAL_MS;
+    int sent = 0, received = 0;
+    auto next_send = std::chrono::steady_clock::now();
+    auto end = next_send + std::chrono::seconds(seconds) + std::chrono::milliseconds(500);
+    uint8_t buffer[2048];
+    while (std::chrono::steady_clock::now() < end) {
+        auto now = std::chrono::steady_clock::now();
+        if (sent < total && now >= next_send) {
+            MediaHeader hdr;
+            hdr.type = MEDIA_KIND_CONTROL;
+            hdr.seq = sent++;
+            hdr.frame_size = 1;
+            write_media_header(buffer, hdr);
+            buffer[MEDIA_HEADER_SIZE] = 1; // MediaCrypto::CONTROL_KEY
+            sendto(sock, buffer, MEDIA_HEADER_SIZE + 1, 0, (sockaddr*)&dest, sizeof(dest));
+            next_send += std::chrono::milliseconds(SEND_INTERVAL_MS);
+        }
+        pollfd pfd{sock, POLLIN, 0};
+        poll(&pfd, 1, SEND_INTERVAL_MS);
+        ssize_t n;
+        while ((n = recv(sock, buffer, sizeof(buffer), MSG_DONTWAIT)) > 0) {
+            MediaHeader hdr;
+            if (read_media_header(buffer, n, hdr) && hdr.type == MEDIA_KIND_CONTROL &&
+                static_cast<size_t>(n) > MEDIA_HEADER_SIZE && buffer[MEDIA_HEADER_SIZE] == 1) {
+                received++;
+            }
+        }
+    }
+    rendezvous.stop();
+    close(sock);
+
+    std::cout << name << ": " << (path.relayed ? "relayed" : "direct") << ", sent " << sent << ", received "
+              << received << " of " << total << std::endl;
+    return received * 10 >= total * 9 ? 0 : 1;
+}
@@ -0,0 +1,260 @@
+#include "rendezvous.hpp"
+#include "media_packet.hpp"
+#include "metrics.hpp"
+#include "thread_policy.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <sstream>
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <poll.h>
+#include <sys/socket.h>
+
+static Counter& probes_sent = metrics().counter("gopher_path_probes_sent_total", "Connectivity check probes sent");
+static Counter& probe_replies = metrics().counter("gopher_path_probe_replies_total",
+                                                  "Connectivity check replies received");
+static Counter& keys_ignored = metrics().counter("gopher_path_keys_ignored_total",
+                                                 "KEY datagrams during path checks from neither a candidate nor the relay");
+static Histogram& path_check_time = metrics().histogram("gopher_path_check_seconds",
+                                                        "Time from the first probe to a chosen path",
+                                                        {50000, 100000, 250000, 500000, 1000000, 2500000, 5000000,
+                                                         15000000});
+
+constexpr uint8_t CONTROL_KEY_TYPE = 1; // MediaCrypto::CONTROL_KEY
+constexpr size_t PROBE_SIZE = 16;
+
+std::vector<PathCandidate> parse_candidates(const std::string& list) {
+    std::vector<PathCandidate> out;
+    std::istringstream entries(list);
+    std::string entry;
+    while (std::getline(entries, entry, '+')) {
+        size_t colon = entry.rfind(':');
+        if (colon == std::string::npos) continue;
+        in_addr addr;
+        if (inet_pton(AF_INET, entry.substr(0, colon).c_str(), &addr) != 1) continue;
+        try {
+            int port = std::stoi(entry.substr(colon + 1));
+            if (port <= 0 || port > 65535) continue;
+            out.push_back(PathCandidate{entry.substr(0, colon), static_cast<uint16_t>(port)});
+        } catch (const std::exception&) {
+            continue;
+        }
+    }
+    return out;
+}
+
+static bool to_sockaddr(const PathCandidate& c, sockaddr_in& out) {
+    out = sockaddr_in{};
+    out.sin_family = AF_INET;
+    out.sin_port = htons(c.port);
+    return inet_pton(AF_INET, c.ip.c_str(), &out.sin_addr) == 1;
+}
+
+static bool same_endpoint(const sockaddr_in& a, const sockaddr_in& b) {
+    return a.sin_addr.s_addr == b.sin_addr.s_addr && a.sin_port == b.sin_port;
+}
+
+bool RendezvousClient::initialize(const std::string& server, int listening_socket, const Announcement& announcement,
+                                  std::function<std::string()> local_ip_fn) {
+    std::string host = server;
+    std::string port = std::to_string(RENDEZVOUS_PORT);
+    size_t colon = server.rfind(':');
+    if (colon != std::string::npos) {
+        host = server.substr(0, colon);
+        port = server.substr(colon + 1);
+    }
+
+    addrinfo hints{};
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_DGRAM;
+    addrinfo* result = nullptr;
+    if (getaddrinfo(host.c_str(), port.c_str(), &hints, &result) != 0 || !result) {
+        std::cerr << "Cannot resolve rendezvous server " << server << std::endl;
+        return false;
+    }
+    memcpy(&server_addr, result->ai_addr, sizeof(server_addr));
+    freeaddrinfo(result);
+
+    sock = listening_socket;
+    self = announcement;
+    self.ttl = 3 * RENDEZVOUS_INTERVAL_S;
+    local_ip = std::move(local_ip_fn);
+    return true;
+}
+
+void RendezvousClient::start() {
+    if (running.exchange(true)) return;
+    worker = std::thread(&RendezvousClient::loop, this);
+}
+
+void RendezvousClient::stop() {
+    if (!running.exchange(false)) return;
+    wake_cv.notify_all();
+    if (worker.joinable()) worker.join();
+    sendRegistration(true);
+}
+
+RendezvousClient::~RendezvousClient() {
+    stop();
+}
+
+void RendezvousClient::relayTo(const std::string& peer_key) {
+    {
+        std::lock_guard<std::mutex> lock(wake_mutex);
+        relay_peer = peer_key;
+    }
+    wake_cv.notify_all(); // the route has to be up before our first relayed datagram
+}
+
+PathCandidate RendezvousClient::relayAddress() const {
+    char ip[INET_ADDRSTRLEN];
+    inet_ntop(AF_INET, &server_addr.sin_addr, ip, sizeof(ip));
+    return PathCandidate{ip, ntohs(server_addr.sin_port)};
+}
+
+void RendezvousClient::sendRegistration(bool goodbye) {
+    Announcement a = self;
+    a.ip = local_ip();
+    a.goodbye = goodbye;
+    std::string message = format_announcement(a);
+    sendto(sock, message.c_str(), message.size(), 0, (const sockaddr*)&server_addr, sizeof(server_addr));
+}
+
+void RendezvousClient::loop() {
+    apply_thread_policy(ThreadRole::BACKGROUND, "rendezvous");
+    std::unique_lock<std::mutex> lock(wake_mutex);
+    std::string requested; // relay peer as of the last request
+    while (running) {
+        std::string peer = relay_peer;
+        lock.unlock();
+        sendRegistration(false);
+        if (!peer.empty()) {
+            std::string request = format_relay_request(self.key, peer);
+            sendto(sock, request.c_str(), request.size(), 0, (const sockaddr*)&server_addr, sizeof(server_addr));
+        }
+        lock.lock();
+        requested = peer;
+        wake_cv.wait_for(lock, std::chrono::seconds(RENDEZVOUS_INTERVAL_S),
+                         [&] { return !running || relay_peer != requested; });
+    }
+}
+
+static size_t write_probe(uint8_t* out, uint8_t type, uint32_t id, int64_t clock_us) {
+    MediaHeader hdr;
+    hdr.type = MEDIA_KIND_CONTROL;
+    hdr.frame_size = PROBE_SIZE;
+    write_media_header(out, hdr);
+    uint8_t* p = out + MEDIA_HEADER_SIZE;
+    memset(p, 0, PROBE_SIZE);
+    p[0] = type;
+    uint32_t id_be = htonl(id);
+    uint32_t hi = htonl(static_cast<uint32_t>(static_cast<uint64_t>(clock_us) >> 32));
+    uint32_t lo = htonl(static_cast<uint32_t>(clock_us));
+    memcpy(p + 4, &id_be, 4);
+    memcpy(p + 8, &hi, 4);
+    memcpy(p + 12, &lo, 4);
+    return MEDIA_HEADER_SIZE + PROBE_SIZE;
+}
+
+bool select_path(int sock, const std::vector<PathCandidate>& candidates, const PathCandidate* relay, int timeout_ms,
+                 PathChoice& out) {
+    std::vector<sockaddr_in> targets;
+    std::vector<PathCandidate> usable;
+    for (const auto& c : candidates) {
+        sockaddr_in addr;
+        if (!to_sockaddr(c, addr)) continue;
+        targets.push_back(addr);
+        usable.push_back(c);
+    }
+    sockaddr_in relay_addr{};
+    bool have_relay = relay && to_sockaddr(*relay, relay_addr);
+
+    const int64_t start = media_clock_us();
+    const int64_t deadline = start + int64_t(timeout_ms) * 1000;
+    int64_t next_probe = start;
+    int64_t settle_at = -1;
+    std::vector<int64_t> rtt(targets.size(), -1);
+    uint8_t buffer[2048];
+
+    auto finish = [&](PathChoice choice) {
+        out = choice;
+        path_check_time.observe(media_clock_us() - start);
+        return true;
+    };
+
+    while (true) {
+        int64_t now = media_clock_us();
+        if (settle_at >= 0 && now >= settle_at) {
+            size_t best = std::min_element(rtt.begin(), rtt.end(), [](int64_t a, int64_t b) {
+                return a >= 0 && (b < 0 || a < b);
+            }) - rtt.begin();
+            return finish(PathChoice{usable[best].ip, usable[best].port, rtt[best], false});
+        }
+        if (now >= deadline) return false;
+
+        if (now >= next_probe) {
+            for (size_t i = 0; i < targets.size(); i++) {
+                size_t len = write_probe(buffer, CONTROL_PROBE, i, now);
+                sendto(sock, buffer, len, 0, (const sockaddr*)&targets[i], sizeof(targets[i]));
+                probes_sent.inc();
+            }
+            next_probe = now + PROBE_INTERVAL_MS * 1000;
+        }
+
+        int64_t wake = std::min(next_probe, settle_at >= 0 ? std::min(settle_at, deadline) : deadline);
+        pollfd pfd{sock, POLLIN, 0};
+        poll(&pfd, 1, static_cast<int>(std::max<int64_t>(0, (wake - now + 999) / 1000)));
+
+        sockaddr_in from{};
+        socklen_t from_len = sizeof(from);
+        ssize_t n;
+        while ((n = recvfrom(sock, buffer, sizeof(buffer), MSG_DONTWAIT, (sockaddr*)&from, &from_len)) > 0) {
+            from_len = sizeof(from);
+            MediaHeader hdr;
+            if (!read_media_header(buffer, n, hdr) || hdr.type != MEDIA_KIND_CONTROL ||
+                static_cast<size_t>(n) <= MEDIA_HEADER_SIZE) {
+                continue;
+            }
+            const uint8_t* p = buffer + MEDIA_HEADER_SIZE;
+            size_t len = n - MEDIA_HEADER_SIZE;
+
+            if (p[0] == CONTROL_KEY_TYPE && !(hdr.flags & MEDIA_FLAG_ENCRYPTED)) {
+                // The peer settled on a path and started its call: reply along it
+                bool via_relay = have_relay && same_endpoint(from, relay_addr);
+                bool listed = std::any_of(targets.begin(), targets.end(),
+                                          [&](const sockaddr_in& t) { return same_endpoint(from, t); });
+                if (!via_relay && !listed) {
+                    keys_ignored.inc();
+                    continue;
+                }
+                char ip[INET_ADDRSTRLEN];
+                inet_ntop(AF_INET, &from.sin_addr, ip, sizeof(ip));
+                return finish(PathChoice{ip, ntohs(from.sin_port), -1, via_relay});
+            }
+            if (len < PROBE_SIZE) continue;
+            if (p[0] == CONTROL_PROBE) {
+                // Echo id and clock straight back; that is all the peer needs
+                memcpy(buffer + MEDIA_HEADER_SIZE, p, PROBE_SIZE);
+                buffer[MEDIA_HEADER_SIZE] = CONTROL_PROBE_REPLY;
+                sendto(sock, buffer, MEDIA_HEADER_SIZE + PROBE_SIZE, 0, (const sockaddr*)&from, sizeof(from));
+            } else if (p[0] == CONTROL_PROBE_REPLY) {
+                uint32_t id, hi, lo;
+                memcpy(&id, p + 4, 4);
+                memcpy(&hi, p + 8, 4);
+                memcpy(&lo, p + 12, 4);
+                id = ntohl(id);
+                int64_t sent = static_cast<int64_t>(static_cast<uint64_t>(ntohl(hi)) << 32 | ntohl(lo));
+                int64_t sample = media_clock_us() - sent;
+                if (id >= rtt.size() || !same_endpoint(from, targets[id]) || sample < 0 ||
+                    sample > int64_t(timeout_ms) * 1000) {
+                    continue;
+                }
+                probe_replies.inc();
+                if (rtt[id] < 0 || sample < rtt[id]) rtt[id] = sample;
+                if (settle_at < 0) settle_at = media_clock_us() + SETTLE_MS * 1000;
+            }
+        }
+    }
+}
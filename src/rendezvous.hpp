@@ -0,0 +1,100 @@
+#ifndef RENDEZVOUS_HPP
+#define RENDEZVOUS_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <netinet/in.h>
+
+#include "discovery.hpp"
+
+struct PathCandidate {
+    std::string ip;
+    uint16_t port = 0;
+};
+
+// "<ip>:<port>+<ip>:<port>" from a rendezvous peer listing; malformed entries are skipped
+std::vector<PathCandidate> parse_candidates(const std::string& list);
+
+struct PathChoice {
+    std::string ip;
+    uint16_t port = 0;
+    int64_t rtt_us = -1;  // -1: adopted from the peer's own choice, not measured
+    bool relayed = false; // through the rendezvous daemon
+};
+
+/*
+  Client side of gopherd's rendezvous mode (discovery.hpp). Registers
+  every RENDEZVOUS_INTERVAL_S from the listening socket, which keeps our
+  NAT mapping for it open and current, and renews the relay request while
+  relayTo() names a peer. Only ever sends on the socket, so it runs
+  alongside a call's receiver.
+*/
+class RendezvousClient {
+public:
+    // server: "host" or "host:port"; self: our announcement (ip is refreshed from local_ip_fn)
+    bool initialize(const std::string& server, int listening_socket, const Announcement& self,
+                    std::function<std::string()> local_ip_fn);
+    void start();
+    // Sends a goodbye
+    void stop();
+    // Ask the daemon to forward our media to the peer with this identity key; "" stops asking
+    void relayTo(const std::string& peer_key);
+    // Where to send media for the daemon to relay
+    PathCandidate relayAddress() const;
+    ~RendezvousClient();
+
+private:
+    int sock = -1; // not owned
+    sockaddr_in server_addr{};
+    Announcement self;
+    std::function<std::string()> local_ip;
+
+    std::thread worker;
+    std::atomic<bool> running{false};
+    std::mutex wake_mutex; // also guards relay_peer
+    std::condition_variable wake_cv;
+    std::string relay_peer;
+
+    void loop();
+    void sendRegistration(bool goodbye);
+};
+
+/*
+  Connectivity checks against a peer's candidates, on the listening socket
+  while no receiver reads it. Probes are plaintext MEDIA_KIND_CONTROL
+  datagrams, 16 byte payload:
+
+    0 u8 CONTROL_PROBE or CONTROL_PROBE_REPLY  1..3 0  4 u32 candidate index  8 i64 sender clock
+
+  Every PROBE_INTERVAL_MS each candidate gets a probe, and probes from the
+  peer are answered, which also opens our NAT towards it. Once a candidate
+  replies the others get SETTLE_MS to do the same, and the lowest RTT wins.
+  A peer that finished its checks first is already sending KEY datagrams
+  (media_crypto.hpp) and no longer answers. Its first KEY ends the checks,
+  and its source address becomes our path, or the relay if it arrived
+  through the daemon.
+
+  KEY and probe replies are not authenticated, so they only count from
+  where the peer can be: a KEY from one of its listed candidates or the
+  relay, a reply from the candidate that was probed. Anything else on the
+  socket cannot end the checks or steer the call elsewhere. Media itself
+  is sealed, so a spoofed source address can at worst stall the call.
+
+  Returns false if nothing worked within timeout_ms.
+*/
+constexpr uint8_t CONTROL_PROBE = 5;       // 1-4: MediaCrypto::CONTROL_KEY and the ControlChannel messages
+constexpr uint8_t CONTROL_PROBE_REPLY = 6;
+constexpr int PROBE_INTERVAL_MS = 50;
+constexpr int SETTLE_MS = 150;
+constexpr int PATH_CHECK_TIMEOUT_MS = 15000;
+
+bool select_path(int sock, const std::vector<PathCandidate>& candidates, const PathCandidate* relay,
+                 int timeout_ms, PathChoice& out);
+
+#endif // RENDEZVOUS_HPP
@@ -0,0 +1,117 @@
+/*
+  gopher_replay - feed a captured receive trace (gopher_client --trace DIR)
+  through the real receiver path: fragment reassembly, video decode and the
+  audio jitter buffer/PLC. Arrival times come from the trace, so two runs of
+  the same trace see the same losses, reordering and jitter and can be
+  compared directly before and after a receiver change.
+
+    gopher_replay TRACE [--speed realtime|max] [--loop N]
+
+  realtime paces datagrams at their captured arrival times; max feeds them
+  as fast as the receiver takes them (decode throughput).
+*/
+#include <iostream>
+#include <string>
+#include <thread>
+#include <chrono>
+#include <cstdio>
+#include <algorithm>
+
+#include "net_trace.hpp"
+#include "ffmpeg_receiver.hpp"
+#include "display_scheduler.hpp"
+#include "audio_common.hpp"
+
+int main(int argc, char* argv[]) {
+    if (argc < 2) {
+        std::cerr << "Usage: gopher_replay TRACE [--speed realtime|max] [--loop N]" << std::endl;
+        return 1;
+    }
+    std::string path = argv[1];
+    bool realtime = false;
+    int loops = 1;
+    for (int i = 2; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--speed" && i + 1 < argc) realtime = std::string(argv[++i]) == "realtime";
+        if (arg == "--loop" && i + 1 < argc) loops = std::max(1, std::stoi(argv[++i]));
+    }
+
+    TraceReader trace;
+    if (!trace.open(path)) {
+        std::cerr << "Cannot read trace " << path << std::endl;
+        return 1;
+    }
+
+    FFmpegReceiver receiver;
+    if (!receiver.initializeReplay()) return 1;
+    AudioReceiver* audio = receiver.audioPlayout();
+
+    uint64_t datagrams = 0;
+    uint64_t bytes = 0;
+    int64_t trace_us = 0;
+    auto wall_start = std::chrono::steady_clock::now();
+
+    TraceReader::Record record;
+    for (int loop = 0; loop < loops; loop++) {
+        trace.rewind();
+        // Later loops continue on the same timeline, so the receiver sees one long call
+        int64_t offset = trace_us;
+        int64_t first_us = trace.startUs();
+        int64_t next_audio_us = -1;
+        int64_t next_refresh_us = -1;
+        auto loop_start = std::chrono::steady_clock::now();
+
+        while (trace.next(record)) {
+            int64_t arrival_us = offset + record.arrival_us - first_us;
+            if (realtime) {
+                std::this_thread::sleep_until(loop_start + std::chrono::microseconds(arrival_us - offset));
+            }
+
+            // Audio playout runs on trace time, one 20 ms slot at a time
+            if (audio) {
+                if (next_audio_us < 0) next_audio_us = arrival_us;
+                while (next_audio_us <= arrival_us) {
+                    audio->playoutStep(false);
+                    next_audio_us += AUDIO_FRAME_MS * 1000;
+                }
+            }
+
+            // So does the display's refresh; A/V sync only means something in real time
+            if (next_refresh_us < 0) next_refresh_us = arrival_us;
+            while (next_refresh_us <= arrival_us) {
+                DisplayFrame frame;
+                display_scheduler().next(frame, realtime);
+                next_refresh_us += 1000000 / DEFAULT_REFRESH_HZ;
+            }
+
+            receiver.handleDatagram(record.data.data(), record.data.size(), arrival_us);
+            trace_us = arrival_us;
+            datagrams++;
+            bytes += record.data.size();
+        }
+    }
+    DisplayScheduler::Stats display = display_scheduler().stats();
+
+    double wall_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - wall_start).count();
+    double trace_s = trace_us / 1e6;
+    uint64_t decoded = receiver.frames_decoded.load();
+
+    std::printf("trace      %s\n", path.c_str());
+    std::printf("datagrams  %llu (%.1f MB)\n", (unsigned long long)datagrams, bytes / 1e6);
+    std::printf("frames     %llu completed, %llu expired, %llu decoded\n",
+                (unsigned long long)receiver.frames_completed.load(),
+                (unsigned long long)receiver.frames_expired.load(), (unsigned long long)decoded);
+    std::printf("display    %llu presented, %llu dropped as stale, %llu overflowed\n",
+                (unsigned long long)display.presented, (unsigned long long)display.dropped,
+                (unsigned long long)display.overflow);
+    std::printf("decode     %.2f ms/frame\n", decoded ? receiver.decode_ns.load() / 1e6 / decoded : 0.0);
+    if (audio) {
+        std::printf("audio      %llu played, %llu concealed, %llu late\n",
+                    (unsigned long long)audio->frames_played.load(),
+                    (unsigned long long)audio->frames_concealed.load(),
+                    (unsigned long long)audio->late_packets.load());
+    }
+    std::printf("time       %.2f s trace, %.2f s wall (%.1fx)\n", trace_s, wall_s,
+                wall_s > 0 ? trace_s / wall_s : 0.0);
+    return 0;
+}
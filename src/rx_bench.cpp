@@ -0,0 +1,175 @@
+/*
+  gopher_rx_bench - blast media datagrams at a loopback socket and compare
+  the receive backends (recvfrom vs io_uring) at high packet rates:
+  delivered rate, loss, receiver CPU per datagram and context switches.
+
+    gopher_rx_bench [--packets N] [--rate pps] [--backend recvfrom|io_uring|both]
+
+  --rate 0 (the default) sends as fast as the sender can.
+*/
+#include <iostream>
+#include <string>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <vector>
+#include <sys/socket.h>
+#include <sys/resource.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+
+#include "media_packet.hpp"
+#include "media_rx.hpp"
+
+struct RxResult {
+    uint64_t received = 0;
+    double seconds = 0;
+    double cpu_seconds = 0;
+    long context_switches = 0;
+    std::string backend;
+};
+
+static double thread_cpu_seconds() {
+    timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static long thread_context_switches() {
+#ifdef RUSAGE_THREAD
+    rusage ru;
+    getrusage(RUSAGE_THREAD, &ru);
+    return ru.ru_nvcsw + ru.ru_nivcsw;
+#else
+    return 0;
+#endif
+}
+
+// Fragments of 60 KB frames, back to back, like a keyframe-heavy stream
+static void send_stream(const sockaddr_in& dest, uint64_t packets, uint64_t rate) {
+    int sock = socket(AF_INET, SOCK_DGRAM, 0);
+    const size_t frame_size = 60000;
+    std::vector<uint8_t> datagram(MEDIA_HEADER_SIZE + MEDIA_MAX_PAYLOAD, 0xab);
+
+    MediaHeader hdr;
+    hdr.type = MEDIA_KIND_VIDEO;
+    hdr.frame_size = frame_size;
+
+    auto start = std::chrono::steady_clock::now();
+    for (uint64_t i = 0; i < packets; i++) {
+        hdr.frag_offset = (i * MEDIA_MAX_PAYLOAD) % frame_size;
+        if (hdr.frag_offset == 0) hdr.seq++;
+        size_t len = std::min(MEDIA_MAX_PAYLOAD, frame_size - hdr.frag_offset);
+        write_media_header(datagram.data(), hdr);
+        sendto(sock, datagram.data(), MEDIA_HEADER_SIZE + len, 0, (const sockaddr*)&dest, sizeof(dest));
+
+        if (rate && i % 64 == 63) {
+            std::this_thread::sleep_until(start + std::chrono::microseconds((i + 1) * 1000000 / rate));
+        }
+    }
+    close(sock);
+}
+
+static RxResult run_backend(bool io_uring, uint64_t packets, uint64_t rate) {
+    int sock = socket(AF_INET, SOCK_DGRAM, 0);
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    bind(sock, (sockaddr*)&addr, sizeof(addr));
+    socklen_t len = sizeof(addr);
+    getsockname(sock, (sockaddr*)&addr, &len);
+
+    int rcvbuf = 8 * 1024 * 1024;
+    setsockopt(sock, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+    timeval timeout{0, 200000};
+    setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+    MediaRx rx;
+    rx.initialize(sock, io_uring);
+
+    RxResult result;
+    std::atomic<bool> running{true};
+    std::atomic<uint64_t> received{0};
+    std::vector<uint8_t> frame(65536);
+
+    std::thread receiver([&] {
+        double cpu_start = thread_cpu_seconds();
+        long switches_start = thread_context_switches();
+        // Same work per datagram as the real receiver: parse, place the payload
+        rx.run(running, [&](const uint8_t* data, size_t n) {
+            MediaHeader h;
+            if (!read_media_header(data, n, h)) return;
+            size_t payload = n - MEDIA_HEADER_SIZE;
+            if (h.frag_offset + payload <= frame.size()) {
+                memcpy(frame.data() + h.frag_offset, data + MEDIA_HEADER_SIZE, payload);
+            }
+            received.fetch_add(1, std::memory_order_relaxed);
+        });
+        result.cpu_seconds = thread_cpu_seconds() - cpu_start;
+        result.context_switches = thread_context_switches() - switches_start;
+    });
+
+    // Let the backend come up before the first datagram
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    auto start = std::chrono::steady_clock::now();
+    send_stream(addr, packets, rate);
+
+    // Done once nothing has arrived for a while
+    uint64_t last = 0;
+    auto last_change = std::chrono::steady_clock::now();
+    while (true) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        uint64_t now_received = received.load();
+        if (now_received != last) {
+            last = now_received;
+            last_change = std::chrono::steady_clock::now();
+        } else if (now_received >= packets ||
+                   std::chrono::steady_clock::now() - last_change > std::chrono::milliseconds(300)) {
+            break;
+        }
+    }
+    result.seconds = std::chrono::duration<double>(last_change - start).count();
+    running = false;
+    receiver.join();
+
+    result.received = received.load();
+    result.backend = rx.backendName();
+    close(sock);
+    return result;
+}
+
+int main(int argc, char* argv[]) {
+    uint64_t packets = 2000000;
+    uint64_t rate = 0;
+    std::string backend = "both";
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--packets" && i + 1 < argc) packets = std::stoull(argv[++i]);
+        else if (arg == "--rate" && i + 1 < argc) rate = std::stoull(argv[++i]);
+        else if (arg == "--backend" && i + 1 < argc) backend = argv[++i];
+    }
+
+    std::vector<bool> runs;
+    if (backend == "recvfrom" || backend == "both") runs.push_back(false);
+    if (backend == "io_uring" || backend == "both") runs.push_back(true);
+#ifndef GOPHER_HAVE_IO_URING
+    std::cout << "Built without liburing; io_uring runs fall back to recvfrom" << std::endl;
+#endif
+
+    printf("%-9s %10s %10s %7s %12s %12s %10s\n",
+           "backend", "sent", "received", "loss %", "kpps", "cpu ns/dgram", "ctx sw");
+    for (bool io_uring : runs) {
+        RxResult r = run_backend(io_uring, packets, rate);
+        double loss = packets ? 100.0 * (packets - std::min(packets, r.received)) / packets : 0;
+        double kpps = r.seconds > 0 ? r.received / r.seconds / 1000 : 0;
+        double ns = r.received ? r.cpu_seconds * 1e9 / r.received : 0;
+        printf("%-9s %10llu %10llu %7.2f %12.0f %12.0f %10ld\n", r.backend.c_str(),
+               (unsigned long long)packets, (unsigned long long)r.received, loss, kpps, ns,
+               r.context_switches);
+    }
+    return 0;
+}
@@ -0,0 +1,313 @@
+#include "stream_recorder.hpp"
+#include "thread_policy.hpp"
+
+#include <iostream>
+#include <vector>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+
+// Recording should stay a rounding error next to capture + encode
+constexpr double RECORDER_CPU_BUDGET_PERCENT = 3.0;
+
+static int64_t thread_cpu_ns() {
+    timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+// SPS and PPS NAL units (with start codes) from an Annex B keyframe, for avcC
+static std::vector<uint8_t> h264_parameter_sets(const uint8_t* data, size_t size) {
+    auto next_start = [&](size_t from) {
+        for (size_t i = from; i + 3 <= size; i++) {
+            if (data[i] == 0 && data[i + 1] == 0 && data[i + 2] == 1) return i;
+        }
+        return size;
+    };
+
+    std::vector<uint8_t> out;
+    size_t start = next_start(0);
+    while (start < size) {
+        size_t nal = start + 3;
+        size_t end = next_start(nal);
+        size_t nal_end = end;
+        while (nal_end > nal && data[nal_end - 1] == 0) nal_end--; // next 4-byte start code
+        if (nal < nal_end) {
+            int type = data[nal] & 0x1f;
+            if (type == 7 || type == 8) {
+                const uint8_t start_code[4] = {0, 0, 0, 1};
+                out.insert(out.end(), start_code, start_code + 4);
+                out.insert(out.end(), data + nal, data + nal_end);
+            }
+        }
+        start = end;
+    }
+    return out;
+}
+
+// RFC 7845 identification header; MP4 needs it for the dOps box
+static std::vector<uint8_t> opus_head(int channels, int sample_rate, int pre_skip) {
+    std::vector<uint8_t> head = {'O', 'p', 'u', 's', 'H', 'e', 'a', 'd', 1, (uint8_t)channels,
+                                 (uint8_t)(pre_skip & 0xff), (uint8_t)((pre_skip >> 8) & 0xff)};
+    for (int i = 0; i < 4; i++) head.push_back((sample_rate >> (8 * i)) & 0xff);
+    head.insert(head.end(), {0, 0, 0}); // gain, mapping family 0
+    return head;
+}
+
+static void set_extradata(AVCodecParameters* par, const std::vector<uint8_t>& data) {
+    par->extradata = (uint8_t*)av_mallocz(data.size() + AV_INPUT_BUFFER_PADDING_SIZE);
+    memcpy(par->extradata, data.data(), data.size());
+    par->extradata_size = data.size();
+}
+
+bool StreamRecorder::open(const std::string& path, bool with_audio) {
+    this->path = path;
+    this->with_audio = with_audio;
+    // The muxer only starts at the first keyframe; find out now whether the file can be written
+    if (avio_open(&io, path.c_str(), AVIO_FLAG_WRITE) < 0) {
+        std::cerr << "Failed to open " << path << " for recording" << std::endl;
+        return false;
+    }
+    opened_at = std::chrono::steady_clock::now();
+    running = true;
+    writer = std::thread(&StreamRecorder::run, this);
+    std::cout << "Recording to " << path << std::endl;
+    return true;
+}
+
+void StreamRecorder::setAudioPreSkip(int samples) {
+    audio_pre_skip.store(samples, std::memory_order_relaxed);
+}
+
+void StreamRecorder::setVideoSize(int width, int height) {
+    video_width.store(width, std::memory_order_relaxed);
+    video_height.store(height, std::memory_order_relaxed);
+}
+
+void StreamRecorder::writePacket(uint8_t kind, VideoCodec codec, const AVPacket* pkt, int64_t pts_us) {
+    auto t0 = std::chrono::steady_clock::now();
+    AVPacket* ref = av_packet_clone(pkt); // shares the encoder's buffer
+    if (ref) enqueue(kind, codec, ref, pts_us);
+    producer_ns += std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - t0).count();
+}
+
+void StreamRecorder::writeData(uint8_t kind, VideoCodec codec, const uint8_t* data, size_t size,
+                               int64_t pts_us, bool keyframe) {
+    auto t0 = std::chrono::steady_clock::now();
+    AVPacket* pkt = av_packet_alloc();
+    if (av_new_packet(pkt, size) >= 0) {
+        memcpy(pkt->data, data, size);
+        if (keyframe) pkt->flags |= AV_PKT_FLAG_KEY;
+        enqueue(kind, codec, pkt, pts_us);
+    } else {
+        av_packet_free(&pkt);
+    }
+    producer_ns += std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - t0).count();
+}
+
+void StreamRecorder::enqueue(uint8_t kind, VideoCodec codec, AVPacket* pkt, int64_t pts_us) {
+    bool is_video = kind == MEDIA_KIND_VIDEO;
+    bool key = pkt->flags & AV_PKT_FLAG_KEY;
+    {
+        std::lock_guard<std::mutex> lock(queue_mutex);
+        if (is_video && need_keyframe && !key) {
+            pkt = nullptr;
+        } else if (!running || queued_bytes + pkt->size > MAX_QUEUED_BYTES) {
+            // Writer is behind (slow disk): drop rather than stall the call, and
+            // resume video only where a decoder could
+            if (is_video) need_keyframe = true;
+            pkt = nullptr;
+        } else {
+            if (is_video) need_keyframe = false;
+            queued_bytes += pkt->size;
+            queue.push_back(Queued{kind, codec, pkt, pts_us});
+        }
+    }
+    if (!pkt) {
+        packets_dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    queue_cv.notify_one();
+}
+
+bool StreamRecorder::openMuxer(VideoCodec codec, const AVPacket* keyframe, bool audio_track) {
+    if (avformat_alloc_output_context2(&fmt_ctx, nullptr, "mp4", path.c_str()) < 0) return false;
+
+    video_stream = avformat_new_stream(fmt_ctx, nullptr);
+    AVCodecParameters* vpar = video_stream->codecpar;
+    vpar->codec_type = AVMEDIA_TYPE_VIDEO;
+    vpar->codec_id = video_codec_id(codec);
+    vpar->width = video_width.load(std::memory_order_relaxed);
+    vpar->height = video_height.load(std::memory_order_relaxed);
+    video_stream->time_base = {1, 90000};
+    bool have_extradata = false;
+    if (codec == VideoCodec::H264) {
+        std::vector<uint8_t> sets = h264_parameter_sets(keyframe->data, keyframe->size);
+        if (!sets.empty()) {
+            set_extradata(vpar, sets);
+            have_extradata = true;
+        }
+    }
+
+    if (audio_track) {
+        audio_stream = avformat_new_stream(fmt_ctx, nullptr);
+        AVCodecParameters* apar = audio_stream->codecpar;
+        apar->codec_type = AVMEDIA_TYPE_AUDIO;
+        apar->codec_id = AV_CODEC_ID_OPUS;
+        apar->sample_rate = 48000;
+        av_channel_layout_default(&apar->ch_layout, 1);
+        set_extradata(apar, opus_head(1, 48000, audio_pre_skip.load(std::memory_order_relaxed)));
+        audio_stream->time_base = {1, 48000};
+    }
+
+    fmt_ctx->pb = io;
+    io = nullptr;
+
+    // Fragment per keyframe so a crash or full disk still leaves a playable file.
+    // Without up-front extradata the muxer takes it from the first fragment.
+    AVDictionary* opts = nullptr;
+    av_dict_set(&opts, "movflags", have_extradata ? "frag_keyframe+empty_moov+default_base_moof"
+                                                  : "frag_keyframe+delay_moov+default_base_moof", 0);
+    int ret = avformat_write_header(fmt_ctx, &opts);
+    av_dict_free(&opts);
+    if (ret < 0) {
+        std::cerr << "Cannot record " << codec_name(codec) << " to MP4" << std::endl;
+        return false;
+    }
+    recording_codec = codec;
+    return true;
+}
+
+void StreamRecorder::mux(Queued& item) {
+    if (failed) return;
+    if (fmt_ctx) {
+        write(item);
+        return;
+    }
+
+    bool is_video = item.kind == MEDIA_KIND_VIDEO;
+    if (!is_video) audio_seen = true;
+    // Audio before the first keyframe has no video to line up with
+    if (!is_video && held.empty()) return;
+    held.push_back(item);
+    item.pkt = nullptr; // held owns it now
+    if (!with_audio || audio_seen || held.back().pts_us - held.front().pts_us >= AUDIO_WAIT_US) openHeld();
+}
+
+// Opens the muxer at the held keyframe and writes everything held behind it
+void StreamRecorder::openHeld() {
+    Queued& first = held.front();
+    if (!openMuxer(first.codec, first.pkt, with_audio && audio_seen)) {
+        failed = true;
+    } else {
+        origin_us = first.pts_us;
+        for (auto& item : held) write(item);
+    }
+    for (auto& item : held) av_packet_free(&item.pkt);
+    held.clear();
+}
+
+void StreamRecorder::write(Queued& item) {
+    bool is_video = item.kind == MEDIA_KIND_VIDEO;
+    if (is_video && item.codec != recording_codec) {
+        if (!codec_switch_logged) {
+            std::cerr << "Codec changed mid-call, recording stops at the switch" << std::endl;
+            codec_switch_logged = true;
+        }
+        return;
+    }
+
+    AVStream* st = is_video ? video_stream : audio_stream;
+    if (!st) return;
+    int64_t ts = item.pts_us - origin_us;
+    if (ts < 0) return;
+
+    // MP4 needs strictly increasing timestamps per track
+    ts = av_rescale_q(ts, {1, 1000000}, st->time_base);
+    int64_t& last = is_video ? last_video_ts : last_audio_ts;
+    if (ts <= last) ts = last + 1;
+    last = ts;
+
+    int size = item.pkt->size;
+    item.pkt->pts = item.pkt->dts = ts;
+    item.pkt->duration = 0;
+    item.pkt->stream_index = st->index;
+    if (av_write_frame(fmt_ctx, item.pkt) >= 0) {
+        packets_written.fetch_add(1, std::memory_order_relaxed);
+        bytes_written.fetch_add(size, std::memory_order_relaxed);
+    }
+}
+
+void StreamRecorder::run() {
+    apply_thread_policy(ThreadRole::BACKGROUND, "recorder");
+    std::deque<Queued> batch;
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(queue_mutex);
+            queue_cv.wait(lock, [this] { return !queue.empty() || !running; });
+            if (queue.empty() && !running) break;
+            batch.swap(queue);
+            queued_bytes = 0;
+        }
+        // Muxing and disk I/O happen outside the lock
+        for (auto& item : batch) {
+            mux(item);
+            av_packet_free(&item.pkt);
+        }
+        batch.clear();
+        writer_cpu_ns = thread_cpu_ns();
+    }
+
+    // A call shorter than the audio wait
+    if (!held.empty() && !failed) openHeld();
+    if (io) {
+        // No keyframe ever arrived: nothing to keep
+        avio_closep(&io);
+        remove(path.c_str());
+    }
+    if (fmt_ctx) {
+        if (!failed) av_write_trailer(fmt_ctx);
+        if (fmt_ctx->pb) avio_closep(&fmt_ctx->pb);
+        avformat_free_context(fmt_ctx);
+        fmt_ctx = nullptr;
+    }
+    writer_cpu_ns = thread_cpu_ns();
+}
+
+void StreamRecorder::close() {
+    {
+        std::lock_guard<std::mutex> lock(queue_mutex);
+        if (!running) return;
+        running = false;
+    }
+    queue_cv.notify_one();
+    if (writer.joinable()) writer.join();
+
+    Stats s = stats();
+    double cpu_percent = s.wall_ms > 0 ? 100.0 * (s.writer_cpu_ms + s.producer_cpu_ms) / s.wall_ms : 0;
+    std::cout << "Recorded " << path << ": " << s.packets_written << " packets, "
+              << s.bytes_written / 1024 << " KB, " << s.packets_dropped << " dropped, "
+              << cpu_percent << "% CPU" << std::endl;
+    if (cpu_percent > RECORDER_CPU_BUDGET_PERCENT) {
+        std::cerr << "Recording used more than " << RECORDER_CPU_BUDGET_PERCENT
+                  << "% of a core" << std::endl;
+    }
+}
+
+StreamRecorder::Stats StreamRecorder::stats() const {
+    Stats s;
+    s.packets_written = packets_written.load(std::memory_order_relaxed);
+    s.bytes_written = bytes_written.load(std::memory_order_relaxed);
+    s.packets_dropped = packets_dropped.load(std::memory_order_relaxed);
+    s.writer_cpu_ms = writer_cpu_ns.load() / 1e6;
+    s.producer_cpu_ms = producer_ns.load() / 1e6;
+    s.wall_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - opened_at).count();
+    return s;
+}
+
+StreamRecorder::~StreamRecorder() {
+    close();
+    for (auto& item : queue) av_packet_free(&item.pkt);
+}
@@ -0,0 +1,120 @@
+#ifndef STREAM_RECORDER_HPP
+#define STREAM_RECORDER_HPP
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+
+extern "C" {
+#include <libavformat/avformat.h>
+#include <libavcodec/avcodec.h>
+}
+
+#include "video_codec.hpp"
+#include "media_packet.hpp"
+
+/*
+  Remuxes already-encoded call media (video plus Opus audio) into a
+  fragmented MP4, with no decode or re-encode. Producers hand packets over
+  with a reference or one memcpy. A writer thread does all muxing and disk
+  I/O behind a bounded queue. When the disk stalls and the queue fills,
+  packets are dropped (video until the next keyframe) instead of blocking
+  the call.
+
+  The file starts at the first video keyframe. A mid-call codec switch
+  ends the video track: packets in the new codec are dropped, since one
+  MP4 track cannot change codec. Tracks cannot be added once the header
+  is written, so when audio is expected the writer holds the first
+  AUDIO_WAIT_US of video back until an audio packet shows up; a peer that
+  never sends audio gets a video-only file instead of an empty Opus track.
+*/
+class StreamRecorder {
+public:
+    struct Stats {
+        uint64_t packets_written;
+        uint64_t bytes_written;
+        uint64_t packets_dropped;
+        double writer_cpu_ms;   // muxing + I/O on the writer thread
+        double producer_cpu_ms; // time spent handing packets over on the call's threads
+        double wall_ms;
+    };
+
+    // Creates the file; false (and nothing recorded) if it cannot be written.
+    // with_audio: audio may follow, add its track once it does.
+    bool open(const std::string& path, bool with_audio);
+    // Samples the Opus decoder must drop at the start (the encoder's initial_padding)
+    void setAudioPreSkip(int samples);
+    // Needed for the MP4 track header; call before the first keyframe is queued
+    void setVideoSize(int width, int height);
+    // Takes a reference to pkt's buffer (sender side)
+    void writePacket(uint8_t kind, VideoCodec codec, const AVPacket* pkt, int64_t pts_us);
+    // Copies data (receiver side, where the buffer is recycled)
+    void writeData(uint8_t kind, VideoCodec codec, const uint8_t* data, size_t size,
+                   int64_t pts_us, bool keyframe);
+    // Drains the queue and finalizes the file
+    void close();
+    Stats stats() const;
+    ~StreamRecorder();
+
+private:
+    struct Queued {
+        uint8_t kind;
+        VideoCodec codec;
+        AVPacket* pkt;
+        int64_t pts_us;
+    };
+
+    static constexpr size_t MAX_QUEUED_BYTES = 32 * 1024 * 1024;
+    static constexpr int64_t AUDIO_WAIT_US = 1000000;
+    // libopus's lookahead at 48 kHz, for streams whose encoder we cannot ask (the peer's)
+    static constexpr int OPUS_DEFAULT_PRE_SKIP = 312;
+
+    std::string path;
+    bool with_audio = false;
+    std::atomic<int> video_width{0};
+    std::atomic<int> video_height{0};
+    std::atomic<int> audio_pre_skip{OPUS_DEFAULT_PRE_SKIP};
+
+    std::deque<Queued> queue;
+    size_t queued_bytes = 0;
+    bool need_keyframe = true; // producer side: skip video until a decodable start
+    std::mutex queue_mutex;
+    std::condition_variable queue_cv;
+    std::thread writer;
+    bool running = false;
+
+    AVIOContext* io = nullptr; // opened by open(), handed to the muxer
+
+    // Writer thread only
+    std::deque<Queued> held; // from the first keyframe until the track layout is known
+    bool audio_seen = false;
+    AVFormatContext* fmt_ctx = nullptr;
+    AVStream* video_stream = nullptr;
+    AVStream* audio_stream = nullptr;
+    VideoCodec recording_codec = VideoCodec::H264;
+    bool failed = false;
+    bool codec_switch_logged = false;
+    int64_t origin_us = 0;
+    int64_t last_video_ts = -1;
+    int64_t last_audio_ts = -1;
+
+    std::atomic<uint64_t> packets_written{0};
+    std::atomic<uint64_t> bytes_written{0};
+    std::atomic<uint64_t> packets_dropped{0};
+    std::atomic<int64_t> writer_cpu_ns{0};
+    std::atomic<int64_t> producer_ns{0};
+    std::chrono::steady_clock::time_point opened_at;
+
+    void enqueue(uint8_t kind, VideoCodec codec, AVPacket* pkt, int64_t pts_us);
+    bool openMuxer(VideoCodec codec, const AVPacket* keyframe, bool audio_track);
+    void openHeld();
+    void mux(Queued& item);
+    void write(Queued& item);
+    void run();
+};
+
+#endif // STREAM_RECORDER_HPP
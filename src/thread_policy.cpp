@@ -0,0 +1,409 @@
+#include "thread_policy.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <set>
+#include <sstream>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/resource.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
+
+namespace {
+
+enum Side { ANY = 0, CAPTURE_SIDE = 1, RECEIVE_SIDE = 2 };
+
+struct RoleSpec {
+    const char* name;
+    int nice;   // relative to the process's own nice level
+    bool fifo;
+    Side side;
+};
+
+const RoleSpec& role_spec(ThreadRole role) {
+    static const RoleSpec specs[] = {
+        {"capture", -5, false, CAPTURE_SIDE},
+        {"receive", -5, false, RECEIVE_SIDE},
+        {"display", -5, false, ANY},
+        {"audio-capture", -10, true, CAPTURE_SIDE},
+        {"audio-playout", -10, true, RECEIVE_SIDE},
+        {"background", 0, false, ANY},
+    };
+    return specs[static_cast<int>(role)];
+}
+
+struct Usage {
+    double user = 0;
+    double system = 0;
+    uint64_t voluntary = 0;
+    uint64_t involuntary = 0;
+};
+
+struct Entry {
+    std::string name;
+    int tid = 0;
+    Usage base;        // at registration
+    bool running = true;
+    Usage total;       // since registration, once exited
+    std::string cpus;
+};
+
+constexpr size_t MAX_EXITED = 64; // oldest exited entries go first
+
+std::mutex policy_mutex;
+ThreadPolicy policy;
+bool sides_ready = false;
+std::vector<int> side_cpus[3];
+std::set<int> warned_roles;
+std::vector<Entry> entries;
+
+// Before main(), so it is the process's own, not a role's: threads inherit their creator's
+const int process_nice = getpriority(PRIO_PROCESS, 0);
+#ifdef __linux__
+cpu_set_t process_mask = [] {
+    cpu_set_t mask;
+    CPU_ZERO(&mask);
+    sched_getaffinity(0, sizeof(mask), &mask);
+    return mask;
+}();
+#endif
+
+int current_tid() {
+#ifdef __linux__
+    return static_cast<int>(syscall(SYS_gettid));
+#else
+    return 0;
+#endif
+}
+
+Usage own_usage() {
+    Usage u;
+#ifdef RUSAGE_THREAD
+    rusage ru{};
+    getrusage(RUSAGE_THREAD, &ru);
+    u.user = ru.ru_utime.tv_sec + ru.ru_utime.tv_usec / 1e6;
+    u.system = ru.ru_stime.tv_sec + ru.ru_stime.tv_usec / 1e6;
+    u.voluntary = ru.ru_nvcsw;
+    u.involuntary = ru.ru_nivcsw;
+#endif
+    return u;
+}
+
+Usage minus(const Usage& a, const Usage& b) {
+    Usage d;
+    d.user = std::max(0.0, a.user - b.user);
+    d.system = std::max(0.0, a.system - b.system);
+    d.voluntary = a.voluntary > b.voluntary ? a.voluntary - b.voluntary : 0;
+    d.involuntary = a.involuntary > b.involuntary ? a.involuntary - b.involuntary : 0;
+    return d;
+}
+
+// Another live thread's totals, from /proc/self/task/<tid>
+bool task_usage(int tid, Usage& u, int& cpu) {
+#ifdef __linux__
+    std::string dir = "/proc/self/task/" + std::to_string(tid);
+    std::ifstream stat(dir + "/stat");
+    std::string line;
+    if (!std::getline(stat, line)) return false;
+    size_t comm_end = line.rfind(')');
+    if (comm_end == std::string::npos) return false;
+    // Fields from the third (state) on; field n is f[n - 3]
+    std::istringstream rest(line.substr(comm_end + 1));
+    std::vector<std::string> f;
+    std::string field;
+    while (rest >> field) f.push_back(field);
+    if (f.size() < 37) return false;
+    const double tick = static_cast<double>(sysconf(_SC_CLK_TCK));
+    u.user = std::stoull(f[14 - 3]) / tick;
+    u.system = std::stoull(f[15 - 3]) / tick;
+    cpu = std::stoi(f[39 - 3]);
+
+    std::ifstream status(dir + "/status");
+    while (std::getline(status, line)) {
+        if (line.compare(0, 24, "voluntary_ctxt_switches:") == 0) u.voluntary = std::stoull(line.substr(24));
+        if (line.compare(0, 27, "nonvoluntary_ctxt_switches:") == 0) u.involuntary = std::stoull(line.substr(27));
+    }
+    return true;
+#else
+    (void)tid;
+    (void)u;
+    (void)cpu;
+    return false;
+#endif
+}
+
+std::string format_cpu_list(const std::vector<int>& cpus) {
+    std::string out;
+    for (size_t i = 0; i < cpus.size();) {
+        size_t j = i;
+        while (j + 1 < cpus.size() && cpus[j + 1] == cpus[j] + 1) j++;
+        if (!out.empty()) out += ",";
+        out += std::to_string(cpus[i]);
+        if (j > i) out += "-" + std::to_string(cpus[j]);
+        i = j + 1;
+    }
+    return out;
+}
+
+#ifdef __linux__
+// The CPUs sharing cpu's last level cache, as the kernel lists them; "" if unknown
+std::string l3_domain(int cpu) {
+    for (int index = 0; index < 8; index++) {
+        std::string dir = "/sys/devices/system/cpu/cpu" + std::to_string(cpu) + "/cache/index" +
+                          std::to_string(index);
+        std::ifstream level(dir + "/level");
+        int n = 0;
+        if (!(level >> n)) break;
+        if (n != 3) continue;
+        std::ifstream shared(dir + "/shared_cpu_list");
+        std::string list;
+        std::getline(shared, list);
+        return list;
+    }
+    return "";
+}
+#endif
+
+// Caller holds policy_mutex
+void compute_sides() {
+    if (sides_ready) return;
+    sides_ready = true;
+    if (!policy.pin) return;
+#ifdef __linux__
+    std::map<std::string, std::vector<int>> by_domain;
+    std::vector<int> allowed;
+    for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+        if (!CPU_ISSET(cpu, &process_mask)) continue;
+        allowed.push_back(cpu);
+        by_domain[l3_domain(cpu)].push_back(cpu);
+    }
+    std::vector<std::vector<int>> domains;
+    for (auto& d : by_domain) domains.push_back(d.second);
+    std::sort(domains.begin(), domains.end());
+
+    if (domains.size() >= 2) {
+        side_cpus[CAPTURE_SIDE] = domains[0];
+        side_cpus[RECEIVE_SIDE] = domains[1];
+    } else if (allowed.size() >= 2) {
+        // One L3 for all: at least keep the two pipelines off each other's cores
+        size_t half = allowed.size() / 2;
+        side_cpus[CAPTURE_SIDE].assign(allowed.begin(), allowed.begin() + half);
+        side_cpus[RECEIVE_SIDE].assign(allowed.begin() + half, allowed.end());
+    } else {
+        std::cerr << "[threads] One CPU available, not pinning" << std::endl;
+        return;
+    }
+    std::cout << "[threads] capture/encode on CPUs " << format_cpu_list(side_cpus[CAPTURE_SIDE])
+              << ", receive/decode on CPUs " << format_cpu_list(side_cpus[RECEIVE_SIDE])
+              << (domains.size() >= 2 ? " (separate L3 domains)" : " (shared L3)") << std::endl;
+#else
+    std::cerr << "[threads] CPU pinning is only supported on Linux" << std::endl;
+#endif
+}
+
+void set_name(const char* name) {
+#if defined(__APPLE__)
+    pthread_setname_np(name);
+#elif defined(__linux__)
+    // The kernel keeps 15 characters
+    pthread_setname_np(pthread_self(), std::string(name).substr(0, 15).c_str());
+#endif
+}
+
+// Caller holds policy_mutex. Returns the CPU list the thread was pinned to, "" if none.
+std::string place(const RoleSpec& spec) {
+#ifdef __linux__
+    compute_sides();
+    const std::vector<int>& cpus = side_cpus[spec.side];
+    if (spec.side == ANY || cpus.empty()) {
+        // Undo whatever a pinned creator passed down
+        sched_setaffinity(0, sizeof(process_mask), &process_mask);
+        return "";
+    }
+    cpu_set_t mask;
+    CPU_ZERO(&mask);
+    for (int cpu : cpus) CPU_SET(cpu, &mask);
+    if (sched_setaffinity(0, sizeof(mask), &mask) != 0) return "";
+    return format_cpu_list(cpus);
+#else
+    (void)spec;
+    return "";
+#endif
+}
+
+// Caller holds policy_mutex
+void prioritize(ThreadRole role, const RoleSpec& spec, int tid) {
+    if (!policy.priority) return;
+    if (spec.fifo) {
+        sched_param param{};
+        param.sched_priority = sched_get_priority_min(SCHED_FIFO) + 10;
+        if (pthread_setschedparam(pthread_self(), SCHED_FIFO, &param) == 0) return;
+    } else {
+        // A creator's SCHED_FIFO is inherited too
+        sched_param param{};
+        pthread_setschedparam(pthread_self(), SCHED_OTHER, &param);
+    }
+#ifdef __linux__
+    // Per-thread nice on Linux (needs CAP_SYS_NICE or RLIMIT_NICE to go below the process's)
+    if (setpriority(PRIO_PROCESS, tid, process_nice + spec.nice) == 0) return;
+#else
+    (void)tid;
+#endif
+    if (warned_roles.insert(static_cast<int>(role)).second && spec.nice < 0) {
+        std::cerr << "[threads] " << spec.name << ": running without raised priority (" << strerror(errno) << ")"
+                  << std::endl;
+    }
+}
+
+// Caller holds policy_mutex
+Entry& register_thread(const std::string& name, int tid, const std::string& cpus) {
+    size_t exited = std::count_if(entries.begin(), entries.end(), [](const Entry& e) { return !e.running; });
+    if (exited >= MAX_EXITED) {
+        entries.erase(std::find_if(entries.begin(), entries.end(), [](const Entry& e) { return !e.running; }));
+    }
+    Entry e;
+    e.name = name;
+    e.tid = tid;
+    e.base = own_usage();
+    e.cpus = cpus;
+    entries.push_back(std::move(e));
+    return entries.back();
+}
+
+void note_exit(int tid) {
+    Usage now = own_usage();
+    std::lock_guard<std::mutex> lock(policy_mutex);
+    for (auto& e : entries) {
+        if (e.tid == tid && e.running) {
+            e.running = false;
+            e.total = minus(now, e.base);
+        }
+    }
+}
+
+// Records a thread's totals as it exits, while getrusage can still see it
+struct ExitHook {
+    int tid = 0;
+    ~ExitHook() {
+        if (tid) note_exit(tid);
+    }
+};
+
+} // namespace
+
+void set_thread_policy(const ThreadPolicy& p) {
+    std::lock_guard<std::mutex> lock(policy_mutex);
+    policy = p;
+    sides_ready = false;
+    for (auto& cpus : side_cpus) cpus.clear();
+}
+
+void apply_thread_policy(ThreadRole role, const char* name) {
+    const RoleSpec& spec = role_spec(role);
+    const char* label = name ? name : spec.name;
+    int tid = current_tid();
+    set_name(label);
+    {
+        std::lock_guard<std::mutex> lock(policy_mutex);
+        prioritize(role, spec, tid);
+        register_thread(label, tid, place(spec));
+    }
+    thread_local ExitHook hook;
+    hook.tid = tid;
+}
+
+struct ThreadRoleScope::Saved {
+    char name[16] = {};
+    int nice = 0;
+    int sched_policy = SCHED_OTHER;
+    sched_param param{};
+#ifdef __linux__
+    cpu_set_t mask;
+#endif
+    int tid = 0;
+};
+
+ThreadRoleScope::ThreadRoleScope(ThreadRole role) : saved(new Saved) {
+    saved->tid = current_tid();
+#if defined(__linux__) || defined(__APPLE__)
+    pthread_getname_np(pthread_self(), saved->name, sizeof(saved->name));
+#endif
+    saved->nice = getpriority(PRIO_PROCESS, 0);
+    pthread_getschedparam(pthread_self(), &saved->sched_policy, &saved->param);
+#ifdef __linux__
+    sched_getaffinity(0, sizeof(saved->mask), &saved->mask);
+#endif
+
+    const RoleSpec& spec = role_spec(role);
+    set_name(spec.name);
+    std::lock_guard<std::mutex> lock(policy_mutex);
+    prioritize(role, spec, saved->tid);
+    register_thread(spec.name, saved->tid, place(spec));
+}
+
+ThreadRoleScope::~ThreadRoleScope() {
+    note_exit(saved->tid);
+    set_name(saved->name);
+    pthread_setschedparam(pthread_self(), saved->sched_policy, &saved->param);
+#ifdef __linux__
+    setpriority(PRIO_PROCESS, saved->tid, saved->nice);
+    sched_setaffinity(0, sizeof(saved->mask), &saved->mask);
+#endif
+    delete saved;
+}
+
+std::vector<ThreadStats> thread_stats() {
+    std::vector<Entry> snapshot;
+    {
+        std::lock_guard<std::mutex> lock(policy_mutex);
+        snapshot = entries;
+    }
+    std::vector<ThreadStats> out;
+    for (const auto& e : snapshot) {
+        ThreadStats s;
+        s.name = e.name;
+        s.tid = e.tid;
+        s.cpus = e.cpus;
+        Usage u = e.total;
+        if (e.running) {
+            Usage now;
+            if (task_usage(e.tid, now, s.last_cpu)) {
+                u = minus(now, e.base);
+            } else {
+                s.running = false; // gone without passing its exit hook
+            }
+        } else {
+            s.running = false;
+        }
+        s.user_seconds = u.user;
+        s.system_seconds = u.system;
+        s.voluntary_switches = u.voluntary;
+        s.involuntary_switches = u.involuntary;
+        out.push_back(std::move(s));
+    }
+    return out;
+}
+
+void print_thread_stats(std::ostream& out) {
+    char line[160];
+    snprintf(line, sizeof(line), "%-15s %7s %-7s %9s %9s %10s %10s %4s  %s", "thread", "tid", "state", "user s",
+             "sys s", "vol csw", "invol csw", "cpu", "pinned");
+    out << line << "\n";
+    for (const auto& s : thread_stats()) {
+        snprintf(line, sizeof(line), "%-15s %7d %-7s %9.2f %9.2f %10llu %10llu %4d  %s", s.name.c_str(), s.tid,
+                 s.running ? "running" : "exited", s.user_seconds, s.system_seconds,
+                 (unsigned long long)s.voluntary_switches, (unsigned long long)s.involuntary_switches, s.last_cpu,
+                 s.cpus.empty() ? "-" : s.cpus.c_str());
+        out << line << "\n";
+    }
+    out.flush();
+}
@@ -0,0 +1,79 @@
+#ifndef THREAD_POLICY_HPP
+#define THREAD_POLICY_HPP
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+enum class ThreadRole {
+    CAPTURE,       // camera, scaling and encode
+    RECEIVE,       // reassembly and decode
+    DISPLAY,       // presentation loop
+    AUDIO_CAPTURE,
+    AUDIO_PLAYOUT,
+    BACKGROUND,    // discovery, control, metrics, recording: named and measured only
+};
+
+struct ThreadPolicy {
+    // Keep capture/encode and receive/decode on separate L3 domains (CCXs), or on
+    // separate halves of our CPUs where there is only one
+    bool pin = false;
+    // SCHED_FIFO for audio, raised nice levels for the video threads, where permitted
+    bool priority = true;
+};
+
+/*
+  Threads say what they are with apply_thread_policy() as their first
+  statement. That names them (ps -L, top -H, perf), applies the process's
+  ThreadPolicy and registers them for thread_stats(). FFmpeg's codec
+  threads inherit the mask of the thread that opens the codec, so codecs
+  opened under a role run on its CPUs as well.
+
+    role           priority                     CPUs when pinned
+    capture        nice -5                      capture side
+    receive        nice -5                      receive side
+    display        nice -5                      any
+    audio-*        SCHED_FIFO, else nice -10    capture / receive side
+    background     nice 0                       any
+
+  Priority changes that need privileges (CAP_SYS_NICE or RLIMIT_RTPRIO /
+  RLIMIT_NICE) fall back or are skipped, with one message per role.
+*/
+
+// Call before the first media thread starts; the default is no pinning, priorities on
+void set_thread_policy(const ThreadPolicy& policy);
+// The calling thread, for the rest of its life; name defaults to the role's
+void apply_thread_policy(ThreadRole role, const char* name = nullptr);
+
+// A role for the current scope only, e.g. the main thread while it presents a call.
+// Name, nice level, scheduling class and CPU mask are restored afterwards.
+class ThreadRoleScope {
+public:
+    explicit ThreadRoleScope(ThreadRole role);
+    ~ThreadRoleScope();
+    ThreadRoleScope(const ThreadRoleScope&) = delete;
+    ThreadRoleScope& operator=(const ThreadRoleScope&) = delete;
+
+private:
+    struct Saved;
+    Saved* saved;
+};
+
+struct ThreadStats {
+    std::string name;
+    int tid = 0;
+    bool running = true;
+    double user_seconds = 0;
+    double system_seconds = 0;
+    uint64_t voluntary_switches = 0;   // blocked or yielded
+    uint64_t involuntary_switches = 0; // preempted: contention for its CPU
+    int last_cpu = -1;                 // -1 once exited
+    std::string cpus;                  // allowed CPUs, empty when not pinned
+};
+
+// Every thread that applied a role, counted from when it did; exited ones keep their totals
+std::vector<ThreadStats> thread_stats();
+void print_thread_stats(std::ostream& out);
+
+#endif // THREAD_POLICY_HPP
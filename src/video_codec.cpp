@@ -0,0 +1,313 @@
+#include "video_codec.hpp"
+
+#include <iostream>
+#include <sstream>
+#include <cstring>
+#include <algorithm>
+
+extern "C" {
+#include <libavutil/opt.h>
+}
+
+namespace {
+
+struct CodecInfo {
+    VideoCodec codec;
+    const char* name;
+    AVCodecID id;
+    // Encoders tried in order; first one present in this FFmpeg build wins
+    std::vector<const char*> encoders;
+    std::vector<const char*> decoders;
+};
+
+const std::vector<CodecInfo>& codec_table() {
+    static const std::vector<CodecInfo> table = {
+        {VideoCodec::H264, "h264", AV_CODEC_ID_H264, {"h264_videotoolbox", "libx264"}, {"h264"}},
+        {VideoCodec::VP8,  "vp8",  AV_CODEC_ID_VP8,  {"libvpx"},                       {"vp8", "libvpx"}},
+        {VideoCodec::VP9,  "vp9",  AV_CODEC_ID_VP9,  {"libvpx-vp9"},                   {"vp9", "libvpx-vp9"}},
+        {VideoCodec::AV1,  "av1",  AV_CODEC_ID_AV1,  {"libsvtav1", "libaom-av1"},      {"libdav1d", "libaom-av1", "av1"}},
+    };
+    return table;
+}
+
+const CodecInfo& info_for(VideoCodec codec) {
+    for (const auto& info : codec_table()) {
+        if (info.codec == codec) return info;
+    }
+    return codec_table().front();
+}
+
+bool is_hardware(const char* encoder_name) {
+    return strstr(encoder_name, "videotoolbox") != nullptr;
+}
+
+const AVCodec* find_encoder(const CodecSettings& settings) {
+    for (const char* name : info_for(settings.codec).encoders) {
+        if (!settings.allow_hardware && is_hardware(name)) continue;
+        if (const AVCodec* enc = avcodec_find_encoder_by_name(name)) return enc;
+    }
+    return nullptr;
+}
+
+const AVCodec* find_decoder(VideoCodec codec) {
+    for (const char* name : info_for(codec).decoders) {
+        if (const AVCodec* dec = avcodec_find_decoder_by_name(name)) return dec;
+    }
+    return avcodec_find_decoder(info_for(codec).id);
+}
+
+// Per-encoder real-time options. Presets are the encoder's own speed knob.
+void set_realtime_options(const AVCodec* encoder, const CodecSettings& s, AVCodecContext* ctx,
+                          AVDictionary** opts) {
+    const std::string name = encoder->name;
+
+    if (name == "h264_videotoolbox") {
+        av_dict_set(opts, "realtime", "1", 0);
+        av_dict_set(opts, "quality", "0.5", 0);
+    } else if (name == "libx264") {
+        av_dict_set(opts, "preset", s.preset.empty() ? "ultrafast" : s.preset.c_str(), 0);
+        av_dict_set(opts, "tune", s.tune.empty() ? "zerolatency" : s.tune.c_str(), 0);
+        av_dict_set(opts, "forced-idr", "1", 0); // forced I frames become IDRs
+    } else if (name == "libvpx" || name == "libvpx-vp9") {
+        // Real-time deadline with no lookahead; cpu-used trades quality for speed
+        av_dict_set(opts, "deadline", "realtime", 0);
+        av_dict_set(opts, "cpu-used", s.preset.empty() ? "8" : s.preset.c_str(), 0);
+        av_dict_set(opts, "lag-in-frames", "0", 0);
+        av_dict_set(opts, "error-resilient", "1", 0);
+        // CBR-ish behaviour so a single frame cannot blow the link budget
+        ctx->rc_max_rate = s.bit_rate;
+        ctx->rc_buffer_size = static_cast<int>(s.bit_rate / 2);
+        ctx->qmin = 4;
+        ctx->qmax = 56;
+        if (name == "libvpx-vp9") {
+            av_dict_set(opts, "row-mt", "1", 0);
+            av_dict_set(opts, "tile-columns", "2", 0);
+            av_dict_set(opts, "aq-mode", "3", 0); // cyclic refresh, suited to video calls
+            if (!s.tune.empty()) av_dict_set(opts, "tune-content", s.tune.c_str(), 0);
+        }
+    } else if (name == "libsvtav1") {
+        // svtav1-params (low-delay prediction, rc) is set with the rate control below
+        av_dict_set(opts, "preset", s.preset.empty() ? "10" : s.preset.c_str(), 0);
+    } else if (name == "libaom-av1") {
+        av_dict_set(opts, "usage", "realtime", 0);
+        av_dict_set(opts, "cpu-used", s.preset.empty() ? "8" : s.preset.c_str(), 0);
+        av_dict_set(opts, "lag-in-frames", "0", 0);
+    }
+}
+
+// Rate control on top of the per-encoder defaults above
+void set_rate_control(const AVCodec* encoder, const CodecSettings& s, AVCodecContext* ctx,
+                      AVDictionary** opts) {
+    const std::string name = encoder->name;
+    const std::string quality = std::to_string(s.quality);
+
+    if (name == "libsvtav1") {
+        // svtav1-params is applied after crf and bit_rate, so rc here decides the mode
+        const char* rc = s.rate_control == RateControl::CQ ? "0" : s.rate_control == RateControl::VBR ? "1" : "2";
+        av_dict_set(opts, "svtav1-params", (std::string("pred-struct=1:lookahead=0:rc=") + rc).c_str(), 0);
+    }
+
+    switch (s.rate_control) {
+    case RateControl::CBR:
+        // min == max == bit_rate: libx264 pads with filler and libvpx switches to VPX_CBR
+        ctx->rc_min_rate = s.bit_rate;
+        ctx->rc_max_rate = s.bit_rate;
+        ctx->rc_buffer_size = static_cast<int>(s.bit_rate / 2);
+        break;
+    case RateControl::VBR:
+        break;
+    case RateControl::CQ:
+        if (name == "libx264" || name == "libsvtav1") {
+            ctx->bit_rate = 0;
+            av_dict_set(opts, "crf", quality.c_str(), 0);
+        } else if (name == "libvpx" || name == "libvpx-vp9" || name == "libaom-av1") {
+            // Constrained quality: crf with bit_rate as the ceiling
+            av_dict_set(opts, "crf", quality.c_str(), 0);
+        } else if (name == "h264_videotoolbox") {
+            std::cerr << "VideoToolbox has no constant-quality mode, using VBR" << std::endl;
+        }
+        break;
+    }
+}
+
+std::vector<VideoCodec> probe(bool encoders) {
+    std::vector<VideoCodec> found;
+    for (const auto& info : codec_table()) {
+        bool present = false;
+        if (encoders) {
+            CodecSettings s;
+            s.codec = info.codec;
+            present = find_encoder(s) != nullptr;
+        } else {
+            present = find_decoder(info.codec) != nullptr;
+        }
+        if (present) found.push_back(info.codec);
+    }
+    return found;
+}
+
+} // namespace
+
+const char* codec_name(VideoCodec codec) {
+    return info_for(codec).name;
+}
+
+AVCodecID video_codec_id(VideoCodec codec) {
+    return info_for(codec).id;
+}
+
+const char* rate_control_name(RateControl rc) {
+    switch (rc) {
+    case RateControl::CBR: return "cbr";
+    case RateControl::CQ:  return "cq";
+    default:               return "vbr";
+    }
+}
+
+bool parse_rate_control(const std::string& name, RateControl& out) {
+    for (RateControl rc : {RateControl::CBR, RateControl::VBR, RateControl::CQ}) {
+        if (name == rate_control_name(rc)) {
+            out = rc;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool parse_codec_name(const std::string& name, VideoCodec& out) {
+    for (const auto& info : codec_table()) {
+        if (name == info.name) {
+            out = info.codec;
+            return true;
+        }
+    }
+    return false;
+}
+
+std::string format_codec_list(const std::vector<VideoCodec>& codecs) {
+    std::string list;
+    for (VideoCodec c : codecs) {
+        if (!list.empty()) list += "+";
+        list += codec_name(c);
+    }
+    return list;
+}
+
+std::vector<VideoCodec> parse_codec_list(const std::string& list) {
+    std::vector<VideoCodec> codecs;
+    std::istringstream iss(list);
+    std::string item;
+    while (std::getline(iss, item, '+')) {
+        VideoCodec c;
+        if (parse_codec_name(item, c)) codecs.push_back(c);
+    }
+    return codecs;
+}
+
+const std::vector<VideoCodec>& supported_encoders() {
+    static const std::vector<VideoCodec> encoders = probe(true);
+    return encoders;
+}
+
+const std::vector<VideoCodec>& supported_decoders() {
+    static const std::vector<VideoCodec> decoders = probe(false);
+    return decoders;
+}
+
+std::vector<VideoCodec> default_codec_preference() {
+    if (avcodec_find_encoder_by_name("h264_videotoolbox")) {
+        return {VideoCodec::H264, VideoCodec::VP9, VideoCodec::VP8, VideoCodec::AV1};
+    }
+    return {VideoCodec::VP9, VideoCodec::VP8, VideoCodec::H264, VideoCodec::AV1};
+}
+
+VideoCodec negotiate_codec(const std::vector<VideoCodec>& preference,
+                           const std::vector<VideoCodec>& peer_decoders) {
+    const auto& local = supported_encoders();
+    for (VideoCodec c : preference) {
+        bool can_encode = std::find(local.begin(), local.end(), c) != local.end();
+        bool peer_decodes = peer_decoders.empty()
+            ? c == VideoCodec::H264
+            : std::find(peer_decoders.begin(), peer_decoders.end(), c) != peer_decoders.end();
+        if (can_encode && peer_decodes) return c;
+    }
+    return VideoCodec::H264;
+}
+
+AVCodecContext* open_video_encoder(const CodecSettings& settings) {
+    const AVCodec* encoder = find_encoder(settings);
+    if (!encoder) {
+        std::cerr << "No encoder available for " << codec_name(settings.codec) << std::endl;
+        return nullptr;
+    }
+    std::cout << "Using " << (is_hardware(encoder->name) ? "hardware" : "software")
+              << " encoder (" << encoder->name << ")" << std::endl;
+
+    AVCodecContext* ctx = avcodec_alloc_context3(encoder);
+    ctx->width = settings.width;
+    ctx->height = settings.height;
+    ctx->time_base = {1, settings.fps};
+    ctx->framerate = {settings.fps, 1};
+    ctx->pix_fmt = AV_PIX_FMT_YUV420P;
+    ctx->bit_rate = settings.bit_rate;
+    ctx->gop_size = settings.gop;
+    ctx->max_b_frames = 0; // Low latency
+    ctx->thread_count = settings.threads;
+
+    AVDictionary* opts = nullptr;
+    set_realtime_options(encoder, settings, ctx, &opts);
+    set_rate_control(encoder, settings, ctx, &opts);
+
+    int ret = avcodec_open2(ctx, encoder, &opts);
+    av_dict_free(&opts);
+    if (ret < 0) {
+        std::cerr << "Failed to open encoder " << encoder->name << std::endl;
+        avcodec_free_context(&ctx);
+        return nullptr;
+    }
+    return ctx;
+}
+
+void set_video_bit_rate(AVCodecContext* ctx, const CodecSettings& s, int64_t bit_rate) {
+    switch (s.rate_control) {
+    case RateControl::CBR:
+        ctx->bit_rate = bit_rate;
+        ctx->rc_min_rate = bit_rate;
+        ctx->rc_max_rate = bit_rate;
+        break;
+    case RateControl::VBR:
+        ctx->bit_rate = bit_rate;
+        break;
+    case RateControl::CQ:
+        // Quality, not bit_rate, drives the encoder; x264 and SVT would leave CRF for ABR
+        break;
+    }
+}
+
+AVCodecContext* open_video_decoder(VideoCodec codec) {
+    const AVCodec* decoder = find_decoder(codec);
+    if (!decoder) {
+        std::cerr << "No decoder available for " << codec_name(codec) << std::endl;
+        return nullptr;
+    }
+
+    AVCodecContext* ctx = avcodec_alloc_context3(decoder);
+    ctx->flags |= AV_CODEC_FLAG_LOW_DELAY;
+    if (avcodec_open2(ctx, decoder, nullptr) < 0) {
+        avcodec_free_context(&ctx);
+        return nullptr;
+    }
+    return ctx;
+}
+
+std::string encoder_pool_key(const CodecSettings& s) {
+    std::ostringstream key;
+    key << "enc:" << codec_name(s.codec) << ":" << s.preset << ":" << s.tune << ":" << s.width << "x" << s.height
+        << "@" << s.fps << ":" << s.bit_rate << ":" << rate_control_name(s.rate_control) << s.quality
+        << ":" << s.gop << ":" << s.threads << (s.allow_hardware ? ":hw" : ":sw");
+    return key.str();
+}
+
+std::string decoder_pool_key(VideoCodec codec) {
+    return std::string("dec:") + codec_name(codec);
+}
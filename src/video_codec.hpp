@@ -0,0 +1,87 @@
+#ifndef VIDEO_CODEC_HPP
+#define VIDEO_CODEC_HPP
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+}
+
+/*
+  Codec abstraction for the media path. Each call negotiates one of these:
+  the caller picks the first codec in its preference order that it can
+  encode and the peer advertised (via discovery) that it can decode.
+*/
+enum class VideoCodec : uint8_t {
+    H264 = 0,
+    VP8  = 1,
+    VP9  = 2,
+    AV1  = 3,
+};
+
+// Media type byte on the wire: low nibble = packet type (1 video, 2 audio),
+// high nibble = VideoCodec. H.264 packs to the legacy value.
+inline uint8_t pack_media_type(uint8_t type, VideoCodec codec) {
+    return static_cast<uint8_t>(type | (static_cast<uint8_t>(codec) << 4));
+}
+inline uint8_t media_type_kind(uint8_t packed) { return packed & 0x0f; }
+inline VideoCodec media_type_codec(uint8_t packed) { return static_cast<VideoCodec>(packed >> 4); }
+
+// CBR: held at bit_rate (min = max) with a half-second buffer. VBR: bit_rate on average
+// (the encoder's own real-time caps apply). CQ: constant quality at `quality`
+// (CRF-style, lower is better), bit_rate only as a ceiling where supported.
+enum class RateControl : uint8_t { CBR, VBR, CQ };
+
+struct CodecSettings {
+    VideoCodec codec = VideoCodec::H264;
+    std::string preset;          // codec specific, empty = real-time default
+    std::string tune;            // libx264 tune / libvpx-vp9 tune-content, empty = default
+    int width = 1280;
+    int height = 720;
+    int fps = 30;
+    int64_t bit_rate = 2000000;
+    RateControl rate_control = RateControl::VBR;
+    int quality = 28;            // CQ only
+    int gop = 30;
+    int threads = 0;             // 0 = let the codec decide
+    bool allow_hardware = true;  // e.g. h264_videotoolbox
+};
+
+const char* codec_name(VideoCodec codec);
+const char* rate_control_name(RateControl rc);
+bool parse_rate_control(const std::string& name, RateControl& out);
+AVCodecID video_codec_id(VideoCodec codec);
+bool parse_codec_name(const std::string& name, VideoCodec& out);
+
+// "vp9+vp8+h264" <-> list, as advertised in discovery
+std::string format_codec_list(const std::vector<VideoCodec>& codecs);
+std::vector<VideoCodec> parse_codec_list(const std::string& list);
+
+// Codecs this build can actually encode / decode, probed once
+const std::vector<VideoCodec>& supported_encoders();
+const std::vector<VideoCodec>& supported_decoders();
+
+// Default preference: hardware H.264 when present, otherwise the software
+// codecs that spend the fewest bits per quality at our rates in real time
+std::vector<VideoCodec> default_codec_preference();
+
+// First codec in preference that we can encode and the peer can decode.
+// An empty peer list means an older client that only knows H.264.
+VideoCodec negotiate_codec(const std::vector<VideoCodec>& preference,
+                           const std::vector<VideoCodec>& peer_decoders);
+
+// Opened contexts, nullptr on failure. Callers own the result (or pool it).
+AVCodecContext* open_video_encoder(const CodecSettings& settings);
+AVCodecContext* open_video_decoder(VideoCodec codec);
+
+// Change an open encoder's target mid-stream (libx264 applies it on the next
+// frame); a no-op under CQ, where bit_rate is not the target
+void set_video_bit_rate(AVCodecContext* ctx, const CodecSettings& settings, int64_t bit_rate);
+
+// Pool keys that capture everything fixed at avcodec_open2 time
+std::string encoder_pool_key(const CodecSettings& settings);
+std::string decoder_pool_key(VideoCodec codec);
+
+#endif // VIDEO_CODEC_HPP